@@ -0,0 +1,105 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "Memory.h"
+#include "PPU.h"
+#include "Settings.h"
+
+// Frames per second of the PPU alone, drawing the background from tiles against the background cache.
+// The scene scrolls a little every frame and has sprites on. Without raster effects the cache draws every
+// line. With a PPUADDR split every frame it draws the lines above the split, and with a CHR bank switched for
+// the bottom lines every frame it also re-renders the tiles it shows each frame. Both runs have to end on
+// the same frame.
+// Usage: PPUBenchmark [frames]
+
+namespace {
+    constexpr i64 frameLength = 262 * 341;
+
+    struct Result {
+        double fps = 0;
+        u64 hash = 0;
+    };
+
+    enum class Scene { Scrolling, Split, Banks };
+
+    Result measure(bool cache, Scene scene, u32 frames) {
+        Memory memory(ramSize);
+        memory.init();
+        PPU ppu(&memory);
+        ppu.setBackgroundCache(cache);
+
+        std::mt19937 rng(1);
+        std::vector<u8> chr(chrSize);
+        for (auto& byte : chr)
+            byte = rng() & 0xff;
+        ppu.loadChr(chr.data(), chr.size());
+        ppu.setMirroring(nes_mapper_flags_vertical_mirroring);
+        for (u16 addr = 0x2000; addr < 0x2800; ++addr)
+            ppu.writeVram(addr, rng() & 0xff);
+        for (u16 addr = 0x3f00; addr < 0x3f20; ++addr)
+            ppu.writeVram(addr, rng() & 0x3f);
+        for (u16 i = 0; i < oamSize; ++i)
+            memory.write(0x200 + i, rng() & 0xff);
+        memory.oamDMA(0x200);
+
+        auto start = std::chrono::steady_clock::now();
+        for (u32 frame = 0; frame < frames; ++frame)
+        {
+            const i64 begin = frame * frameLength;
+
+            if (scene == Scene::Split)
+            {
+                ppu.step(nes_cycle_t(begin + 120 * 341 + 260));
+                memory.read(ppu::PPUSTATUSAddress);
+                memory.write(ppu::PPUADDRAddress, 0x24);
+                memory.write(ppu::PPUADDRAddress, 0x00);
+            }
+            else if (scene == Scene::Banks)
+            {
+                // the status bar has its own tiles, the playfield gets them back in vblank
+                ppu.step(nes_cycle_t(begin + 200 * 341 + 260));
+                ppu.setChrPage(0, 4);
+                ppu.step(nes_cycle_t(begin + 241 * 341));
+                ppu.setChrPage(0, 0);
+            }
+
+            // a pixel right and down every frame, in vblank like a game does it
+            ppu.step(nes_cycle_t(begin + 242 * 341));
+            memory.read(ppu::PPUSTATUSAddress);
+            memory.write(ppu::PPUSCROLLAddress, frame & 0xff);
+            memory.write(ppu::PPUSCROLLAddress, frame % 240);
+            memory.write(ppu::PPUCTRLAddress, (frame >> 8) & 1);
+            memory.write(ppu::PPUMASKAddress, 0x1e);
+        }
+        ppu.step(nes_cycle_t(frames * frameLength));
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {frames / elapsed.count(), ppu.getFrameHash()};
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const u32 frames = argc > 1 ? u32(std::strtoul(argv[1], null, 10)) : 600;
+
+    const std::pair<Scene, const char*> scenes[] = {
+        {Scene::Scrolling, "scrolling"}, {Scene::Split, "split"}, {Scene::Banks, "banks"},
+    };
+
+    for (const auto& [scene, name] : scenes)
+    {
+        const Result tiles = measure(false, scene, frames);
+        const Result cached = measure(true, scene, frames);
+        std::printf("%-10s  tiles %8.1f  cache %8.1f  fps  %5.2fx\n", name, tiles.fps, cached.fps, cached.fps / tiles.fps);
+
+        if (tiles.hash != cached.hash)
+        {
+            std::fprintf(stderr, "the cache drew a different frame\n");
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <numbers>
+#include <vector>
+
+#include "Resampler.h"
+#include "Types.h"
+
+// Output samples per second the resampler produces for every quality, from the APU's native rate and from
+// the intermediate rate the APU feeds it, to the usual device rates.
+// Usage: ResamplerBenchmark [input seconds]
+
+namespace {
+    // NTSC CPU clock, the rate the channels run at, and the box averaged rate the APU resamples from
+    constexpr double nativeRate = 21477272.0 / 12;
+    constexpr double intermediateRate = nativeRate / 8;
+
+    double measure(double inRate, double outRate, ResampleQuality quality, double seconds, u16& taps) {
+        Resampler resampler(inRate, outRate, quality);
+        taps = resampler.getTaps();
+
+        // what the APU hands over, flat stretches with steps in between
+        std::vector<float> chunk(size_t(inRate / 240));
+        for (size_t i = 0; i < chunk.size(); ++i)
+            chunk[i] = (i / 97) % 2 ? 3000.0f : -3000.0f;
+
+        std::vector<float> out(resampler.maxOutput(chunk.size()));
+        const u32 chunks = u32(seconds * 240);
+        u64 produced = 0;
+
+        auto start = std::chrono::steady_clock::now();
+        for (u32 i = 0; i < chunks; ++i)
+            produced += resampler.process(chunk.data(), chunk.size(), out.data());
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return produced / elapsed.count();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const double seconds = argc > 1 ? std::atof(argv[1]) : 1;
+
+    const struct {
+        const char* name;
+        ResampleQuality quality;
+    } qualities[] = {
+        {"fast", ResampleQuality::Fast},
+        {"medium", ResampleQuality::Medium},
+        {"high", ResampleQuality::High},
+    };
+
+    for (double inRate : {nativeRate, intermediateRate})
+        for (double outRate : {44100.0, 48000.0, 96000.0})
+            for (const auto& quality : qualities)
+            {
+                u16 taps;
+                const double rate = measure(inRate, outRate, quality.quality, seconds, taps);
+                std::printf("%8.0f Hz -> %5.0f Hz %-7s %4u taps %12.0f samples/s %8.1fx realtime\n",
+                            inRate, outRate, quality.name, taps, rate, rate / outRate);
+            }
+
+    return 0;
+}
@@ -0,0 +1,131 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <vector>
+
+#include "NtscFilter.h"
+#include "Scaler.h"
+#include "Settings.h"
+#include "WorkerPool.h"
+
+// Scaled frames per second for every filter and the NTSC filter, on one thread and on the worker pool.
+// Usage: ScalerBenchmark [frames]
+
+namespace {
+    // tile-like picture with a handful of colours, close to what the scalers see in games
+    std::vector<u8> makeIndices() {
+        std::mt19937 rng(2002);
+
+        std::vector<u8> tiles(32 * 30);
+        for (auto& tile : tiles)
+            tile = rng() % 64;
+
+        std::vector<u8> frame(resolution.x * resolution.y);
+        for (int y = 0; y < resolution.y; ++y)
+            for (int x = 0; x < resolution.x; ++x)
+            {
+                u8 tile = tiles[(y / 8) * 32 + x / 8];
+                frame[y * resolution.x + x] = (tile + (((x + tile) ^ (y * tile)) >> 2) % 4) & 0x3f;
+            }
+
+        return frame;
+    }
+
+    std::vector<u32> makeFrame() {
+        std::mt19937 rng(2002);
+        const u32 colors[] = {0x1d1d5500, 0xf8d84000, 0xc8282800, 0x30a03000, 0xffffff00, 0x00000000};
+
+        std::vector<u8> tiles(32 * 30);
+        for (auto& tile : tiles)
+            tile = rng() % 16;
+
+        std::vector<u32> frame(resolution.x * resolution.y);
+        for (int y = 0; y < resolution.y; ++y)
+            for (int x = 0; x < resolution.x; ++x)
+            {
+                u8 tile = tiles[(y / 8) * 32 + x / 8];
+                u8 pixel = ((x + tile) ^ (y * tile)) >> 2;
+                frame[y * resolution.x + x] = colors[(pixel + tile) % 6];
+            }
+
+        return frame;
+    }
+
+    double measure(Scaler& scaler, const std::vector<u32>& frame, std::vector<u32>& output, int frames) {
+        const u32 pitch = resolution.x * scaler.getFactor();
+        output.resize(pitch * resolution.y * scaler.getFactor());
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+            scaler.scale(frame.data(), resolution.x, resolution.y, output.data(), pitch);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return frames / elapsed.count();
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const int frames = argc > 1 ? std::atoi(argv[1]) : 500;
+
+    struct Case {
+        const char* name;
+        ScaleFilter filter;
+        u8 factor;
+    };
+
+    const Case cases[] = {
+        {"nearest 2x", ScaleFilter::Nearest, 2},
+        {"nearest 3x", ScaleFilter::Nearest, 3},
+        {"nearest 4x", ScaleFilter::Nearest, 4},
+        {"nearest 5x", ScaleFilter::Nearest, 5},
+        {"scale2x", ScaleFilter::Scale2x, 2},
+        {"scale3x", ScaleFilter::Scale3x, 3},
+        {"scale4x", ScaleFilter::Scale4x, 4},
+        {"xbr 2x", ScaleFilter::XBR, 2},
+    };
+
+    std::vector<u32> frame = makeFrame();
+    std::vector<u32> output;
+    WorkerPool pool;
+
+    std::printf("%-12s %12s %12s (%u threads)\n", "filter", "1 thread", "pool", pool.size());
+
+    for (const Case& test : cases)
+    {
+        Scaler single;
+        Scaler parallel(&pool);
+        single.setFilter(test.filter, test.factor);
+        parallel.setFilter(test.filter, test.factor);
+
+        double singleFps = measure(single, frame, output, frames);
+        double parallelFps = measure(parallel, frame, output, frames);
+
+        std::printf("%-12s %8.0f fps %8.0f fps\n", test.name, singleFps, parallelFps);
+    }
+
+    std::vector<u8> indices = makeIndices();
+    std::vector<u8> emphasis(resolution.y, 0);
+    const u32 pitch = resolution.x * NtscFilter::factor;
+    output.resize(pitch * resolution.y * NtscFilter::factor);
+
+    NtscFilter single;
+    NtscFilter parallel(&pool);
+    double fps[2];
+
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        NtscFilter& ntsc = pass == 0 ? single : parallel;
+
+        auto start = std::chrono::steady_clock::now();
+        for (int i = 0; i < frames; ++i)
+            ntsc.filter(indices.data(), emphasis.data(), resolution.x, resolution.y, i, output.data(), pitch);
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        fps[pass] = frames / elapsed.count();
+    }
+
+    std::printf("%-12s %8.0f fps %8.0f fps\n", "ntsc 2x", fps[0], fps[1]);
+
+    return 0;
+}
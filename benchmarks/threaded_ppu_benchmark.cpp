@@ -0,0 +1,130 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+
+#include "APU.h"
+#include "Console.h"
+#include "Settings.h"
+
+// Frames per second of a whole console with the PPU on the CPU's thread against ThreadedPPU. The game
+// scrolls a random background with sprites on, does some work each frame and then polls $2002 for vblank,
+// so most of its reads land while the PPU is rendering. Both runs have to end on the same frame.
+// Usage: ThreadedPPUBenchmark [frames]
+
+namespace {
+    struct Result {
+        double fps = 0;
+        u64 hash = 0;
+    };
+
+    // NROM, 32KB PRG, 8KB of random CHR
+    std::string writeRom() {
+        const std::string path = (std::filesystem::temp_directory_path()
+            / ("threaded_ppu_benchmark_" + std::to_string(std::random_device()()) + ".nes")).string();
+
+        std::vector<u8> prg(0x8000, 0);
+        const std::vector<u8> program = {
+            0x78,                   // reset: SEI
+            0xa9, 0x00,             //        LDA #0
+            0x8d, 0x00, 0x20,       //        STA $2000
+            0x8d, 0x01, 0x20,       //        STA $2001
+            0x2c, 0x02, 0x20,       // warm:  BIT $2002
+            0x10, 0xfb,             //        BPL warm
+            0xa9, 0x20,             //        LDA #$20
+            0x8d, 0x06, 0x20,       //        STA $2006
+            0xa9, 0x00,             //        LDA #0
+            0x8d, 0x06, 0x20,       //        STA $2006
+            0xa0, 0x04,             //        LDY #4
+            0xa2, 0x00,             //        LDX #0
+            0x8e, 0x07, 0x20,       // fill:  STX $2007
+            0xe8,                   //        INX
+            0xd0, 0xfa,             //        BNE fill
+            0x88,                   //        DEY
+            0xd0, 0xf7,             //        BNE fill
+            0xa9, 0x3f,             //        LDA #$3f
+            0x8d, 0x06, 0x20,       //        STA $2006
+            0xa9, 0x00,             //        LDA #0
+            0x8d, 0x06, 0x20,       //        STA $2006
+            0x8e, 0x07, 0x20,       // pal:   STX $2007
+            0xe8,                   //        INX
+            0xe0, 0x20,             //        CPX #$20
+            0xd0, 0xf8,             //        BNE pal
+            0xa2, 0x00,             //        LDX #0
+            0x8a,                   // oam:   TXA
+            0x9d, 0x00, 0x02,       //        STA $0200,X
+            0xe8,                   //        INX
+            0xd0, 0xf9,             //        BNE oam
+            0xa9, 0x02,             // main:  LDA #2
+            0x8d, 0x14, 0x40,       //        STA $4014
+            0xa5, 0x00,             //        LDA $00
+            0x8d, 0x05, 0x20,       //        STA $2005
+            0x8d, 0x05, 0x20,       //        STA $2005
+            0xa9, 0x1e,             //        LDA #$1e
+            0x8d, 0x01, 0x20,       //        STA $2001
+            0xe6, 0x00,             //        INC $00
+            0xa2, 0x00,             //        LDX #0
+            0xbd, 0x00, 0x03,       // work:  LDA $0300,X
+            0x69, 0x01,             //        ADC #1
+            0x9d, 0x00, 0x03,       //        STA $0300,X
+            0xe8,                   //        INX
+            0xd0, 0xf5,             //        BNE work
+            0x2c, 0x02, 0x20,       // wait:  BIT $2002
+            0x10, 0xfb,             //        BPL wait
+            0x4c, 0x40, 0x80,       //        JMP main
+        };
+        std::copy(program.begin(), program.end(), prg.begin());
+        prg[0x7ffc] = 0x00;
+        prg[0x7ffd] = 0x80;
+
+        std::mt19937 rng(1);
+        std::vector<char> chr(chrSize);
+        for (auto& byte : chr)
+            byte = char(rng() & 0xff);
+
+        const u8 header[16] = {'N', 'E', 'S', 0x1a, 2, 1};
+        std::ofstream file(path, std::ofstream::binary);
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)prg.data(), prg.size());
+        file.write(chr.data(), chr.size());
+        return path;
+    }
+
+    Result measure(const std::string& path, bool threaded, u32 frames) {
+        Console console;
+        console.setThreadedPPU(threaded);
+        if (!console.load(path))
+            return {};
+        console.audio().setTimingOnly(true);
+
+        auto start = std::chrono::steady_clock::now();
+        for (u32 frame = 0; frame < frames; ++frame)
+            console.runFrame();
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+
+        return {frames / elapsed.count(), console.frame().hash};
+    }
+}
+
+int main(int argc, char* argv[]) {
+    const u32 frames = argc > 1 ? u32(std::strtoul(argv[1], null, 10)) : 600;
+    const std::string path = writeRom();
+
+    const Result single = measure(path, false, frames);
+    const Result threaded = measure(path, true, frames);
+    std::filesystem::remove(path);
+
+    std::printf("single %8.1f  threaded %8.1f  fps  %5.2fx\n", single.fps, threaded.fps, threaded.fps / single.fps);
+
+    if (single.fps == 0 || single.hash != threaded.hash)
+    {
+        std::fprintf(stderr, "the threaded PPU drew a different frame\n");
+        return 1;
+    }
+
+    return 0;
+}
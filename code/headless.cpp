@@ -0,0 +1,137 @@
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <memory>
+#include <string>
+
+#include "APU.h"
+#include "AudioRecorder.h"
+#include "Console.h"
+#include "InputMovie.h"
+#include "Settings.h"
+
+// The emulator without a window or an audio device, for servers and CI. Runs a ROM as fast as it goes for a
+// number of frames or master cycles, then prints the hash of the last frame and how long it took.
+// Usage: NESHeadless <rom> [--frames N] [--cycles N] [--input movie.fm2] [--ppm frame.ppm] [--record sound.wav]
+//                    [--sprite-evaluation dot|scanline] [--frame-skip N] [--background-cache] [--threaded-ppu]
+// 600 frames when no limit is given, with both the first one reached ends the run.
+
+namespace {
+    bool writePpm(const std::string& path, const IndexedFrame& frame) {
+        FILE* file = std::fopen(path.c_str(), "wb");
+        if (!file)
+            return false;
+
+        std::fprintf(file, "P6\n%d %d\n255\n", resolution.x, resolution.y);
+        for (u8 pixel : frame.pixels)
+        {
+            const Color& color = frame.palette[pixel];
+            const u8 rgb[3] = {color.r, color.g, color.b};
+            std::fwrite(rgb, 1, 3, file);
+        }
+
+        return std::fclose(file) == 0;
+    }
+}
+
+int main(int argc, char* argv[]) {
+    if (argc < 2)
+    {
+        std::fprintf(stderr, "usage: %s <rom> [--frames N] [--cycles N] [--input movie.fm2] [--ppm frame.ppm] [--record sound.wav]\n"
+                             "       [--sprite-evaluation dot|scanline] [--frame-skip N] [--background-cache] [--threaded-ppu]\n", argv[0]);
+        return 1;
+    }
+
+    u64 frameLimit = 0;
+    u64 cycleLimit = 0;
+    std::string inputPath, ppmPath, recordPath;
+    ppu::SpriteEvaluation spriteEvaluation = ppu::SpriteEvaluation::Dot;
+    u8 frameSkip = 0;
+    bool backgroundCache = false;
+    bool threadedPPU = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--frames") == 0 && i + 1 < argc)
+            frameLimit = std::strtoull(argv[++i], null, 10);
+        else if (strcmp(argv[i], "--cycles") == 0 && i + 1 < argc)
+            cycleLimit = std::strtoull(argv[++i], null, 10);
+        else if (strcmp(argv[i], "--input") == 0 && i + 1 < argc)
+            inputPath = argv[++i];
+        else if (strcmp(argv[i], "--ppm") == 0 && i + 1 < argc)
+            ppmPath = argv[++i];
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "--sprite-evaluation") == 0 && i + 1 < argc)
+            spriteEvaluation = strcmp(argv[++i], "scanline") == 0 ? ppu::SpriteEvaluation::Scanline : ppu::SpriteEvaluation::Dot;
+        else if (strcmp(argv[i], "--frame-skip") == 0 && i + 1 < argc)
+            frameSkip = u8(std::strtoul(argv[++i], null, 10));
+        else if (strcmp(argv[i], "--background-cache") == 0)
+            backgroundCache = true;
+        else if (strcmp(argv[i], "--threaded-ppu") == 0)
+            threadedPPU = true;
+    }
+    if (frameLimit == 0 && cycleLimit == 0)
+        frameLimit = 600;
+
+    InputMovie movie;
+    if (!inputPath.empty() && !movie.load(inputPath))
+        return 1;
+
+    Console console;
+    console.setSpriteEvaluation(spriteEvaluation);
+    console.setFrameSkip(frameSkip);
+    console.setBackgroundCache(backgroundCache);
+    console.setThreadedPPU(threadedPPU);
+    if (!console.load(argv[1]))
+        return 1;
+
+    APU& apu = console.audio();
+    // nothing plays the sound, it's either recorded at exactly audioFrequency or not made at all
+    apu.setTimingOnly(recordPath.empty());
+    apu.setRateControl(false);
+
+    std::unique_ptr<AudioRecorder> recorder;
+    if (!recordPath.empty())
+    {
+        recorder = std::make_unique<AudioRecorder>(recordPath, AudioRecorder::formatFor(recordPath), audioFrequency,
+                                                   AudioRecorder::Overflow::Wait);
+        if (!recorder->isOpen())
+            return 1;
+        apu.setRecorder(recorder.get());
+    }
+
+    const nes_cycle_t until = cycleLimit != 0 ? nes_cycle_t(cycleLimit) : nes_cycle_t::max();
+    const auto start = std::chrono::steady_clock::now();
+
+    // the buttons of each frame go in before it starts
+    for (u32 frame = 0; frameLimit == 0 || frame < frameLimit; frame = console.getFrameCount())
+    {
+        console.setInput(0, movie.getButtons(frame, 0));
+        console.setInput(1, movie.getButtons(frame, 1));
+
+        if (!console.runFrame(until))
+            break;
+    }
+
+    const std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    const u64 frames = console.getFrameCount();
+    const double emulated = double(console.getCycle().count()) / NES_CLOCK_HZ;
+
+    if (recorder)
+    {
+        apu.setRecorder(null);
+        recorder->close();
+    }
+
+    if (!ppmPath.empty() && !writePpm(ppmPath, console.frame()))
+        std::fprintf(stderr, "can't write %s\n", ppmPath.c_str());
+
+    std::printf("frames %llu\n", (unsigned long long)frames);
+    std::printf("cycles %lld\n", (long long)console.getCycle().count());
+    std::printf("hash %016llx\n", (unsigned long long)console.frame().hash);
+    std::printf("time %.3f s, %.1f fps, %.2fx realtime\n",
+                elapsed.count(), frames / elapsed.count(), emulated / elapsed.count());
+
+    return 0;
+}
@@ -4,7 +4,13 @@
 
 #ifndef APU_H
 #define APU_H
+#include <atomic>
+#include <memory>
+
+#include "BlipBuffer.h"
 #include "NESHelpers.h"
+#include "Resampler.h"
+#include "RingBuffer.h"
 
 using namespace apu;
 
@@ -17,7 +23,10 @@ public:
     void writeSweep(u8);
     void writeTimerLow(u8);
     void writeTimerHigh(u8);
-    void stepTimer();
+    // runs the timer for that many APU cycles at once
+    void advance(u32 cycles);
+    // APU cycles until the output can change next, 0 when only a register write or the frame counter can change it
+    u32 cyclesToTransition() const;
     void stepSweep();
     void stepEnvelope();
     void stepLength();
@@ -59,7 +68,8 @@ public:
     void writeControl(u8);
     void writeTimerLow(u8);
     void writeTimerHigh(u8);
-    void stepTimer();
+    void advance(u32 cycles);
+    u32 cyclesToTransition() const;
     void stepLength();
     void stepCounter();
 
@@ -77,34 +87,224 @@ private:
     bool counterReload;
 };
 
+class Noise {
+public:
+    friend class APU;
+
+    Noise();
+
+    void writeControl(u8);
+    void writePeriod(u8);
+    void writeLength(u8);
+    void advance(u32 cycles);
+    u32 cyclesToTransition() const;
+    void stepEnvelope();
+    void stepLength();
+
+    u8 out() const;
+
+private:
+    bool enabled = false;
+    bool lengthEnabled = false;
+    u8 lengthValue = 0;
+    // in APU cycles, the table is in CPU cycles
+    u16 timerPeriod = noiseTable[0] / 2 - 1;
+    u16 timerValue = 0;
+    bool shortMode = false;
+    u16 shiftRegister = 1;
+    bool envelopeEnabled = false;
+    bool envelopeLoop = false;
+    bool envelopeStart = false;
+    u8 envelopePeriod = 0;
+    u8 envelopeValue = 0;
+    u8 envelopeVolume = 0;
+    u8 constantVolume = 0;
+
+    static u16 stepShiftRegister(u16 value, bool shortMode);
+};
+
+// delta modulation channel, plays 1-bit deltas fetched from CPU memory
+// https://www.nesdev.org/wiki/APU_DMC
+class DMC {
+public:
+    friend class APU;
+
+    explicit DMC(Memory* memory);
+
+    void writeControl(u8);
+    void writeLevel(u8);
+    void writeAddress(u8);
+    void writeLength(u8);
+    void setEnabled(bool);
+    void advance(u32 cycles);
+    u32 cyclesToTransition() const;
+
+    u8 out() const;
+
+private:
+    Memory* memory = null;
+
+    bool irqEnabled = false;
+    bool loop = false;
+    bool irqFlag = false;
+    u16 timerPeriod = dmcRateTable[0] / 2 - 1;
+    u16 timerValue = 0;
+    u8 level = 0;
+
+    u16 sampleAddress = 0xc000;
+    u16 sampleLength = 1;
+    u16 currentAddress = 0xc000;
+    u16 bytesRemaining = 0;
+
+    u8 shiftRegister = 0;
+    u8 bitsRemaining = 8;
+    bool silence = true;
+    u8 sampleBuffer = 0;
+    bool bufferEmpty = true;
+
+    bool idle() const;
+    void clock();
+    // memory reader, steals the CPU for the fetch
+    void fetch();
+    void restart();
+};
+
+// first order IIR stage, the console's output goes through two high-passes and a low-pass
+// https://www.nesdev.org/wiki/APU_Mixer
+class AudioFilter {
+public:
+    static AudioFilter highPass(float cutoff, float sampleRate);
+    static AudioFilter lowPass(float cutoff, float sampleRate);
+
+    float process(float in);
+
+private:
+    float b0 = 1;
+    float b1 = 0;
+    float a1 = 0;
+    float lastIn = 0;
+    float lastOut = 0;
+};
+
+class AudioRecorder;
 
 class APU {
 public:
     explicit APU(Memory* sharedMemory);
     void step(nes_cycle_t count);
 
-    std::vector<u8>* getSampleBuffer();
-    void clearSampleBuffer();
+    // audio thread, audioFrequency samples, fills dst completely.
+    // Missing samples repeat the last one and count as an underrun.
+    void readSamples(i16* dst, size_t count);
+    // same in [-1, 1]
+    void readSamples(float* dst, size_t count);
+
+    // reads that ran out of samples
+    u64 getUnderruns() const;
+    // samples dropped because the device wasn't reading them fast enough
+    u64 getOverruns() const;
+    // samples waiting for the device right now
+    size_t getQueuedSamples() const;
+    // smoothed number of samples waiting for the device
+    float getBufferFill() const;
+    // current output rate over audioFrequency
+    float getRateRatio() const;
+
+    // no sound, only what the CPU can see is emulated: length counters, the frame IRQ and the DMC's
+    // fetches and IRQ, all exactly as with sound. Channel timers, envelopes, sweeps and mixing are skipped.
+    // Meant to be set once before running, channels don't catch up when it's turned off again.
+    void setTimingOnly(bool enabled);
+    bool isTimingOnly() const;
+
+    // every output sample also goes to the recorder, null stops it. Emulation thread.
+    void setRecorder(AudioRecorder* recorder);
+    // off when nothing plays the samples in realtime, the output then stays at exactly audioFrequency
+    void setRateControl(bool enabled);
+
+    // windowed-sinc resampling instead of band-limited steps, null goes back to those. Set before audio starts.
+    void setResampler(std::optional<ResampleQuality> quality);
+
+    // fill rate control aims for, twice as much is the most the buffer may hold. Set before audio starts.
+    void setTargetFill(u32 samples);
+    u32 getTargetFill() const;
+
+    // $4015 read, clears the frame interrupt flag
+    u8 readStatus();
+
+    // mixed output level as of the last step, before filtering. Not kept up in timing-only mode.
+    i32 getLevel() const;
 
 private:
+    // the bus this APU is on, its IRQ line and DMC stalls go to that console's CPU
+    Memory* memory = null;
     FrameCounter frameCounter;
 
+    // the APU jumps from event to event, channel timers are only brought up to date when something happens
     nes_cycle_t master_cycle = nes_cycle_t(0);
+    // channels are up to date with this cycle
     nes_apu_cycle_t apu_cycle = nes_apu_cycle_t(0);
-    nes_apu_cycle_t sample_cycle = nes_apu_cycle_t(0);
+    // last cycle the emulation asked for
+    nes_apu_cycle_t target_cycle = nes_apu_cycle_t(0);
+    nes_apu_cycle_t nextEvent = nes_apu_cycle_t(0);
+    nes_apu_cycle_t nextFrameStep = nes_apu_cycle_t(stepTable[0]);
 
     Pulse pulse1 = Pulse(1);
     Pulse pulse2 = Pulse(2);
     Triangle triangle;
+    Noise noise;
+    DMC dmc;
+    bool frameIRQ = false;
+    bool timingOnly = false;
+
+    // output level changes go in as band-limited steps, filtered samples come out every few milliseconds
+    BlipBuffer blip;
+    nes_cycle_t blipFrameStart = nes_cycle_t(0);
+    i32 amplitude = 0;
+    std::array<AudioFilter, 3> filters;
+    std::vector<i16> outputSamples;
+
+    // the alternative path: box averages of the output level at an intermediate rate go through a
+    // polyphase sinc resampler
+    static constexpr u8 resampleDivider = 24;
+    std::unique_ptr<Resampler> resampler;
+    nes_cycle_t steppedUntil = nes_cycle_t(0);
+    i64 boxSum = 0;
+    u8 boxCycles = 0;
+    std::vector<float> stepped;
+    std::vector<float> resampled;
+
+    RingBuffer<i16, audioBufferSize> samples;
+    i16 lastSample = 0;
+    std::atomic<u64> underruns{0};
+    std::atomic<u64> overruns{0};
+
+    // dynamic rate control, the output rate follows the buffer fill so latency stays put
+    // whatever pace the emulation and the device actually run at
+    u32 targetFill = audioTargetFill;
+    float smoothedFill = audioTargetFill;
+    float rateIntegral = 0;
+    bool rateControl = true;
 
-    std::vector<u8> sampleBuffer;
+    AudioRecorder* recorder = null;
+    std::atomic<float> bufferFill{audioTargetFill};
+    std::atomic<float> rateRatio{1};
 
-    void stepAPU(nes_apu_cycle_t);
+    void advanceTo(nes_apu_cycle_t cycle);
+    // frame counter steps and channel transitions up to and including cycle
+    void runUntil(nes_apu_cycle_t cycle);
+    void schedule();
     void sequencer();
-    void invokeIRQ() const;
+    void invokeIRQ();
+    // the CPU's IRQ line follows the frame and DMC flags once they are written or read
+    void updateIRQ();
     void quarterFrame();
     void halfFrame();
-    u8 getSample();
+    i32 mix() const;
+    void updateOutput();
+    i16 filter(float sample);
+    void flushAudio();
+    void renderSteps(nes_cycle_t until);
+    void controlRate();
 
     void writeControl(u8 val);
 };
@@ -0,0 +1,40 @@
+#ifndef AUDIOPLAYBACK_H
+#define AUDIOPLAYBACK_H
+
+#include <atomic>
+#include <cstddef>
+
+#include "Types.h"
+
+class APU;
+
+// What an audio device plays from the APU, whatever calls it back. Playback holds the last sample until the
+// buffer is filled to its target, at start and whenever the device ran it dry, instead of crackling through
+// every partial chunk, and keeps track of how late the newest sample plays.
+class AudioPlayback {
+public:
+    AudioPlayback(APU* apu, u32 sampleRate);
+
+    // audio thread, a whole device chunk
+    void fill(i16* dst, size_t count);
+
+    bool isPriming() const;
+    // samples waiting in the APU buffer plus the chunk being played, averaged
+    float getLatencyMs() const;
+    float getMaxLatencyMs() const;
+    // times playback waited for the buffer to fill, the first start included
+    u64 getPrefills() const;
+
+private:
+    APU* apu = null;
+    u32 sampleRate = 0;
+
+    std::atomic<bool> priming{true};
+    i16 held = 0;
+
+    std::atomic<float> latencyMs{0};
+    std::atomic<float> maxLatencyMs{0};
+    std::atomic<u64> prefills{1};
+};
+
+#endif //AUDIOPLAYBACK_H
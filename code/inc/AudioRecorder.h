@@ -0,0 +1,70 @@
+#ifndef AUDIORECORDER_H
+#define AUDIORECORDER_H
+
+#include <atomic>
+#include <fstream>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+#include "Types.h"
+
+// Writes the APU's output to a 16-bit mono WAV or raw PCM file. The emulation thread only copies samples into
+// a bounded queue, a background thread drains it and writes in large blocks, so a slow disk costs dropped
+// samples (counted) and never emulation time, unless the recorder is told to wait instead. The queue holds
+// a few seconds, enough for runs faster than realtime.
+class AudioRecorder {
+public:
+    enum class Format : u8 {
+        Wav,
+        Raw,
+    };
+
+    // what submit does when the queue is full
+    enum class Overflow : u8 {
+        Drop, // live play, the emulation must not wait for the disk
+        Wait, // batch rendering, every sample counts
+    };
+
+    AudioRecorder(const std::string& path, Format format, u32 sampleRate, Overflow overflow = Overflow::Drop);
+    ~AudioRecorder();
+
+    // writes what is still queued, fills in the WAV sizes and closes the file, nothing is submitted after
+    void close();
+
+    // .wav records WAV, anything else raw samples
+    static Format formatFor(const std::string& path);
+
+    bool isOpen() const;
+
+    // emulation thread, blocks only with Overflow::Wait
+    void submit(const i16* samples, size_t count);
+
+    u64 getSamplesWritten() const;
+    // samples that didn't fit in the queue
+    u64 getDropped() const;
+
+private:
+    static constexpr size_t queueSize = 1 << 18;
+    static constexpr size_t blockSize = 1 << 15;
+
+    std::ofstream file;
+    Format format;
+    u32 sampleRate;
+    Overflow overflow;
+
+    RingBuffer<i16, queueSize> queue;
+    std::vector<i16> block;
+    std::atomic<bool> running{false};
+    std::thread writer;
+
+    std::atomic<u64> written{0};
+    std::atomic<u64> dropped{0};
+
+    void run();
+    void writeBlock(size_t count);
+    void writeHeader(u32 dataBytes);
+};
+
+#endif //AUDIORECORDER_H
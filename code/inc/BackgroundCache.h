@@ -0,0 +1,47 @@
+#ifndef BACKGROUNDCACHE_H
+#define BACKGROUNDCACHE_H
+
+#include <vector>
+
+#include "Types.h"
+
+class PPU;
+
+// The four logical nametables pre-rendered as 4-bit background colour indices (attribute bits 3-2,
+// pattern bits 1-0) laid out as a 512x480 bitmap:
+//   0 1
+//   2 3
+// Tiles are re-rendered lazily when a nametable, attribute or pattern write touched them. Palette writes
+// don't invalidate anything, the palette is applied when a line is copied out.
+class BackgroundCache {
+public:
+    explicit BackgroundCache(PPU* ppu);
+
+    void invalidateAll();
+    void invalidateVram(u16 addr);
+
+    // copies the 256 pixels starting at coarse/nametable position v (fine x/y given separately)
+    void copyLine(u16 v, u8 fineX, u8 fineY, u16 patternTable, u8* dst);
+
+    // tiles re-rendered since the last call
+    u32 takeTilesRendered();
+
+private:
+    static constexpr u16 width = 512;
+    static constexpr u16 height = 480;
+    static constexpr u8 tileColumns = 64;
+    static constexpr u8 tileRows = 60;
+
+    PPU* ppu = null;
+
+    std::vector<u8> bitmap;
+    std::vector<u8> dirty;
+    bool patternsDirty = true;
+    u16 patternTable = 0;
+    u32 tilesRendered = 0;
+
+    void markTile(u8 column, u8 row);
+    void renderTile(u8 column, u8 row);
+};
+
+#endif //BACKGROUNDCACHE_H
@@ -0,0 +1,86 @@
+#ifndef BATCHAPU_H
+#define BATCHAPU_H
+
+#include <array>
+#include <vector>
+
+#include "Types.h"
+
+// Many APUs stepped in lockstep, for running a batch of consoles side by side (training agents and the like).
+// Instead of an APU object per console, every piece of channel state is an array over the instances, so
+// timers catch up 4 instances to a vector. Behaves like APU cycle for cycle: the same levels and the same
+// $4015 reads for the same writes.
+// No DMC sample playback, there is no CPU memory to fetch from, only the level set through $4011.
+class BatchAPU {
+public:
+    explicit BatchAPU(u32 instances);
+
+    u32 size() const;
+
+    // $4000-$4017 of one instance, lands before the next cycle
+    void write(u32 instance, u16 addr, u8 val);
+    // clears the instance's frame interrupt flag
+    u8 readStatus(u32 instance);
+
+    // every instance moves that many APU cycles
+    void run(u32 cycles);
+    // current output level of every instance, the same scale as APU::getLevel
+    void mix(i16* levels) const;
+
+    u64 getCycle() const;
+
+    // off runs the scalar fallback even where there is SSE2, the same results either way
+    void setVectorized(bool enabled);
+    bool isVectorized() const;
+
+private:
+    // a lane per instance, rounded up to whole vectors, flags are 0 or 1
+    using Lanes = std::vector<i32>;
+
+    struct Envelope {
+        Lanes enabled, loop, start, period, value, volume, constantVolume;
+    };
+
+    struct Pulse {
+        Lanes enabled, lengthEnabled, length, timerPeriod, timer, dutyMode, duty;
+        Lanes sweepReload, sweepEnabled, sweepNegate, sweepShift, sweepPeriod, sweepValue;
+        Envelope envelope;
+    };
+
+    struct Triangle {
+        Lanes enabled, lengthEnabled, length, timerPeriod, timer, duty;
+        Lanes counterPeriod, counter, counterReload;
+    };
+
+    struct Noise {
+        Lanes enabled, lengthEnabled, length, timerPeriod, timer, shortMode, shift;
+        Envelope envelope;
+    };
+
+    u32 instances = 0;
+    u32 lanes = 0;
+    bool vectorized = true;
+
+    std::array<Pulse, 2> pulses;
+    Triangle triangle;
+    Noise noise;
+    Lanes dmcLevel;
+    Lanes stopIRQ;
+    Lanes frameIRQ;
+
+    // the frame sequence only depends on time, so it is shared
+    u64 cycle = 0;
+    u64 nextFrameStep = 0;
+
+    void runTimers(u32 cycles);
+    void frameStep();
+    void quarterFrame();
+    void halfFrame();
+    void stepEnvelopes(Envelope& envelope);
+
+    u8 pulseOut(const Pulse& pulse, u32 i) const;
+    u8 triangleOut(u32 i) const;
+    u8 noiseOut(u32 i) const;
+};
+
+#endif //BATCHAPU_H
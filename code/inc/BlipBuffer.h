@@ -0,0 +1,54 @@
+#ifndef BLIPBUFFER_H
+#define BLIPBUFFER_H
+
+#include <array>
+#include <vector>
+
+#include "Types.h"
+
+// Band-limited synthesis in the spirit of blargg's blip_buf. Sources only report how much their output
+// changed and when, in clocks of the emulated chip. Every change is added as a band-limited step
+// (a windowed sinc picked out of a table by the sub-sample phase), so the output is free of aliasing and
+// costs nothing while the waveform stays flat.
+class BlipBuffer {
+public:
+    // capacity is in output samples, endFrame has to be called before that many pile up
+    BlipBuffer(double clockRate, double sampleRate, u32 capacity);
+
+    // only between frames, steps already added keep the rate they were added with
+    void setRates(double clockRate, double sampleRate);
+
+    // time is in clocks since the start of the current frame
+    void addDelta(u64 time, i32 delta);
+    // closes the current frame, samples before its end can be read, the next frame starts there
+    void endFrame(u64 time);
+
+    u32 available() const;
+    // up to count samples, returns how many were read
+    u32 read(i16* dst, u32 count);
+    void clear();
+
+private:
+    static constexpr u8 timeBits = 32;
+    static constexpr u8 phaseBits = 5;
+    static constexpr u8 phases = 1 << phaseBits;
+    static constexpr u8 taps = 16;
+    static constexpr u8 kernelBits = 15;
+
+    // output samples per clock, fixed point
+    u64 factor = 0;
+    // start of the current frame in output samples, fixed point, relative to buffer[0]
+    u64 offset = 0;
+    u32 capacity = 0;
+    // buffer entries past this one are all zero
+    u32 used = 0;
+    i64 integrator = 0;
+
+    // each phase sums to 1 << kernelBits, so steps integrate back to their exact height
+    std::array<std::array<i32, taps>, phases> kernels{};
+    std::vector<i64> buffer;
+
+    void buildKernels();
+};
+
+#endif //BLIPBUFFER_H
@@ -32,15 +32,7 @@ public:
 
     nes_cycle_t getCycle() const;
 
-    static void setNMI();
-    static void setDMA(u16 omddmaAddress);
-    static void setIRQ();
-
 private:
-    static bool executeNMI;
-    static bool executeDMA;
-    static bool executeIRQ;
-
     u64 currentInstruction = 0;
 
     Registers* regs = null;
@@ -50,8 +42,6 @@ private:
 
     bool hasCrossedPage = false;
 
-    static u16 OMDDMAAddress;
-
     u16 fetchImmediate() const;
     u16 fetchZeroPage() const;
     u16 fetchZeroPageX() const;
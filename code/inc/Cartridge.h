@@ -16,7 +16,7 @@ enum nes_mapper_flags : u8
 {
     nes_mapper_flags_none = 0,
 
-    nes_mapper_flags_mirroring_mask = 0x3,
+    nes_mapper_flags_mirroring_mask = 0x7,
 
     // A, B
     // A, B
@@ -25,6 +25,18 @@ enum nes_mapper_flags : u8
     // A, A
     // B, B
     nes_mapper_flags_horizontal_mirroring = 0x3,
+
+    // A, A
+    // A, A
+    nes_mapper_flags_one_screen_lower_mirroring = 0x4,
+
+    // B, B
+    // B, B
+    nes_mapper_flags_one_screen_upper_mirroring = 0x5,
+
+    // A, B
+    // C, D  (C and D live in cartridge VRAM)
+    nes_mapper_flags_four_screen_mirroring = 0x6,
 };
 
 struct FileHeader
@@ -44,6 +56,7 @@ struct NESFile {
     std::vector<u8> prg_rom;
     std::vector<u8> chr_rom;
     bool has_trainer;
+    bool four_screen;
     u8 mapper;
     u8 mirroring;
 };
@@ -0,0 +1,92 @@
+#ifndef CONSOLE_H
+#define CONSOLE_H
+
+#include <array>
+#include <functional>
+#include <memory>
+#include <string>
+
+#include "CPU.h"
+#include "NESHelpers.h"
+
+class APU;
+class Cartridge;
+class Controller;
+class PPU;
+class ThreadedPPU;
+
+// The whole machine behind one object, without a window or an audio device: CPU, PPU, APU, the cartridge
+// and both controllers. The SDL frontend, the headless runner and tools all drive it the same way.
+// The CPU's interrupt lines are per thread, so one console runs on a thread at a time, any number of them
+// on different threads.
+class Console {
+public:
+    Console();
+    ~Console();
+
+    Console(const Console&) = delete;
+    Console& operator=(const Console&) = delete;
+
+    // one attempt per console, false when the file can't be used or something was loaded already
+    bool load(const std::string& path);
+    bool isLoaded() const;
+
+    // rendering on a thread of its own, see ThreadedPPU. Only before load, false after it.
+    bool setThreadedPPU(bool threaded);
+    // PPU options, they can be set before load and carry over to the PPU it makes
+    void setSpriteEvaluation(ppu::SpriteEvaluation mode);
+    // runFrame and the frame count keep the full rate, frame() stays on the last drawn one of every skip + 1
+    void setFrameSkip(u8 skip);
+    // background lines copied from pre-rendered nametables, the same picture for less work on most games
+    void setBackgroundCache(bool enabled);
+
+    // until the PPU finishes the next frame or the master cycle reaches until, true when the frame was finished.
+    // Both do nothing before a successful load.
+    bool runFrame(nes_cycle_t until = nes_cycle_t::max());
+    // that many master cycles
+    void run(nes_cycle_t cycles);
+
+    // player 0 or 1, a controller byte as Controller takes it, held until set again
+    void setInput(u8 player, u8 buttons);
+    // or asked for every time the game strobes the controller
+    void setInputSource(u8 player, std::function<u8()> source);
+
+    // the last finished frame, an empty one before load
+    const IndexedFrame& frame();
+    // sound comes out of here, see APU for reading samples, recording and rate control
+    APU& audio();
+
+    Registers* getRegisters() const;
+    // frames finished since load
+    u32 getFrameCount() const;
+    nes_cycle_t getCycle() const;
+
+private:
+    CPU cpu;
+    std::string romPath;
+    std::unique_ptr<Cartridge> cartridge;
+    std::unique_ptr<PPU> ppu;
+    // in the PPU's place when it runs on its own thread
+    std::unique_ptr<ThreadedPPU> threadedPPU;
+    std::unique_ptr<APU> apu;
+    std::array<std::unique_ptr<Controller>, 2> controllers;
+
+    bool threaded = false;
+    ppu::SpriteEvaluation spriteEvaluation = ppu::SpriteEvaluation::Dot;
+    u8 frameSkip = 0;
+    bool backgroundCache = false;
+
+    nes_cycle_t master_cycle = nes_cycle_t(0);
+    u32 firstFrame = 0;
+    // frame() only copies the PPU's front buffer when a new one was finished
+    IndexedFrame lastFrame;
+    bool lastFrameValid = false;
+    u32 lastFrameCount = 0;
+
+    void stepPPU(nes_cycle_t cycle);
+    u32 ppuFrameCount() const;
+    // where options go, the threaded one's PPU once its thread caught up, null before load
+    PPU* optionsPPU();
+};
+
+#endif //CONSOLE_H
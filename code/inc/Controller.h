@@ -5,26 +5,28 @@
 #ifndef CONTROLLER_H
 #define CONTROLLER_H
 
-#include <SDL_events.h>
-#include <vector>
+#include <functional>
 
 #include "Types.h"
 
 
 class Memory;
 
+// Buttons are one byte, bit 7 down to bit 0: A, B, Select, Start, Up, Down, Left, Right, the order the
+// console shifts them out in.
 class Controller {
 public:
-    Controller(Memory* mem, u16 relatedMemoryAddress, const SDL_Scancode* keys);
-    void setButtonState(SDL_Keycode button, bool pressed);
+    Controller(Memory* mem, u16 relatedMemoryAddress);
+    // asked for the buttons every time the game strobes the controller, without one they stay as last set
+    void setInputSource(std::function<u8()> source);
     void setButtonState(u8 val);
     u8 getButtonState();
-    void updateFromSDL(const SDL_Event& event); // Nowa metoda do obsługi SDL2
 
 private:
     Memory* sharedMemory = null;
-    std::vector<std::pair<SDL_Scancode, bool>> keymap;
+    std::function<u8()> inputSource;
     u16 controllerInputMemoryAddress = 0;
+    u8 buttons = 0;
     u8 keysValue = 0;
     u8 buttonID = 0;
 
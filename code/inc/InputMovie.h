@@ -0,0 +1,25 @@
+#ifndef INPUTMOVIE_H
+#define INPUTMOVIE_H
+
+#include <array>
+#include <string>
+#include <vector>
+
+#include "Types.h"
+
+// Recorded controller input, one line per frame in the layout of FCEUX's fm2 movies:
+// |commands|RLDUTSBA|RLDUTSBA|...  https://fceux.com/web/help/fm2.html
+// Any character but '.' or ' ' holds the button. Header lines are skipped, the commands (resets) are ignored.
+class InputMovie {
+public:
+    bool load(const std::string& path);
+
+    u32 getFrameCount() const;
+    // controller byte for Controller::setButtonState, nothing held past the last frame
+    u8 getButtons(u32 frame, u8 player) const;
+
+private:
+    std::vector<std::array<u8, 2>> frames;
+};
+
+#endif //INPUTMOVIE_H
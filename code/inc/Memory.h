@@ -22,6 +22,17 @@
     //0x6000 - 0x7FFF: SRAM (opcjonalna, np. do zapisów stanu gry).
     //0x8000 - 0xFFFF: PRG-ROM (kod programu).
 
+// what the chips on a bus ask of its CPU, the CPU looks at it before each instruction
+struct CPULines {
+    bool nmi = false;
+    // a level, held by the APU until its flags are acknowledged
+    bool irq = false;
+    bool dma = false;
+    u16 dmaAddress = 0;
+    // DMC sample fetches, the CPU is halted for that many of its cycles before the next instruction
+    u16 stall = 0;
+};
+
 class Memory {
 public:
     explicit Memory(u32 maxSize);
@@ -46,6 +57,10 @@ public:
 
     std::vector<std::function<bool(u16, u8&)>> beforeWrite;
     std::vector<std::function<std::optional<u8>(u16)>> beforeRead;
+    // copies the page at the address into OAM, set by whoever owns the sprites of this console's PPU
+    std::function<void(u16)> oamDMA;
+    // per console, so consoles sharing a thread don't share interrupts
+    CPULines cpuLines;
 
 private:
     std::vector<u8> data;
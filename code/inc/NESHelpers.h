@@ -5,16 +5,18 @@
 #ifndef NESHELPERS_H
 #define NESHELPERS_H
 
+#include <array>
 #include <iomanip>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "Memory.h"
 #include "Types.h"
 #include <chrono>
-#include <SDL_keycode.h>
 
 #include "Logger.h"
+#include "Settings.h"
 
 
 class PPU;
@@ -50,6 +52,59 @@ struct Color {
     }
 };
 
+// A frame as the PPU made it, a quarter of the size of RGBA. Pixels are a colour (bits 5-0) in one of
+// 4 palette slots (bits 7-6), each slot holds the 64 colours under one set of emphasis bits.
+// Frames using more than 4 emphasis combinations share the last slot.
+struct IndexedFrame {
+    std::vector<u8> pixels;
+    // PPUMASK emphasis bits (BGR, bits 2-0) per line
+    std::vector<u8> emphasis;
+    std::array<Color, 256> palette{};
+    u32 number = 0;
+
+    // hash of each stripe of lines and of the whole picture, equal frames have equal hashes
+    std::array<u64, stripeCount> stripes{};
+    u64 hash = 0;
+
+    // bit n set when stripe n differs from the previous frame's
+    u32 changedStripes(const std::array<u64, stripeCount>& previous) const {
+        u32 changed = 0;
+        for (u8 i = 0; i < stripeCount; ++i)
+            if (stripes[i] != previous[i])
+                changed |= 1u << i;
+        return changed;
+    }
+};
+
+// What a consumer last showed, so frames identical to it can be skipped by their hash alone
+class ShownFrame {
+public:
+    bool isSet() const { return set; }
+
+    // the NTSC picture still moves with the frame parity, so with parityMatters only same parity frames match
+    bool matches(const IndexedFrame& frame, bool parityMatters) const {
+        return set && frame.hash == hash && (!parityMatters || (frame.number & 1) == (number & 1));
+    }
+
+    // what has to be redrawn to get from the shown frame to this one, everything when nothing is shown
+    u32 changedStripes(const IndexedFrame& frame) const {
+        return set ? frame.changedStripes(stripes) : (1u << stripeCount) - 1;
+    }
+
+    void show(const IndexedFrame& frame) {
+        set = true;
+        hash = frame.hash;
+        number = frame.number;
+        stripes = frame.stripes;
+    }
+
+private:
+    bool set = false;
+    u64 hash = 0;
+    u32 number = 0;
+    std::array<u64, stripeCount> stripes{};
+};
+
 namespace cpu {
     enum class AddressingMode : i8
     {
@@ -135,6 +190,24 @@ namespace opcodes {
 }
 
 namespace ppu {
+    constexpr u16 PPUCTRLAddress = 0x2000;
+    constexpr u16 PPUMASKAddress = 0x2001;
+    constexpr u16 PPUSTATUSAddress = 0x2002;
+    constexpr u16 OAMADDRAddress = 0x2003;
+    constexpr u16 OAMDATAAddress = 0x2004;
+    constexpr u16 PPUSCROLLAddress = 0x2005;
+    constexpr u16 PPUADDRAddress = 0x2006;
+    constexpr u16 PPUDATAAddress = 0x2007;
+    constexpr u16 OAMDMAAddress = 0x4014;
+
+    // https://www.nesdev.org/wiki/PPU_palettes#Memory_Map
+    // $3f10/$3f14/$3f18/$3f1c are mirrors of $3f00/$3f04/$3f08/$3f0c
+    constexpr std::array<u8, 0x20> paletteMirror = [] {
+        std::array<u8, 0x20> table{};
+        for (u8 i = 0; i < 0x20; ++i)
+            table[i] = (i & 0x13) == 0x10 ? i & 0x0f : i;
+        return table;
+    }();
 
     struct Sprite {
         u8 y = 0;
@@ -143,6 +216,33 @@ namespace ppu {
         u8 x = 0;
     };
 
+    enum class SpriteEvaluation : u8 {
+        Dot,        // secondary OAM filled over cycles 65-256, one OAM entry per two dots
+        Scanline    // all 64 entries range-checked at once on cycle 257
+    };
+
+    // bit n set when OAM entry n covers the scanline (sprites are drawn one line below their Y)
+    u64 spritesInRange(const u8* oam, u16 scanline, u8 spriteHeight);
+
+    // one scanline worth of layers, masks hold 0x00 or 0xff per pixel
+    struct LineBuffer {
+        alignas(16) std::array<u8, resolution.x> bgColor{};
+        alignas(16) std::array<u8, resolution.x> bgOpaque{};
+        alignas(16) std::array<u8, resolution.x> spriteColor{};
+        alignas(16) std::array<u8, resolution.x> spriteOpaque{};
+        alignas(16) std::array<u8, resolution.x> spriteFront{};
+        alignas(16) std::array<u8, resolution.x> sprite0{};
+    };
+
+    // writes the composed line to dst, returns true when sprite 0 overlaps an opaque background pixel
+    bool composeScanline(const LineBuffer& line, u8* dst);
+    bool sprite0Overlaps(const LineBuffer& line);
+
+    // fast non-cryptographic hash of a composed line, emphasis included
+    u64 hashLine(const u8* pixels, u8 emphasis);
+    // order dependent, for folding line hashes into stripe and frame hashes
+    u64 combineHash(u64 seed, u64 value);
+
     //https://www.nesdev.org/wiki/PPU_registers
     struct Registers {
         u16 V = 0;                 // current vram address
@@ -193,7 +293,7 @@ namespace ppu {
         void writeOAMADDR(u8 val);
         void writeOAMDATA(u8 val);
         void writePPUData(u8 val, PPU* ppu);
-        void writeOAMDMA(u8 val);
+        void writeOAMDMA(u8 val, Memory* memory);
 
         u8 readPPUSTATUS();
         u8 readOAMDATA();
@@ -215,28 +315,6 @@ namespace input {
     };
     constexpr u16 p1 = 0x4016;
     constexpr u16 p2 = 0x4017;
-
-    constexpr SDL_Scancode firstPlayerKeys[] = {
-        SDL_SCANCODE_D,
-        SDL_SCANCODE_A,
-        SDL_SCANCODE_S,
-        SDL_SCANCODE_W,
-        SDL_SCANCODE_LSHIFT,
-        SDL_SCANCODE_LCTRL,
-        SDL_SCANCODE_G,
-        SDL_SCANCODE_H
-    };
-
-    constexpr SDL_Scancode secondPlayerKeys[] = {
-        SDL_SCANCODE_RIGHT,
-        SDL_SCANCODE_LEFT,
-        SDL_SCANCODE_DOWN,
-        SDL_SCANCODE_UP,
-        SDL_SCANCODE_RSHIFT,
-        SDL_SCANCODE_KP_ENTER,
-        SDL_SCANCODE_K,
-        SDL_SCANCODE_L
-    };
 }
 
 namespace apu {
@@ -262,6 +340,32 @@ namespace apu {
         4, 8, 16, 32, 64, 96, 128, 160, 202, 254, 380, 508, 762, 1016, 2034, 4068
     };
 
+    // CPU cycles per DMC output bit, https://www.nesdev.org/wiki/APU_DMC
+    constexpr u16 dmcRateTable[] = {
+        428, 380, 340, 320, 286, 254, 226, 214, 190, 160, 142, 128, 106, 84, 72, 54
+    };
+
+    // https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table, scaled so both tables at full add up to under 32767
+    constexpr i32 mixerScale = 32767;
+
+    // indexed by pulse1 + pulse2
+    constexpr std::array<i16, 31> pulseMixTable = [] {
+        std::array<i16, 31> table{};
+        for (u8 n = 1; n < table.size(); ++n)
+            table[n] = i16(95.52 / (8128.0 / n + 100) * mixerScale + 0.5);
+        return table;
+    }();
+
+    // indexed by 3 * triangle + 2 * noise + dmc
+    constexpr std::array<i16, 203> tndMixTable = [] {
+        std::array<i16, 203> table{};
+        for (u8 n = 1; n < table.size(); ++n)
+            table[n] = i16(163.67 / (24329.0 / n + 100) * mixerScale + 0.5);
+        return table;
+    }();
+
+    constexpr u16 APUSTATUSAddress = 0x4015;
+
     constexpr u32 stepTable[] = {
         7457, 14913, 22371, 29829
     };
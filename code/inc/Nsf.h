@@ -0,0 +1,79 @@
+#ifndef NSF_H
+#define NSF_H
+
+#include <array>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "CPU.h"
+#include "NESHelpers.h"
+#include "Types.h"
+
+class APU;
+class AudioRecorder;
+
+// NES Sound Format, the music code and data of a game without the rest of it.
+// https://www.nesdev.org/wiki/NSF
+class Nsf {
+public:
+    bool load(const std::string& path);
+
+    u8 getTrackCount() const;
+    // 0 based
+    u8 getStartingTrack() const;
+    const std::string& getName() const;
+    const std::string& getArtist() const;
+
+private:
+    friend class NsfPlayer;
+
+    std::string name;
+    std::string artist;
+    u8 tracks = 0;
+    u8 startingTrack = 0;
+    u16 loadAddress = 0;
+    u16 initAddress = 0;
+    u16 playAddress = 0;
+    // microseconds between PLAY calls
+    u16 playPeriod = 0;
+    // 4KB banks for $8000-$FFFF, all zero when the tune isn't bank switched
+    std::array<u8, 8> initialBanks{};
+    bool bankSwitched = false;
+    std::vector<u8> data;
+};
+
+// A CPU and an APU with nothing else around them, driven like an NSF player's driver: INIT once, then PLAY
+// every time the play timer fires instead of on vblank. Runs as fast as it can, one player per track, so
+// tracks can render on different threads.
+class NsfPlayer {
+public:
+    explicit NsfPlayer(const Nsf& nsf);
+    ~NsfPlayer();
+
+    NsfPlayer(const NsfPlayer&) = delete;
+    NsfPlayer& operator=(const NsfPlayer&) = delete;
+
+    // plays track for seconds of emulated time, every sample goes to the recorder, false when the tune hangs
+    bool render(u8 track, double seconds, AudioRecorder* recorder);
+
+private:
+    // PLAY and INIT return here, nothing is ever executed at it
+    static constexpr u16 returnAddress = 0x5FF0;
+
+    const Nsf& nsf;
+    CPU cpu;
+    std::unique_ptr<APU> apu;
+    // time the driver spent waiting for the play timer, the CPU's own clock only counts instructions
+    nes_cycle_t idle = nes_cycle_t(0);
+
+    nes_cycle_t now() const;
+    void reset(u8 track);
+    void switchBank(u8 slot, u8 bank);
+    // the CPU sits idle until then
+    void wait(nes_cycle_t until);
+    // runs the routine until it returns or the deadline passes
+    bool call(u16 address, nes_cycle_t deadline);
+};
+
+#endif //NSF_H
@@ -0,0 +1,45 @@
+#ifndef NTSCFILTER_H
+#define NTSCFILTER_H
+
+#include <array>
+#include <vector>
+
+#include "Types.h"
+
+class WorkerPool;
+
+// Composite video simulation in the spirit of blargg's nes_ntsc, working on the PPU's 6-bit palette
+// indices and per line emphasis bits. https://www.nesdev.org/wiki/NTSC_video
+// Every pixel becomes 8 samples of a square wave at one of 3 subcarrier phases. Decoding is linear, so
+// the RGB each pixel adds to its neighbourhood of output pixels is precomputed for all 512 colours
+// (index + emphasis) and phases. Filtering a pixel is then 8 vector adds, gamma is applied at the end.
+class NtscFilter {
+public:
+    // output pixels per input pixel, horizontally and vertically
+    static constexpr u8 factor = 2;
+
+    explicit NtscFilter(WorkerPool* pool = null);
+
+    // dst holds (width * factor) x (height * factor) pixels as RGBA8888, pitch is in pixels.
+    // The phase pattern moves with the frame number like the real dot crawl.
+    void filter(const u8* indices, const u8* emphasis, u16 width, u16 height, u32 frame, u32* dst, u32 dstPitch);
+
+private:
+    static constexpr u8 phases = 3;
+    // output pixels touched by one input pixel, relative to its first output pixel
+    static constexpr i8 kernelStart = -3;
+    static constexpr u8 kernelWidth = 8;
+    static constexpr u16 gammaSize = 1024;
+
+    WorkerPool* pool = null;
+
+    // [colour][phase][output][r, g, b, unused]
+    std::vector<float> kernels;
+    std::array<u8, gammaSize> gamma{};
+
+    void buildKernels();
+    void filterRows(const u8* indices, const u8* emphasis, u16 width, u32 frame, u32* dst, u32 dstPitch,
+                    u16 y0, u16 y1) const;
+};
+
+#endif //NTSCFILTER_H
@@ -6,6 +6,7 @@
 #define PPU_H
 #include <array>
 
+#include "BackgroundCache.h"
 #include "Cartridge.h"
 #include "Memory.h"
 #include "Types.h"
@@ -14,7 +15,8 @@
 
 class PPU {
 public:
-    explicit PPU(Memory* shared);
+    // without attached hooks register accesses have to be forwarded through writeRegister/readRegister
+    explicit PPU(Memory* shared, bool attachHooks = true);
     ~PPU() = default;
 
     void init(Memory* shared);
@@ -24,72 +26,158 @@ public:
     void step_ppu(nes_ppu_cycle_t count);
 
     std::vector<u8> getFrameBuffer() const;
+    // PPUMASK emphasis bits (BGR, bits 2-0) each line of the front buffer was composed with
+    std::vector<u8> getEmphasisBuffer() const;
     std::vector<u32> getFrame() const;
+    // front buffer as palette indices, reuses the frame's storage so streaming it doesn't allocate
+    void getIndexedFrame(IndexedFrame& frame) const;
+    // front buffer hashes, updated as lines are composed so asking costs next to nothing
+    std::array<u64, stripeCount> getStripeHashes() const;
+    u64 getFrameHash() const;
+    // frames finished so far, the front buffer changes when this does (unless the frame was skipped)
+    u32 getFrameCount() const;
+    const std::array<Color, paletteSize>& getPalette() const;
 
     u8 readVram(u16 addr);
     void writeVram(u16 addr, u8 value);
     void writeVram(u16 addr, u8 *src, u16 src_size);
 
-    u8* getVRam();
+    // keeps the whole CHR ROM/RAM and maps its first 8KB, an empty one means 8KB of CHR RAM
+    void loadChr(const u8* data, u32 size);
+    // maps 1KB CHR bank to $0000 + page * $400 (page 0-7), for mappers
+    void setChrPage(u8 page, u16 bank);
 
-    static std::function<void(u16)> setOAMDMA;
+    // memory hook bodies, false/a value means the access was handled by the PPU
+    bool writeRegister(u16 addr, u8& val);
+    std::optional<u8> readRegister(u16 addr);
+    // one byte of an OAM DMA transfer, offset is relative to OAMADDR
+    void writeOAMDMA(u8 offset, u8 value);
+
+    // off when somebody else keeps track of vblank timing for the CPU
+    void setRaiseNMI(bool raise);
 
     void setMirroring(nes_mapper_flags);
+    void setSpriteEvaluation(ppu::SpriteEvaluation mode);
+
+    // PPUSTATUS sprite 0 hit and overflow (bits 6-5) and the open bus latch, reading them changes nothing
+    u8 getSpriteFlags() const;
+    u8 getOpenBus() const;
+    // master cycle before which the sprite flags stay as they are, unless a register, OAM, bank or
+    // mirroring change comes in first
+    i64 getSpriteFlagsSteadyUntil() const;
+
+    // where the last step ended, and the sprites found for the next line (complete from dot 257 on)
+    u16 getScanline() const;
+    u16 getDot() const;
+    const std::vector<ppu::Sprite>& getSecondaryOAM() const;
+
+    // renders one frame out of every skip + 1, skipped frames keep timing, status flags and sprite 0 hit
+    void setFrameSkip(u8 skip);
+    u8 getFrameSkip() const;
+
+    // background lines copied out of pre-rendered nametables. Lines after a raster effect fall back to tiles,
+    // and so do whole frames while re-rendering the cache keeps costing more than it saves
+    void setBackgroundCache(bool enabled);
 private:
     ppu::Registers regs{};
 
     Memory* sharedMemory = null;
 
-    std::vector<u8> vram;
+    // 1KB pages covering $0000-$3fff, $3f00-$3fff goes through the palette instead
+    std::array<u8*, vRamSize / vRamPageSize> pages{};
+    std::vector<u8> chr;
+    std::array<u8, ciramSize> ciram{};
+    std::array<u8, 0x20> paletteRam{};
     std::array<Color, paletteSize> palette;
 
     u16 scanline = 0;
 
     u8 tileIndex = 0;
     u8 tilePaletteBit32 = 0;
-    u8 bitPlane0;
+    u8 bitPlane0 = 0;
     u8 _pixel_cycle[8];
     u8 xOffset = 0;
     u8 lastSpriteID = 0;
     u8 hasSprite0 = 0;
     u8 lastSpriteY = 0;
     u32 frameCount = 0;
+    // frame on the front buffer
+    u32 frontFrame = 0;
+    u8 frameSkip = 0;
 
     nes_cycle_t _master_cycle;
     nes_ppu_cycle_t _scanline_cycle;
 
-    nes_mapper_flags mirroring;
+    nes_mapper_flags mirroring = nes_mapper_flags_horizontal_mirroring;
+    ppu::SpriteEvaluation spriteEvaluation = ppu::SpriteEvaluation::Dot;
 
     u8* entireFrameBuffer;
     std::vector<u8> frameBuffer1;
     std::vector<u8> frameBuffer2;
-    std::vector<u8> frameBufferBG;
+    u8* entireEmphasisBuffer;
+    std::vector<u8> emphasisBuffer1;
+    std::vector<u8> emphasisBuffer2;
+    u64* entireLineHashes;
+    std::vector<u64> lineHashes1;
+    std::vector<u64> lineHashes2;
+    ppu::LineBuffer line;
+
+    BackgroundCache backgroundCache;
+    bool backgroundCacheEnabled = false;
+    bool rasterEffectThisFrame = false;
+    // lines the cache drew this frame, frames in a row where re-rendering cost more than that saved,
+    // and how many frames the cache still sits out because of it
+    u16 cachedLines = 0;
+    u8 costlyFrames = 0;
+    u8 cacheOffFrames = 0;
+    bool cachedLine = false;
+    u16 cachedLineV = 0;
+    u8 lineFineX = 0;
 
     std::vector<ppu::Sprite> spriteBuffer;
 
     bool frameReady = false;
+    bool raiseNMI = true;
 
     void tilesPipeline();
     void spritesPipeline();
+    void evaluateSprites();
+
+    void composeLine();
+    void prepareCachedLine();
+    void copyCachedLine(u16 target, bool skipped, u16 pixels = resolution.x);
+    void splitCachedLine();
+    void endCachedFrame();
+    void detectRasterEffect(u16 addr, u8 val);
+    void markRasterEffect();
 
     void fetchTile();
+    // position in the line's tile fetches, and the line they are for (the next one during the prefetch)
+    int tileFetchCycle(u16& cur_scanline) const;
+    // nametable (0), attribute (2) or low pattern plane (4) fetch into the tile latches
+    void fetchTileByte(u8 access_cycle, u8 tile_row_index, bool skipped);
+    void incrementCoarseX();
+    bool tileSpan(int tile, int& start_bit, int& end_bit) const;
     void fetch_sprite(uint8_t sprite_id);
 
     u8 read_pattern_table_column(bool sprite, u8 tile_index, u8 bitplane, u8 tile_row_index);
     u8 read_pattern_table_column_8x16_sprite(uint8_t tile_index, uint8_t bitplane, uint8_t tile_row_index);
+    u8& vramByte(u16 addr);
     u8 get_palette_color(bool is_background, uint8_t palette_index_4_bit);
 
     ppu::Sprite *getSprite(u8 sprite_id) const;
 
     void swap_buffer();
 
-    bool is_ready() const { return _master_cycle > nes_ppu_cycle_t(29658); }
+    bool isSkippedFrame(u32 frame) const { return frameSkip != 0 && frame % (frameSkip + 1) != 0; }
 
-    void redirectAddress(u16& address);
+    bool is_ready() const { return _master_cycle > nes_ppu_cycle_t(29658); }
 
     //https://www.nesdev.org/wiki/PPU_registers
 };
 
 
 
+bool isIOReg(u16 addr);
+
 #endif //PPU_H
@@ -0,0 +1,51 @@
+#ifndef RESAMPLER_H
+#define RESAMPLER_H
+
+#include <cstddef>
+#include <vector>
+
+#include "Types.h"
+
+// zero crossings of the sinc on each side, more is a steeper cutoff for proportionally more work
+enum class ResampleQuality : u8 {
+    Fast = 4,
+    Medium = 8,
+    High = 16,
+};
+
+// Polyphase windowed-sinc resampler for a mono float stream. The kernel is tabulated for phases
+// sub-sample offsets, each output sample is one dot product of the kernel for its offset with the input
+// around it. When going down in rate the cutoff follows the output's Nyquist, so the kernel gets longer
+// with the ratio. https://ccrma.stanford.edu/~jos/resample/
+class Resampler {
+public:
+    Resampler(double inRate, double outRate, ResampleQuality quality);
+
+    // fine tuning for rate control, the kernel stays the one built for the nominal rates
+    void setRatio(double ratio);
+
+    // takes all of src, writes at most maxOutput(count) samples, returns how many
+    size_t process(const float* src, size_t count, float* dst);
+    size_t maxOutput(size_t count) const;
+
+    u16 getTaps() const;
+    void clear();
+
+private:
+    static constexpr u16 phases = 256;
+
+    u16 taps = 0;
+    double nominalStep = 1;
+    // input samples per output sample
+    double step = 1;
+    // of the next output sample, in input samples from history[0]
+    double position = 0;
+
+    // [phase][taps], taps rounded up to a multiple of 4
+    std::vector<float> kernels;
+    std::vector<float> history;
+
+    void buildKernels(double cutoff, u8 zeroCrossings);
+};
+
+#endif //RESAMPLER_H
@@ -0,0 +1,83 @@
+#ifndef RINGBUFFER_H
+#define RINGBUFFER_H
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free queue for exactly one producer and one consumer thread. Capacity has to be a power of two,
+// one slot is kept free to tell full from empty.
+template <typename T, size_t Capacity>
+class RingBuffer {
+    static_assert(Capacity >= 2 && (Capacity & (Capacity - 1)) == 0, "capacity has to be a power of two");
+
+public:
+    bool push(const T& item) {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        const size_t next = (head + 1) & (Capacity - 1);
+
+        if (next == tail.load(std::memory_order_acquire))
+            return false;
+
+        items[head] = item;
+        this->head.store(next, std::memory_order_release);
+        return true;
+    }
+
+    bool pop(T& item) {
+        const size_t tail = this->tail.load(std::memory_order_relaxed);
+
+        if (tail == head.load(std::memory_order_acquire))
+            return false;
+
+        item = items[tail];
+        this->tail.store((tail + 1) & (Capacity - 1), std::memory_order_release);
+        return true;
+    }
+
+    // copies as many of count items as fit, returns how many did
+    size_t push(const T* src, size_t count) {
+        const size_t head = this->head.load(std::memory_order_relaxed);
+        const size_t free = (tail.load(std::memory_order_acquire) - head - 1) & (Capacity - 1);
+        count = std::min(count, free);
+
+        const size_t first = std::min(count, Capacity - head);
+        std::copy_n(src, first, items.begin() + head);
+        std::copy_n(src + first, count - first, items.begin());
+
+        this->head.store((head + count) & (Capacity - 1), std::memory_order_release);
+        return count;
+    }
+
+    // copies up to count items out, returns how many there were
+    size_t pop(T* dst, size_t count) {
+        const size_t tail = this->tail.load(std::memory_order_relaxed);
+        const size_t used = (head.load(std::memory_order_acquire) - tail) & (Capacity - 1);
+        count = std::min(count, used);
+
+        const size_t first = std::min(count, Capacity - tail);
+        std::copy_n(items.begin() + tail, first, dst);
+        std::copy_n(items.begin(), count - first, dst + first);
+
+        this->tail.store((tail + count) & (Capacity - 1), std::memory_order_release);
+        return count;
+    }
+
+    // both are snapshots, exact only on the side that owns the other end
+    size_t size() const {
+        return (head.load(std::memory_order_acquire) - tail.load(std::memory_order_acquire)) & (Capacity - 1);
+    }
+
+    bool empty() const { return size() == 0; }
+
+    static constexpr size_t capacity() { return Capacity - 1; }
+
+private:
+    std::array<T, Capacity> items{};
+
+    alignas(64) std::atomic<size_t> head{0};
+    alignas(64) std::atomic<size_t> tail{0};
+};
+
+#endif //RINGBUFFER_H
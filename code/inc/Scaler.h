@@ -0,0 +1,42 @@
+#ifndef SCALER_H
+#define SCALER_H
+
+#include <functional>
+#include <vector>
+
+#include "Types.h"
+
+class WorkerPool;
+
+enum class ScaleFilter : u8 {
+    Nearest,    // integer factor 1-8
+    Scale2x,    // https://www.scale2x.it/algorithm
+    Scale3x,
+    Scale4x,    // Scale2x applied twice
+    XBR         // 2x, edge weights from 2xBR on a 3x3 neighbourhood, corners blended 50%
+};
+
+// CPU pixel art scalers for 32-bit pixels, rows are split into slices over the worker pool.
+class Scaler {
+public:
+    explicit Scaler(WorkerPool* pool = null);
+
+    // factor is only used by Nearest, the other filters have a fixed one
+    void setFilter(ScaleFilter filter, u8 factor = 1);
+    ScaleFilter getFilter() const;
+    u8 getFactor() const;
+
+    // dst holds (width * factor) x (height * factor) pixels, pitch is in pixels
+    void scale(const u32* src, u16 width, u16 height, u32* dst, u32 dstPitch);
+
+private:
+    WorkerPool* pool = null;
+    ScaleFilter filter = ScaleFilter::Nearest;
+    u8 factor = 1;
+
+    std::vector<u32> intermediate;
+
+    void forSlices(u16 height, const std::function<void(u16, u16)>& rows) const;
+};
+
+#endif //SCALER_H
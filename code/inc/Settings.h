@@ -5,8 +5,6 @@
 #ifndef SETTINGS_H
 #define SETTINGS_H
 
-#include <SDL_rect.h>
-
 #include "Types.h"
 
 constexpr u32 ramSize = 0x10000; //65536 or 64KB
@@ -14,10 +12,19 @@ constexpr u8 eof_value = 0x1A;
 constexpr const char* NES = "NES\x1A";
 constexpr i8 illegalCycles = -1;
 constexpr u16 vRamSize = 0x4000;
+constexpr u16 vRamPageSize = 0x400;
+constexpr u16 chrSize = 0x2000;
+constexpr u16 ciramSize = 0x1000; // 2KB on the console + 2KB cartridge VRAM for four-screen
 constexpr u16 oamSize = 0x100;
 constexpr u8 paletteSize = 64;
 constexpr vec2d resolution{256, 240};
+constexpr u8 stripeHeight = 8; // lines per change detection region
+constexpr u8 stripeCount = 240 / stripeHeight;
 constexpr u32 audioFrequency = 48000;
-constexpr u32 audioBufferSize = 8000;
+constexpr u32 audioBufferSize = 8192; // samples between the APU and the audio device, a power of two
+constexpr u16 audioDeviceSamples = 512; // per device callback
+constexpr u16 audioLowLatencySamples = 256; // per device callback with --low-latency
+constexpr u32 audioTargetFill = audioFrequency / 50; // 20 ms, what rate control steers the buffer towards by default
+constexpr float audioMaxRateDelta = 0.005f; // how far rate control may move the output rate
 
 #endif //SETTINGS_H
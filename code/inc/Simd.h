@@ -0,0 +1,11 @@
+#ifndef SIMD_H
+#define SIMD_H
+
+// SSE2 is baseline on every x64 target we build for (MSVC and GCC/Clang),
+// everything that uses it keeps a scalar fallback for other architectures.
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define NES_SSE2 1
+#include <emmintrin.h>
+#endif
+
+#endif //SIMD_H
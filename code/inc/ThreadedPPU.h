@@ -0,0 +1,103 @@
+#ifndef THREADEDPPU_H
+#define THREADEDPPU_H
+
+#include <atomic>
+#include <thread>
+
+#include "PPU.h"
+#include "RingBuffer.h"
+
+// PPU rendering on its own thread. The CPU thread only queues timestamped register writes, OAM DMA bytes
+// and CHR/mirroring changes, the PPU thread applies each one after stepping to its timestamp, which is the
+// same point the single threaded loop (cpu.step, then ppu.step) would apply it at.
+// Vblank NMI, the $2002 vblank bit and the open bus latch come from a copy of the frame timing and
+// register state kept on the CPU side, so the PPU thread never touches the CPU. $2002's sprite 0 hit and
+// overflow bits come from the PPU thread along with how long they stay as they are, the CPU thread only
+// waits for it when they may have changed since. $2004/$2007 reads and taking a frame always wait.
+class ThreadedPPU {
+public:
+    explicit ThreadedPPU(Memory* shared);
+    ~ThreadedPPU();
+
+    void step(nes_cycle_t count);
+
+    // waits until the PPU thread caught up with the last step, the PPU can then be used directly
+    // from the calling thread until the next step
+    void sync();
+    PPU* getPPU();
+
+    std::vector<u8> getFrameBuffer();
+    std::vector<u32> getFrame();
+    void getIndexedFrame(IndexedFrame& frame);
+    u64 getFrameHash();
+    // frames finished by the last step, from the CPU side timing, so asking doesn't wait
+    u32 getFrameCount() const;
+
+    void setChrPage(u8 page, u16 bank);
+    void setMirroring(nes_mapper_flags flags);
+
+private:
+    enum class EventType : u8 {
+        Write,
+        OAMDMA,
+        ChrPage,
+        Mirroring,
+        // a $2002 read served on the CPU side, the PPU thread only applies its side effects
+        StatusRead
+    };
+
+    struct Event {
+        i64 time = 0;
+        EventType type = EventType::Write;
+        u16 addr = 0;
+        u8 value = 0;
+    };
+
+    // how far ahead the PPU thread may run without being told, events carry their own timestamps
+    static constexpr i64 publishInterval = 341;
+
+    PPU ppu;
+    Memory* sharedMemory = null;
+
+    RingBuffer<Event, 4096> events;
+    std::thread thread;
+    std::atomic<bool> running{true};
+
+    // CPU thread -> PPU thread
+    std::atomic<i64> target{0};
+    i64 published = 0;
+    nes_cycle_t now{0};
+    u64 pushed = 0;
+
+    // PPU thread -> CPU thread
+    std::atomic<i64> reached{0};
+    std::atomic<u64> processed{0};
+    // sprite flags (bits 1-0 = PPUSTATUS bits 6-5), cycles they stay that way for (bits 19-2) and the
+    // master cycle they were taken at (bits 63-20), in one word so they are read together
+    std::atomic<u64> spriteStatus{0};
+    // events after the last status read that may change the sprite flags' outlook
+    i64 lastEvent = -1;
+
+    // frame timing mirrored from PPU::step for NMI
+    nes_cycle_t shadowCycle{0};
+    u16 shadowScanline = 0;
+    u16 shadowDot = 0;
+    u32 shadowFrame = 0;
+    u8 shadowControl = 0;
+    bool shadowVblank = false;
+    u8 shadowLatch = 0;
+
+    void push(EventType type, u16 addr, u8 value);
+    void publish(i64 time);
+    void run();
+    void apply(const Event& event);
+    void reportSpriteStatus(i64 time);
+
+    u8 readStatus();
+    u8 spriteFlags();
+
+    void stepShadow();
+    void advanceShadow();
+};
+
+#endif //THREADEDPPU_H
@@ -0,0 +1,50 @@
+#ifndef TRIPLEBUFFER_H
+#define TRIPLEBUFFER_H
+
+#include <array>
+#include <atomic>
+
+#include "Types.h"
+
+// Hands whole frames from one writer thread to one reader thread, neither side ever waits.
+// The writer fills back() and publishes it, the reader picks up the newest published buffer with update().
+template <typename T>
+class TripleBuffer {
+public:
+    explicit TripleBuffer(const T& initial = T()) {
+        buffers.fill(initial);
+    }
+
+    T& back() { return buffers[backIndex]; }
+
+    // false when the previously published buffer was replaced before the reader got to it
+    bool publish() {
+        const u8 old = middle.exchange(backIndex | freshBit, std::memory_order_acq_rel);
+        backIndex = old & indexMask;
+        return !(old & freshBit);
+    }
+
+    // false when nothing was published since the last update, front() stays as it was
+    bool update() {
+        if (!(middle.load(std::memory_order_acquire) & freshBit))
+            return false;
+
+        const u8 old = middle.exchange(frontIndex, std::memory_order_acq_rel);
+        frontIndex = old & indexMask;
+        return true;
+    }
+
+    const T& front() const { return buffers[frontIndex]; }
+
+private:
+    static constexpr u8 indexMask = 0x3;
+    static constexpr u8 freshBit = 0x4;
+
+    std::array<T, 3> buffers;
+
+    u8 backIndex = 0;
+    alignas(64) std::atomic<u8> middle{1};
+    alignas(64) u8 frontIndex = 2;
+};
+
+#endif //TRIPLEBUFFER_H
@@ -6,7 +6,6 @@
 #define TYPES_H
 
 #include <cstdint>
-#include "SDL_rect.h"
 
 #define u8 uint8_t
 #define u16 uint16_t
@@ -20,6 +19,9 @@
 
 #define null nullptr
 
-#define vec2d SDL_Point
+struct vec2d {
+    int x;
+    int y;
+};
 
 #endif //TYPES_H
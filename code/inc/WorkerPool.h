@@ -0,0 +1,49 @@
+#ifndef WORKERPOOL_H
+#define WORKERPOOL_H
+
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "Types.h"
+
+// Fixed set of threads for splitting one job into independent pieces. run() hands out piece indices
+// to the workers and the calling thread alike and returns when every piece is done.
+class WorkerPool {
+public:
+    // 0 picks one worker less than there are cores, the caller is the last one
+    explicit WorkerPool(u32 threads = 0);
+    ~WorkerPool();
+
+    WorkerPool(const WorkerPool&) = delete;
+    WorkerPool& operator=(const WorkerPool&) = delete;
+
+    // threads taking part in run(), including the caller
+    u32 size() const;
+
+    void run(u32 count, const std::function<void(u32)>& task);
+    // rows [first, last) in a few more slices than threads, so one slow slice doesn't hold up the rest
+    void runSlices(u32 rows, const std::function<void(u32, u32)>& task);
+
+private:
+    std::vector<std::thread> workers;
+
+    std::mutex mutex;
+    std::condition_variable wake;
+    std::condition_variable finished;
+
+    const std::function<void(u32)>* task = null;
+    u32 count = 0;
+    std::atomic<u32> next{0};
+    u32 active = 0;
+    u64 generation = 0;
+    bool stopping = false;
+
+    void work();
+    void drain();
+};
+
+#endif //WORKERPOOL_H
@@ -0,0 +1,41 @@
+#ifndef AUDIOOUTPUT_H
+#define AUDIOOUTPUT_H
+
+#include <SDL_audio.h>
+
+#include "AudioPlayback.h"
+#include "Types.h"
+
+class APU;
+
+// The SDL audio device the APU's samples play on. The device chunk sets the floor of the latency, the
+// APU buffer is sized after it (two chunks), so a small chunk makes the whole path small.
+// What is played is up to AudioPlayback.
+class AudioOutput {
+public:
+    // deviceSamples per callback, a power of two, the device may pick another one
+    AudioOutput(APU* apu, u16 deviceSamples);
+    ~AudioOutput();
+
+    bool isOpen() const;
+    // what the device actually uses
+    u16 getDeviceSamples() const;
+
+    // audio thread view: samples waiting in the APU buffer plus the chunk being played, averaged
+    float getLatencyMs() const;
+    float getMaxLatencyMs() const;
+    // times playback waited for the buffer to fill, the first start included
+    u64 getPrefills() const;
+
+private:
+    APU* apu = null;
+    SDL_AudioDeviceID device = 0;
+    SDL_AudioSpec obtained{};
+
+    // the rate is not allowed to change, the device plays at the APU's
+    AudioPlayback playback;
+
+    static void callback(void* userdata, u8* stream, int len);
+};
+
+#endif //AUDIOOUTPUT_H
@@ -0,0 +1,37 @@
+#ifndef KEYBOARD_H
+#define KEYBOARD_H
+
+#include <SDL_scancode.h>
+
+#include "Types.h"
+
+namespace input {
+
+    // in the controller's bit order, right first
+    constexpr SDL_Scancode firstPlayerKeys[] = {
+        SDL_SCANCODE_D,
+        SDL_SCANCODE_A,
+        SDL_SCANCODE_S,
+        SDL_SCANCODE_W,
+        SDL_SCANCODE_LSHIFT,
+        SDL_SCANCODE_LCTRL,
+        SDL_SCANCODE_G,
+        SDL_SCANCODE_H
+    };
+
+    constexpr SDL_Scancode secondPlayerKeys[] = {
+        SDL_SCANCODE_RIGHT,
+        SDL_SCANCODE_LEFT,
+        SDL_SCANCODE_DOWN,
+        SDL_SCANCODE_UP,
+        SDL_SCANCODE_RSHIFT,
+        SDL_SCANCODE_KP_ENTER,
+        SDL_SCANCODE_K,
+        SDL_SCANCODE_L
+    };
+
+    // the 8 keys held right now as a controller byte, only on the thread that polls SDL events
+    u8 readKeyboard(const SDL_Scancode* keys);
+}
+
+#endif //KEYBOARD_H
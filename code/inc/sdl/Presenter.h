@@ -0,0 +1,75 @@
+#ifndef PRESENTER_H
+#define PRESENTER_H
+
+#include <atomic>
+#include <vector>
+
+#include <SDL_render.h>
+
+#include "NESHelpers.h"
+#include "NtscFilter.h"
+#include "Scaler.h"
+#include "Settings.h"
+#include "TripleBuffer.h"
+#include "WorkerPool.h"
+
+// Second half of the video path. The emulation thread submits finished frames as palette indices,
+// the thread owning the window converts, scales and presents the newest one. Indices go through an
+// INDEX8 surface, SDL's blitter expands them to RGBA. Unscaled, only the stripes that changed are uploaded.
+class Presenter {
+public:
+    explicit Presenter(SDL_Window* window);
+    ~Presenter();
+
+    // window thread, the texture is sized to the frame times the filter's factor and SDL stretches the rest
+    void setFilter(ScaleFilter filter, u8 factor = 1);
+
+    // window thread, composite video look instead of the RGB palette, replaces the scale filter while on
+    void setNtsc(bool enabled);
+    bool isNtsc() const;
+
+    // emulation thread, copies the frame and returns without waiting
+    void submit(const IndexedFrame& frame);
+
+    // window thread, returns false when there was nothing to show (no new frame and no vsync to wait on,
+    // or a new frame identical to the one on screen)
+    bool present();
+
+    u64 getFramesSubmitted() const;
+    u64 getFramesPresented() const;
+    // submitted frames replaced by a newer one before they were presented
+    u64 getFramesDropped() const;
+    // presents that showed the previous frame again
+    u64 getFramesRepeated() const;
+    // new frames identical to the one on screen, neither uploaded nor presented
+    u64 getFramesUnchanged() const;
+
+private:
+    SDL_Renderer* renderer = null;
+    SDL_Texture* texture = null;
+    bool vsync = false;
+
+    WorkerPool pool;
+    Scaler scaler;
+    NtscFilter ntsc;
+    bool ntscEnabled = false;
+
+    TripleBuffer<IndexedFrame> frames;
+    SDL_Surface* indexed = null;
+    // RGBA for the scalers, rgba wraps pixels
+    std::vector<u32> pixels;
+    SDL_Surface* rgba = null;
+    ShownFrame shown;
+
+    std::atomic<u64> submitted{0};
+    std::atomic<u64> dropped{0};
+    std::atomic<u64> presented{0};
+    std::atomic<u64> repeated{0};
+    std::atomic<u64> unchanged{0};
+
+    void createTexture();
+    void loadIndexed(const IndexedFrame& frame);
+    void upload();
+};
+
+#endif //PRESENTER_H
@@ -1,50 +1,81 @@
+#include <algorithm>
+#include <atomic>
+#include <cstdlib>
+#include <cstring>
 #include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <thread>
 #include <SDL.h>
-#include "Cartridge.h"
-#include "Controller.h"
-#include "CPU.h"
+#include "Console.h"
 #include "Logger.h"
-#include "Opcodes.h"
-#include "PPU.h"
 #include "NESHelpers.h"
 #include "APU.h"
+#include "AudioRecorder.h"
+#include "sdl/AudioOutput.h"
+#include "sdl/Keyboard.h"
+#include "sdl/Presenter.h"
 
 using namespace std;
 
-void audioCallback(void* userdata, u8* stream, int len) {
-    APU* apu = static_cast<APU*>(userdata);
-    if(apu == null)
-        return;
-
-    vector<u8>* sampleBuffer = apu->getSampleBuffer();
-    if(!sampleBuffer) return;
-
-    if (sampleBuffer->size() > len) {
-        memcpy(stream, sampleBuffer->data(), len);
-        sampleBuffer->erase(sampleBuffer->begin(), sampleBuffer->begin() + len);
-    }
-}
-
 int main(int argc, char* argv[])
 {
-    CPU cpu;
-    cpu.init();
-
     assert(argc > 1);
 
-    Cartridge cartridge(argv[1]);
+    // --low-latency picks a small device chunk, --audio-buffer <samples> any other,
+    // --resampler fast|medium|high swaps band-limited steps for the sinc resampler,
+    // --no-audio opens no device and keeps only the APU state the game can see,
+    // --record <file.wav|file.raw> writes the sound to a file, with or without a device
+    u16 audioSamples = audioDeviceSamples;
+    std::optional<ResampleQuality> resampling;
+    bool audioEnabled = true;
+    std::string recordPath;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--no-audio") == 0)
+            audioEnabled = false;
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc)
+            recordPath = argv[++i];
+        else if (strcmp(argv[i], "--low-latency") == 0)
+            audioSamples = audioLowLatencySamples;
+        else if (strcmp(argv[i], "--audio-buffer") == 0 && i + 1 < argc)
+            audioSamples = u16(std::clamp(atoi(argv[++i]), 64, 2048));
+        else if (strcmp(argv[i], "--resampler") == 0 && i + 1 < argc)
+        {
+            ++i;
+            if (strcmp(argv[i], "fast") == 0)
+                resampling = ResampleQuality::Fast;
+            else if (strcmp(argv[i], "high") == 0)
+                resampling = ResampleQuality::High;
+            else
+                resampling = ResampleQuality::Medium;
+        }
+    }
 
-    assert(cartridge.load());
-    cartridge.loadToMemory(cpu.getMemory());
-    cpu.reset();
+    Console console;
+    if (!console.load(argv[1]))
+    {
+        return 1;
+    }
 
-    PPU ppu(cpu.getMemory());
-    APU apu(cpu.getMemory());
+    APU& apu = console.audio();
+    apu.setResampler(resampling);
+    apu.setTimingOnly(!audioEnabled && recordPath.empty());
+    apu.setRateControl(audioEnabled);
 
-    cartridge.loadToVRam(&ppu);
+    std::unique_ptr<AudioRecorder> recorder;
+    if (!recordPath.empty())
+    {
+        recorder = std::make_unique<AudioRecorder>(recordPath, AudioRecorder::formatFor(recordPath), audioFrequency);
+        if (recorder->isOpen())
+            apu.setRecorder(recorder.get());
+    }
 
-    Controller p1(cpu.getMemory(), input::p1, input::firstPlayerKeys);
-    Controller p2(cpu.getMemory(), input::p2, input::secondPlayerKeys);
+    // SDL updates the keyboard state while this thread polls events, the emulation thread only sees snapshots
+    std::atomic<u8> pads[2] = {0, 0};
+    console.setInputSource(0, [&pads] { return pads[0].load(std::memory_order_relaxed); });
+    console.setInputSource(1, [&pads] { return pads[1].load(std::memory_order_relaxed); });
 
     if (SDL_Init(SDL_INIT_VIDEO | SDL_INIT_AUDIO) != 0)
     {
@@ -60,37 +91,53 @@ int main(int argc, char* argv[])
         0
     );
 
-    SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
-    SDL_SetRenderDrawColor(renderer, 30, 30, 30, SDL_ALPHA_OPAQUE);
-    SDL_RenderClear(renderer);
-    SDL_RenderPresent(renderer);
+    // destroyed before the window, it owns the renderer
+    auto presenter = std::make_unique<Presenter>(window);
+    presenter->setFilter(ScaleFilter::Scale2x);
 
-    SDL_Texture* texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
-                                              resolution.x, resolution.y);
-    if (!texture) {
-        SDL_Log("Unable to create texture! SDL_Error: %s", SDL_GetError());
-        return -1;
-    }
+    std::unique_ptr<AudioOutput> audio;
+    if (audioEnabled)
+        audio = std::make_unique<AudioOutput>(&apu, audioSamples);
+
+    std::atomic<bool> isOn = true;
+    // the registers belong to the emulation thread, it logs them between runs
+    std::atomic<bool> dumpRegisters = false;
 
-    SDL_AudioSpec desiredSpec, obtainedSpec;
-    desiredSpec.freq = NES_CLOCK_HZ / 120;
-    desiredSpec.format = AUDIO_U8;
-    desiredSpec.channels = 1;
-    desiredSpec.samples = 4096;
-    desiredSpec.callback = audioCallback;
-    desiredSpec.userdata = &apu;
+    // emulation runs on its own thread and only hands finished frames over, this one polls events and presents
+    std::thread emulation([&] {
+        u64 prev_counter = SDL_GetPerformanceCounter();
+        u64 count_per_second = SDL_GetPerformanceFrequency();
 
-    SDL_AudioDeviceID device;
-    device = SDL_OpenAudioDevice(SDL_GetAudioDeviceName(0, 0), 0, &desiredSpec, &obtainedSpec, 0);
-    cout << "play audio on device n°" << device << endl;
+        u32 lastFrame = console.getFrameCount();
+
+        while (isOn)
+        {
+            u64 cur_counter = SDL_GetPerformanceCounter();
 
-    SDL_PauseAudioDevice(device, 0);
+            u64 delta_ticks = cur_counter - prev_counter;
+            prev_counter = cur_counter;
+            if (delta_ticks == 0)
+                delta_ticks = 1;
 
-    bool isOn = true;
-    u64 prev_counter = SDL_GetPerformanceCounter();
-    u64 count_per_second = SDL_GetPerformanceFrequency();
+            auto cpu_cycles = ms_to_nes_cycle((double)delta_ticks * 1000 / count_per_second);
 
-    nes_cycle_t _master_cycle = nes_cycle_t(0);
+            if (cpu_cycles > nes_cycle_t(NES_CLOCK_HZ))
+                cpu_cycles = nes_cycle_t(NES_CLOCK_HZ);
+
+            console.run(cpu_cycles);
+
+            if (dumpRegisters.exchange(false))
+                INFOLOG(console.getRegisters()->toString());
+
+            if (console.getFrameCount() != lastFrame)
+            {
+                lastFrame = console.getFrameCount();
+                presenter->submit(console.frame());
+            }
+
+            SDL_Delay(1);
+        }
+    });
 
     while (isOn)
     {
@@ -114,37 +161,51 @@ int main(int argc, char* argv[])
             }
 
             if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_s) {
-                INFOLOG(cpu.getRegisters()->toString());
+                dumpRegisters = true;
             }
-        }
 
-        u64 cur_counter = SDL_GetPerformanceCounter();
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_F2 && audio) {
+                INFOLOG("audio buffer " + to_string(apu.getBufferFill()) + " samples, rate ratio " + to_string(apu.getRateRatio())
+                    + ", latency " + to_string(audio->getLatencyMs()) + " ms");
+            }
 
-        u64 delta_ticks = cur_counter - prev_counter;
-        prev_counter = cur_counter;
-        if (delta_ticks == 0)
-            delta_ticks = 1;
+            if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_n) {
+                presenter->setNtsc(!presenter->isNtsc());
+            }
+        }
 
-        auto cpu_cycles = ms_to_nes_cycle((double)delta_ticks * 1000 / count_per_second);
+        pads[0].store(input::readKeyboard(input::firstPlayerKeys), std::memory_order_relaxed);
+        pads[1].store(input::readKeyboard(input::secondPlayerKeys), std::memory_order_relaxed);
 
-        if (cpu_cycles > nes_cycle_t(NES_CLOCK_HZ))
-            cpu_cycles = nes_cycle_t(NES_CLOCK_HZ);
+        if (!presenter->present())
+            SDL_Delay(1);
+    }
 
-        for (nes_cycle_t i = nes_cycle_t(0); i < cpu_cycles; ++i) {
-            _master_cycle += nes_cycle_t(1);
-            cpu.step(_master_cycle);
-            ppu.step(_master_cycle);
-            apu.step(_master_cycle);
-        }
+    emulation.join();
 
-        SDL_UpdateTexture(texture, null, ppu.getFrame().data(), resolution.x * sizeof(u32));
-        SDL_RenderClear(renderer);
-        SDL_RenderCopy(renderer, texture, null, null);
-        SDL_RenderPresent(renderer);
+    if (recorder)
+    {
+        apu.setRecorder(null);
+        recorder->close();
+        INFOLOG("recorded " + to_string(recorder->getSamplesWritten()) + " samples, dropped " + to_string(recorder->getDropped()));
+        recorder.reset();
+    }
+
+    INFOLOG("frames submitted " + to_string(presenter->getFramesSubmitted())
+        + ", presented " + to_string(presenter->getFramesPresented())
+        + ", dropped " + to_string(presenter->getFramesDropped())
+        + ", repeated " + to_string(presenter->getFramesRepeated())
+        + ", unchanged " + to_string(presenter->getFramesUnchanged()));
+    if (audio)
+    {
+        INFOLOG("audio underruns " + to_string(apu.getUnderruns()) + ", overruns " + to_string(apu.getOverruns())
+            + ", buffer " + to_string(apu.getBufferFill()) + " samples, rate ratio " + to_string(apu.getRateRatio()));
+        INFOLOG("audio latency " + to_string(audio->getLatencyMs()) + " ms, max " + to_string(audio->getMaxLatencyMs())
+            + " ms, prefills " + to_string(audio->getPrefills()));
     }
 
-    SDL_CloseAudio();
-    SDL_DestroyRenderer(renderer);
+    audio.reset();
+    presenter.reset();
     SDL_DestroyWindow(window);
     SDL_Quit();
 
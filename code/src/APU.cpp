@@ -4,10 +4,10 @@
 
 #include "APU.h"
 #include "Settings.h"
-#include <cmath>
-#include <SDL_audio.h>
+#include <algorithm>
+#include <numbers>
 
-#include "CPU.h"
+#include "AudioRecorder.h"
 
 using namespace apu;
 
@@ -64,16 +64,31 @@ void Pulse::writeTimerHigh(uint8_t value) {
     dutyValue = 0;
 }
 
-void Pulse::stepTimer() {
-    if (timerValue == 0)
+void Pulse::advance(u32 cycles) {
+    if (cycles <= timerValue)
     {
-        timerValue = timerPeriod;
-        dutyValue = (dutyValue + 1) % 8;
-    }
-    else
-    {
-        timerValue--;
+        timerValue -= cycles;
+        return;
     }
+
+    // the timer reloads to the period once it was 0, the duty steps on every reload
+    cycles -= timerValue + 1;
+    const u32 length = timerPeriod + 1;
+    dutyValue = (dutyValue + 1 + cycles / length) % 8;
+    timerValue = timerPeriod - cycles % length;
+}
+
+u32 Pulse::cyclesToTransition() const {
+    const u8 volume = envelopeEnabled ? envelopeVolume : constantVolume;
+    if (!enabled || lengthValue == 0 || timerPeriod < 8 || timerPeriod > 0x7ff || volume == 0)
+        return 0;
+
+    const u8 current = dutyTable[dutyMode][dutyValue];
+    for (u8 k = 1; k <= 8; ++k)
+        if (dutyTable[dutyMode][(dutyValue + k) % 8] != current)
+            return timerValue + 1 + (k - 1) * (timerPeriod + 1);
+
+    return 0;
 }
 
 void Pulse::stepSweep() {
@@ -182,6 +197,7 @@ Triangle::Triangle() {
     lengthEnabled = false;
     lengthValue = 0;
     timerPeriod = 0;
+    timerValue = 0;
     dutyValue = 0;
     counterPeriod = 0;
     counterValue = 0;
@@ -204,19 +220,26 @@ void Triangle::writeTimerHigh(uint8_t value) {
     counterReload = true;
 }
 
-void Triangle::stepTimer() {
-    if (timerValue == 0)
+void Triangle::advance(u32 cycles) {
+    if (cycles <= timerValue)
     {
-        timerValue = timerPeriod;
-        if (lengthValue > 0 && counterValue > 0)
-        {
-            dutyValue = (dutyValue + 1) % 32;
-        }
-    }
-    else
-    {
-        timerValue--;
+        timerValue -= cycles;
+        return;
     }
+
+    cycles -= timerValue + 1;
+    const u32 length = timerPeriod + 1;
+    // length and linear counter only change on frame counter steps and writes, both are events
+    if (lengthValue > 0 && counterValue > 0)
+        dutyValue = (dutyValue + 1 + cycles / length) % 32;
+    timerValue = timerPeriod - cycles % length;
+}
+
+u32 Triangle::cyclesToTransition() const {
+    if (!enabled || lengthValue == 0 || counterValue == 0)
+        return 0;
+
+    return timerValue + 1;
 }
 
 void Triangle::stepLength() {
@@ -260,8 +283,293 @@ u8 Triangle::out() const {
     return triangleTable[dutyValue];
 }
 
-APU::APU(Memory *sharedMemory) {
+Noise::Noise() = default;
+
+void Noise::writeControl(u8 value) {
+    lengthEnabled = ((value >> 5) & 1) == 0;
+    envelopeLoop = ((value >> 5) & 1) == 1;
+    envelopeEnabled = ((value >> 4) & 1) == 0;
+    envelopePeriod = value & 15;
+    constantVolume = value & 15;
+    envelopeStart = true;
+}
+
+void Noise::writePeriod(u8 value) {
+    shortMode = (value & 0x80) == 0x80;
+    timerPeriod = noiseTable[value & 0x0f] / 2 - 1;
+}
+
+void Noise::writeLength(u8 value) {
+    lengthValue = lengthTable[value >> 3];
+    envelopeStart = true;
+}
+
+u16 Noise::stepShiftRegister(u16 value, bool shortMode) {
+    // https://www.nesdev.org/wiki/APU_Noise
+    const u16 feedback = (value ^ (value >> (shortMode ? 6 : 1))) & 1;
+    return (value >> 1) | (feedback << 14);
+}
+
+void Noise::advance(u32 cycles) {
+    if (cycles <= timerValue)
+    {
+        timerValue -= cycles;
+        return;
+    }
+
+    cycles -= timerValue + 1;
+    const u32 length = timerPeriod + 1;
+    const u32 clocks = 1 + cycles / length;
+    timerValue = timerPeriod - cycles % length;
+
+    for (u32 i = 0; i < clocks; ++i)
+        shiftRegister = stepShiftRegister(shiftRegister, shortMode);
+}
+
+u32 Noise::cyclesToTransition() const {
+    const u8 volume = envelopeEnabled ? envelopeVolume : constantVolume;
+    if (!enabled || lengthValue == 0 || volume == 0)
+        return 0;
+
+    // looks a few clocks ahead for the output bit to flip, long runs just get an extra event
+    u16 value = shiftRegister;
+    u8 k = 1;
+    for (; k < 32; ++k)
+    {
+        value = stepShiftRegister(value, shortMode);
+        if ((value & 1) != (shiftRegister & 1))
+            break;
+    }
+
+    return timerValue + 1 + (k - 1) * (timerPeriod + 1);
+}
+
+void Noise::stepEnvelope() {
+    if (envelopeStart)
+    {
+        envelopeVolume = 15;
+        envelopeValue = envelopePeriod;
+        envelopeStart = false;
+    }
+    else if (envelopeValue > 0)
+    {
+        envelopeValue--;
+    }
+    else
+    {
+        if (envelopeVolume > 0)
+        {
+            envelopeVolume--;
+        }
+        else if (envelopeLoop)
+        {
+            envelopeVolume = 15;
+        }
+        envelopeValue = envelopePeriod;
+    }
+}
+
+void Noise::stepLength() {
+    if (lengthEnabled && lengthValue > 0)
+    {
+        lengthValue--;
+    }
+}
+
+u8 Noise::out() const {
+    if (!enabled || lengthValue == 0 || (shiftRegister & 1) == 1)
+    {
+        return 0;
+    }
+
+    if (envelopeEnabled)
+    {
+        return envelopeVolume;
+    }
+
+    return constantVolume;
+}
+
+DMC::DMC(Memory *memory) {
+    this->memory = memory;
+}
+
+void DMC::writeControl(u8 value) {
+    irqEnabled = (value & 0x80) == 0x80;
+    loop = (value & 0x40) == 0x40;
+    timerPeriod = dmcRateTable[value & 0x0f] / 2 - 1;
+
+    if (!irqEnabled)
+        irqFlag = false;
+}
+
+void DMC::writeLevel(u8 value) {
+    level = value & 0x7f;
+}
+
+void DMC::writeAddress(u8 value) {
+    sampleAddress = 0xc000 | (u16(value) << 6);
+}
+
+void DMC::writeLength(u8 value) {
+    sampleLength = (u16(value) << 4) | 1;
+}
+
+void DMC::setEnabled(bool enabled) {
+    irqFlag = false;
+
+    if (!enabled)
+    {
+        bytesRemaining = 0;
+        return;
+    }
+
+    if (bytesRemaining == 0)
+    {
+        restart();
+        if (bufferEmpty)
+            fetch();
+    }
+}
+
+bool DMC::idle() const {
+    return silence && bufferEmpty && bytesRemaining == 0;
+}
+
+void DMC::advance(u32 cycles) {
+    if (cycles <= timerValue)
+    {
+        timerValue -= cycles;
+        return;
+    }
+
+    cycles -= timerValue + 1;
+    const u32 length = timerPeriod + 1;
+    u32 clocks = 1 + cycles / length;
+    timerValue = timerPeriod - cycles % length;
+
+    while (clocks > 0 && !idle())
+    {
+        clock();
+        clocks--;
+    }
+
+    // nothing to play, the output unit just keeps counting its bits
+    if (clocks > 0)
+        bitsRemaining = (bitsRemaining - 1 + 8 - clocks % 8) % 8 + 1;
+}
+
+u32 DMC::cyclesToTransition() const {
+    // every clock can move the level or fetch the next byte
+    return idle() ? 0 : timerValue + 1;
+}
+
+void DMC::clock() {
+    if (!silence)
+    {
+        if (shiftRegister & 1)
+        {
+            if (level <= 125)
+                level += 2;
+        }
+        else if (level >= 2)
+        {
+            level -= 2;
+        }
+    }
+    shiftRegister >>= 1;
+
+    if (--bitsRemaining > 0)
+        return;
+
+    bitsRemaining = 8;
+    silence = bufferEmpty;
+    if (!bufferEmpty)
+    {
+        shiftRegister = sampleBuffer;
+        bufferEmpty = true;
+        if (bytesRemaining > 0)
+            fetch();
+    }
+}
+
+void DMC::fetch() {
+    if (bytesRemaining == 0)
+        return;
+
+    // 4 cycles is the common case, it can be 1-3 depending on what the CPU is doing
+    memory->cpuLines.stall += 4;
+    sampleBuffer = memory->read(currentAddress);
+    bufferEmpty = false;
+    currentAddress = currentAddress == 0xffff ? 0x8000 : currentAddress + 1;
+
+    if (--bytesRemaining > 0)
+        return;
+
+    if (loop)
+    {
+        restart();
+    }
+    else if (irqEnabled)
+    {
+        irqFlag = true;
+        memory->cpuLines.irq = true;
+    }
+}
+
+void DMC::restart() {
+    currentAddress = sampleAddress;
+    bytesRemaining = sampleLength;
+}
+
+u8 DMC::out() const {
+    return level;
+}
+
+AudioFilter AudioFilter::highPass(float cutoff, float sampleRate) {
+    const float rc = 1.0f / (2 * std::numbers::pi_v<float> * cutoff);
+    const float alpha = rc / (rc + 1.0f / sampleRate);
+
+    AudioFilter filter;
+    filter.b0 = alpha;
+    filter.b1 = -alpha;
+    filter.a1 = alpha;
+    return filter;
+}
+
+AudioFilter AudioFilter::lowPass(float cutoff, float sampleRate) {
+    const float rc = 1.0f / (2 * std::numbers::pi_v<float> * cutoff);
+    const float alpha = (1.0f / sampleRate) / (rc + 1.0f / sampleRate);
+
+    AudioFilter filter;
+    filter.b0 = alpha;
+    filter.b1 = 0;
+    filter.a1 = 1 - alpha;
+    return filter;
+}
+
+float AudioFilter::process(float in) {
+    lastOut = b0 * in + b1 * lastIn + a1 * lastOut;
+    lastIn = in;
+    return lastOut;
+}
+
+APU::APU(Memory *sharedMemory)
+    : memory(sharedMemory), dmc(sharedMemory), blip(double(NES_CLOCK_HZ), audioFrequency, audioFrequency / 50) {
+    filters = {
+        AudioFilter::highPass(90, audioFrequency),
+        AudioFilter::highPass(440, audioFrequency),
+        AudioFilter::lowPass(14000, audioFrequency),
+    };
+    outputSamples.resize(audioFrequency / 50);
+
     sharedMemory->beforeWrite.push_back([this](u16 addr, u8 val) -> bool {
+        if (addr < 0x4000 || addr > 0x4017)
+            return true;
+
+        // the write lands on channels that are up to date
+        advanceTo(target_cycle);
+
         switch (addr) {
             case 0x4000:
                 pulse1.writeControl(val);
@@ -296,65 +604,240 @@ APU::APU(Memory *sharedMemory) {
             case 0x400B:
                 triangle.writeTimerHigh(val);
                 break;
+            case 0x400C:
+                noise.writeControl(val);
+                break;
+            case 0x400E:
+                noise.writePeriod(val);
+                break;
+            case 0x400F:
+                noise.writeLength(val);
+                break;
+            case 0x4010:
+                dmc.writeControl(val);
+                updateIRQ();
+                break;
+            case 0x4011:
+                dmc.writeLevel(val);
+                break;
+            case 0x4012:
+                dmc.writeAddress(val);
+                break;
+            case 0x4013:
+                dmc.writeLength(val);
+                break;
             case 0x4015:
                 writeControl(val);
+                updateIRQ();
                 break;
             case 0x4017:
                 frameCounter.stopIRQ = val & Bit6;
                 frameCounter.mode4Step = val & Bit7;
+                if (frameCounter.stopIRQ)
+                    frameIRQ = false;
+                updateIRQ();
                 break;
         }
 
+        updateOutput();
+        schedule();
+
         return true;
     });
+
+    sharedMemory->beforeRead.push_back([this](u16 addr) -> std::optional<u8> {
+        if (addr == APUSTATUSAddress)
+            return readStatus();
+
+        return std::nullopt;
+    });
 }
 
 void APU::step(nes_cycle_t count) {
-    while(master_cycle < count) {
-        stepAPU(nes_apu_cycle_t(1));
+    // cycles up to and including the one count falls in
+    target_cycle = nes_apu_cycle_t((count.count() + 5) / 6);
+
+    // a long step is flushed where per cycle steps would have been, the blip buffer holds 20 ms
+    const nes_cycle_t flushPeriod(NES_CLOCK_HZ / 240);
+    while (!timingOnly && target_cycle > std::chrono::ceil<nes_apu_cycle_t>(blipFrameStart + flushPeriod))
+    {
+        runUntil(std::chrono::ceil<nes_apu_cycle_t>(blipFrameStart + flushPeriod));
+        flushAudio();
+    }
 
-        //frame counter/ sequencer
-        u8 previousStepCounter = frameCounter.currentTick;
+    runUntil(target_cycle);
 
-        for (auto i : stepTable) {
-            if(apu_cycle.count() == i) {
-                frameCounter.currentTick++;
-                break;
-            }
-        }
+    // the line is a level, held until the flags are acknowledged, an IRQ taken or masked is raised again
+    if (frameIRQ || dmc.irqFlag)
+        memory->cpuLines.irq = true;
+
+    // a few milliseconds at a time
+    if (!timingOnly && master_cycle - blipFrameStart >= flushPeriod)
+        flushAudio();
+}
+
+void APU::runUntil(nes_apu_cycle_t cycle) {
+    while (nextEvent <= cycle)
+    {
+        advanceTo(nextEvent);
+
+        if (apu_cycle == nextFrameStep)
+        {
+            const i64 position = apu_cycle.count() % (stepTable[3] + 1);
+
+            for (u8 i = 0; i < 4; ++i)
+                if (position == stepTable[i])
+                    frameCounter.currentTick = i + 1;
 
-        if(previousStepCounter != frameCounter.currentTick) {
             sequencer();
-        }
 
-        if(sample_cycle.count() > 20) {
-            sampleBuffer.push_back(getSample());
-            sample_cycle = nes_apu_cycle_t(0);
+            // the sequence wraps after the last step's cycle
+            const i64 next = frameCounter.currentTick < 4
+                ? stepTable[frameCounter.currentTick] - position
+                : stepTable[3] + 1 - position + stepTable[0];
+            nextFrameStep = apu_cycle + nes_apu_cycle_t(next);
         }
+
+        updateOutput();
+        schedule();
+    }
+
+    master_cycle = cycle;
+}
+
+void APU::readSamples(i16 *dst, size_t count) {
+    const size_t read = samples.pop(dst, count);
+
+    if (read > 0)
+        lastSample = dst[read - 1];
+
+    if (read < count)
+    {
+        std::fill_n(dst + read, count - read, lastSample);
+        underruns.fetch_add(1, std::memory_order_relaxed);
+    }
+}
+
+void APU::readSamples(float *dst, size_t count) {
+    i16 chunk[512];
+
+    while (count > 0)
+    {
+        const size_t n = std::min(count, std::size(chunk));
+        readSamples(chunk, n);
+
+        for (size_t i = 0; i < n; ++i)
+            dst[i] = chunk[i] * (1.0f / 32768);
+
+        dst += n;
+        count -= n;
+    }
+}
+
+u64 APU::getUnderruns() const {
+    return underruns.load(std::memory_order_relaxed);
+}
+
+u64 APU::getOverruns() const {
+    return overruns.load(std::memory_order_relaxed);
+}
+
+size_t APU::getQueuedSamples() const {
+    return samples.size();
+}
+
+void APU::setTimingOnly(bool enabled) {
+    timingOnly = enabled;
+    schedule();
+}
+
+bool APU::isTimingOnly() const {
+    return timingOnly;
+}
+
+void APU::setRecorder(AudioRecorder *recorder) {
+    this->recorder = recorder;
+}
+
+void APU::setRateControl(bool enabled) {
+    rateControl = enabled;
+    if (enabled)
+        return;
+
+    blip.setRates(double(NES_CLOCK_HZ), audioFrequency);
+    if (resampler)
+        resampler->setRatio(1);
+    rateIntegral = 0;
+    rateRatio.store(1, std::memory_order_relaxed);
+}
+
+void APU::setResampler(std::optional<ResampleQuality> quality) {
+    if (!quality)
+    {
+        resampler.reset();
+        blip.clear();
+        blipFrameStart = master_cycle;
+        return;
     }
+
+    resampler = std::make_unique<Resampler>(double(NES_CLOCK_HZ) / resampleDivider, audioFrequency, *quality);
+    steppedUntil = master_cycle;
+    boxSum = 0;
+    boxCycles = 0;
+    stepped.clear();
 }
 
-std::vector<u8>* APU::getSampleBuffer() {
-    return &sampleBuffer;
+void APU::setTargetFill(u32 samples) {
+    targetFill = std::clamp<u32>(samples, 1, this->samples.capacity() / 2);
+    smoothedFill = float(targetFill);
+    bufferFill.store(smoothedFill, std::memory_order_relaxed);
 }
 
-void APU::clearSampleBuffer() {
-    sampleBuffer.clear();
+u32 APU::getTargetFill() const {
+    return targetFill;
 }
 
-void APU::stepAPU(nes_apu_cycle_t count) {
-    master_cycle += count;
-    apu_cycle += count;
-    sample_cycle += count;
+float APU::getBufferFill() const {
+    return bufferFill.load(std::memory_order_relaxed);
+}
+
+float APU::getRateRatio() const {
+    return rateRatio.load(std::memory_order_relaxed);
+}
 
-    pulse1.stepTimer();
-    pulse2.stepTimer();
-    triangle.stepTimer();
+void APU::advanceTo(nes_apu_cycle_t cycle) {
+    if (cycle <= apu_cycle)
+        return;
 
-    if(apu_cycle.count() > stepTable[3]) {
-        apu_cycle = nes_apu_cycle_t(0);
-        frameCounter.currentTick = 0;
+    const u32 cycles = (cycle - apu_cycle).count();
+    if (!timingOnly)
+    {
+        pulse1.advance(cycles);
+        pulse2.advance(cycles);
+        triangle.advance(cycles);
+        noise.advance(cycles);
     }
+    // the DMC's timer decides when it fetches, that's visible to the CPU
+    dmc.advance(cycles);
+
+    apu_cycle = cycle;
+    master_cycle = cycle;
+}
+
+void APU::schedule() {
+    nextEvent = nextFrameStep;
+
+    if (timingOnly)
+    {
+        if (const u32 cycles = dmc.cyclesToTransition(); cycles != 0)
+            nextEvent = std::min(nextEvent, apu_cycle + nes_apu_cycle_t(cycles));
+        return;
+    }
+
+    for (u32 cycles : {pulse1.cyclesToTransition(), pulse2.cyclesToTransition(), triangle.cyclesToTransition(),
+                       noise.cyclesToTransition(), dmc.cyclesToTransition()})
+        if (cycles != 0)
+            nextEvent = std::min(nextEvent, apu_cycle + nes_apu_cycle_t(cycles));
 }
 
 void APU::sequencer() {
@@ -377,39 +860,173 @@ void APU::sequencer() {
     }
 }
 
-void APU::invokeIRQ() const {
+void APU::updateIRQ() {
+    memory->cpuLines.irq = frameIRQ || dmc.irqFlag;
+}
+
+void APU::invokeIRQ() {
     if(!frameCounter.stopIRQ)
-        CPU::setIRQ();
+    {
+        frameIRQ = true;
+        memory->cpuLines.irq = true;
+    }
 }
 
 void APU::quarterFrame() {
     pulse1.stepLength();
     pulse2.stepLength();
     triangle.stepLength();
+    noise.stepLength();
 }
 
 void APU::halfFrame() {
+    // envelopes, the linear counter and sweeps only shape the sound
+    if (timingOnly)
+        return;
+
     pulse1.stepEnvelope();
     pulse2.stepEnvelope();
     triangle.stepCounter();
+    noise.stepEnvelope();
 
     pulse1.stepSweep();
     pulse2.stepSweep();
 }
 
-u8 APU::getSample() {
-    double pulseOut = 0.00752 * (pulse1.out() + pulse2.out());
-    double tndOut = 0.00851 * triangle.out();
-    double returnValue = floor(255.0 * (pulseOut + tndOut));
+i32 APU::mix() const {
+    return pulseMixTable[pulse1.out() + pulse2.out()] + tndMixTable[3 * triangle.out() + 2 * noise.out() + dmc.out()];
+}
+
+void APU::updateOutput() {
+    if (timingOnly)
+        return;
+
+    const i32 level = mix();
+    if (level == amplitude)
+        return;
+
+    if (resampler)
+        renderSteps(master_cycle);
+    else
+        blip.addDelta((master_cycle - blipFrameStart).count(), level - amplitude);
+
+    amplitude = level;
+}
+
+void APU::renderSteps(nes_cycle_t until) {
+    i64 cycles = (until - steppedUntil).count();
+    steppedUntil = until;
 
-    WARNLOG(std::to_string(static_cast<u8>(returnValue)));
-    return static_cast<u8>(returnValue);
+    while (cycles > 0)
+    {
+        const i64 take = std::min<i64>(cycles, resampleDivider - boxCycles);
+        boxSum += amplitude * take;
+        boxCycles += u8(take);
+        cycles -= take;
+
+        if (boxCycles == resampleDivider)
+        {
+            stepped.push_back(float(boxSum) / resampleDivider);
+            boxSum = 0;
+            boxCycles = 0;
+        }
+    }
+}
+
+i16 APU::filter(float sample) {
+    for (AudioFilter& stage : filters)
+        sample = stage.process(sample);
+
+    return i16(std::clamp(sample, -32768.0f, 32767.0f));
+}
+
+void APU::flushAudio() {
+    u32 count;
+
+    if (resampler)
+    {
+        renderSteps(master_cycle);
+        // still what paces the flushes
+        blipFrameStart = master_cycle;
+
+        resampled.resize(resampler->maxOutput(stepped.size()));
+        count = u32(resampler->process(stepped.data(), stepped.size(), resampled.data()));
+        stepped.clear();
+
+        // a long step or a rate nudged up gives more than a usual flush, none of it is dropped
+        if (outputSamples.size() < count)
+            outputSamples.resize(count);
+
+        for (u32 i = 0; i < count; ++i)
+            outputSamples[i] = filter(resampled[i]);
+    }
+    else
+    {
+        blip.endFrame((master_cycle - blipFrameStart).count());
+        blipFrameStart = master_cycle;
+
+        count = blip.read(outputSamples.data(), outputSamples.size());
+        for (u32 i = 0; i < count; ++i)
+            outputSamples[i] = filter(outputSamples[i]);
+    }
+
+    if (recorder)
+        recorder->submit(outputSamples.data(), count);
+
+    const size_t maxFill = 2 * targetFill;
+    const size_t room = maxFill - std::min(samples.size(), maxFill);
+    const size_t pushed = samples.push(outputSamples.data(), std::min<size_t>(count, room));
+    if (pushed < count)
+        overruns.fetch_add(count - pushed, std::memory_order_relaxed);
+
+    if (rateControl)
+        controlRate();
+}
+
+void APU::controlRate() {
+    // https://docs.libretro.com/development/cores/dynamic-rate-control/
+    // the device drains in chunks, so only the average fill says whether samples come too fast or too slow
+    smoothedFill += (float(samples.size()) - smoothedFill) * 0.02f;
+
+    const float error = std::clamp((float(targetFill) - smoothedFill) / targetFill, -1.0f, 1.0f);
+    // the integral takes up a steady clock mismatch, so the fill settles on the target instead of next to it
+    rateIntegral = std::clamp(rateIntegral + error * audioMaxRateDelta * 0.002f, -audioMaxRateDelta, audioMaxRateDelta);
+    const float ratio = 1 + std::clamp(audioMaxRateDelta * error + rateIntegral, -audioMaxRateDelta, audioMaxRateDelta);
+
+    // a frame was just closed, steps from here on land with the new rate
+    blip.setRates(double(NES_CLOCK_HZ), audioFrequency * double(ratio));
+    if (resampler)
+        resampler->setRatio(ratio);
+
+    bufferFill.store(smoothedFill, std::memory_order_relaxed);
+    rateRatio.store(ratio, std::memory_order_relaxed);
+}
+
+u8 APU::readStatus() {
+    u8 status = 0;
+    if (pulse1.lengthValue > 0) status |= Bit0;
+    if (pulse2.lengthValue > 0) status |= Bit1;
+    if (triangle.lengthValue > 0) status |= Bit2;
+    if (noise.lengthValue > 0) status |= Bit3;
+    if (dmc.bytesRemaining > 0) status |= Bit4;
+    if (frameIRQ) status |= Bit6;
+    if (dmc.irqFlag) status |= Bit7;
+
+    frameIRQ = false;
+    updateIRQ();
+    return status;
+}
+
+i32 APU::getLevel() const {
+    return amplitude;
 }
 
 void APU::writeControl(uint8_t val) {
     pulse1.enabled = (val & 1) == 1;
     pulse2.enabled = (val & 2) == 2;
     triangle.enabled = (val & 4) == 4;
+    noise.enabled = (val & 8) == 8;
+    dmc.setEnabled((val & 16) == 16);
     if (!pulse1.enabled)
     {
         pulse1.lengthValue = 0;
@@ -422,4 +1039,8 @@ void APU::writeControl(uint8_t val) {
     {
         triangle.lengthValue = 0;
     }
+    if (!noise.enabled)
+    {
+        noise.lengthValue = 0;
+    }
 }
@@ -0,0 +1,52 @@
+#include "AudioPlayback.h"
+
+#include <algorithm>
+
+#include "APU.h"
+
+AudioPlayback::AudioPlayback(APU *apu, u32 sampleRate) {
+    this->apu = apu;
+    this->sampleRate = sampleRate;
+}
+
+void AudioPlayback::fill(i16 *dst, size_t count) {
+    const size_t queued = apu->getQueuedSamples();
+
+    if (!priming && queued == 0)
+    {
+        priming = true;
+        prefills.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    if (priming && queued < apu->getTargetFill())
+    {
+        std::fill_n(dst, count, held);
+        return;
+    }
+
+    priming = false;
+    apu->readSamples(dst, count);
+    held = dst[count - 1];
+
+    // the newest queued sample plays after everything ahead of it, and the device still has a chunk in flight
+    const float latency = float(queued + count) * 1000 / sampleRate;
+    const float smoothed = latencyMs.load(std::memory_order_relaxed);
+    latencyMs.store(smoothed == 0 ? latency : smoothed + (latency - smoothed) * 0.05f, std::memory_order_relaxed);
+    maxLatencyMs.store(std::max(maxLatencyMs.load(std::memory_order_relaxed), latency), std::memory_order_relaxed);
+}
+
+bool AudioPlayback::isPriming() const {
+    return priming;
+}
+
+float AudioPlayback::getLatencyMs() const {
+    return latencyMs.load(std::memory_order_relaxed);
+}
+
+float AudioPlayback::getMaxLatencyMs() const {
+    return maxLatencyMs.load(std::memory_order_relaxed);
+}
+
+u64 AudioPlayback::getPrefills() const {
+    return prefills.load(std::memory_order_relaxed);
+}
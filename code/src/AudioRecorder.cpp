@@ -0,0 +1,136 @@
+#include "AudioRecorder.h"
+
+#include <algorithm>
+#include <bit>
+#include <chrono>
+
+#include "Logger.h"
+
+namespace {
+    // WAV is little endian whatever the host is
+    void put(std::ofstream& file, u32 value, u8 bytes) {
+        for (u8 i = 0; i < bytes; ++i)
+            file.put(char((value >> (i * 8)) & 0xff));
+    }
+}
+
+AudioRecorder::AudioRecorder(const std::string &path, Format format, u32 sampleRate, Overflow overflow) {
+    this->format = format;
+    this->sampleRate = sampleRate;
+    this->overflow = overflow;
+
+    file.open(path, std::ofstream::out | std::ofstream::binary | std::ofstream::trunc);
+    if (!file.is_open())
+    {
+        ERRORLOG("Unable to open " + path + " for recording");
+        return;
+    }
+
+    // sizes are filled in once they are known
+    if (format == Format::Wav)
+        writeHeader(0);
+
+    block.resize(blockSize);
+    running = true;
+    writer = std::thread(&AudioRecorder::run, this);
+
+    INFOLOG("recording audio to " + path);
+}
+
+AudioRecorder::~AudioRecorder() {
+    close();
+}
+
+void AudioRecorder::close() {
+    if (!writer.joinable())
+        return;
+
+    running = false;
+    writer.join();
+
+    if (format == Format::Wav)
+    {
+        file.seekp(0);
+        writeHeader(u32(std::min<u64>(written.load() * sizeof(i16), UINT32_MAX - 44)));
+    }
+
+    file.close();
+}
+
+AudioRecorder::Format AudioRecorder::formatFor(const std::string &path) {
+    const bool wav = path.ends_with(".wav") || path.ends_with(".WAV");
+    return wav ? Format::Wav : Format::Raw;
+}
+
+bool AudioRecorder::isOpen() const {
+    return file.is_open();
+}
+
+void AudioRecorder::submit(const i16 *samples, size_t count) {
+    size_t pushed = queue.push(samples, count);
+
+    if (overflow == Overflow::Wait)
+        while (pushed < count && running)
+        {
+            std::this_thread::yield();
+            pushed += queue.push(samples + pushed, count - pushed);
+        }
+
+    if (pushed < count)
+        dropped.fetch_add(count - pushed, std::memory_order_relaxed);
+}
+
+u64 AudioRecorder::getSamplesWritten() const {
+    return written.load(std::memory_order_relaxed);
+}
+
+u64 AudioRecorder::getDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+void AudioRecorder::run() {
+    while (true)
+    {
+        // read the flag first, whatever was submitted before it went down is still drained
+        const bool stopping = !running.load();
+
+        size_t count;
+        while ((count = queue.pop(block.data(), block.size())) > 0)
+            writeBlock(count);
+
+        if (stopping)
+            break;
+
+        std::this_thread::sleep_for(std::chrono::milliseconds(5));
+    }
+
+    file.flush();
+}
+
+void AudioRecorder::writeBlock(size_t count) {
+    if constexpr (std::endian::native == std::endian::big)
+        for (size_t i = 0; i < count; ++i)
+            block[i] = i16(std::byteswap(u16(block[i])));
+
+    file.write(reinterpret_cast<const char*>(block.data()), std::streamsize(count * sizeof(i16)));
+    written.fetch_add(count, std::memory_order_relaxed);
+}
+
+void AudioRecorder::writeHeader(u32 dataBytes) {
+    // http://soundfile.sapp.org/doc/WaveFormat/
+    file.write("RIFF", 4);
+    put(file, 36 + dataBytes, 4);
+    file.write("WAVE", 4);
+
+    file.write("fmt ", 4);
+    put(file, 16, 4);
+    put(file, 1, 2); // PCM
+    put(file, 1, 2); // mono
+    put(file, sampleRate, 4);
+    put(file, sampleRate * sizeof(i16), 4);
+    put(file, sizeof(i16), 2);
+    put(file, 16, 2);
+
+    file.write("data", 4);
+    put(file, dataBytes, 4);
+}
@@ -0,0 +1,126 @@
+#include "BackgroundCache.h"
+
+#include <algorithm>
+#include <cstring>
+#include <utility>
+
+#include "PPU.h"
+
+BackgroundCache::BackgroundCache(PPU *ppu) {
+    this->ppu = ppu;
+
+    bitmap.resize(width * height, 0);
+    dirty.resize(tileColumns * tileRows, 1);
+}
+
+void BackgroundCache::invalidateAll() {
+    patternsDirty = true;
+}
+
+void BackgroundCache::invalidateVram(u16 addr) {
+    addr &= 0x3fff;
+
+    if (addr < 0x2000)
+    {
+        patternsDirty = true;
+        return;
+    }
+
+    if (addr >= 0x3f00)
+        return;
+
+    // mirroring decides which logical nametables share the byte, marking all four is cheaper than asking
+    u16 offset = addr & 0x3ff;
+
+    if (offset < 0x3c0)
+    {
+        markTile(offset & 0x1f, offset >> 5);
+        return;
+    }
+
+    // http://wiki.nesdev.com/w/index.php/PPU_attribute_tables
+    u8 attr = offset - 0x3c0;
+    u8 column = (attr & 0x7) * 4;
+    u8 row = (attr >> 3) * 4;
+
+    for (u8 y = row; y < row + 4 && y < 30; ++y)
+        for (u8 x = column; x < column + 4; ++x)
+            markTile(x, y);
+}
+
+void BackgroundCache::copyLine(u16 v, u8 fineX, u8 fineY, u16 patternTable, u8 *dst) {
+    if (patternTable != this->patternTable)
+    {
+        this->patternTable = patternTable;
+        patternsDirty = true;
+    }
+
+    if (patternsDirty)
+    {
+        std::fill(dirty.begin(), dirty.end(), 1);
+        patternsDirty = false;
+    }
+
+    u8 coarseX = v & 0x1f;
+    u8 coarseY = (v >> 5) & 0x1f;
+    u8 nametable = (v >> 10) & 0x3;
+
+    u8 row = (nametable >> 1) * 30 + coarseY;
+    u8 firstColumn = (nametable & 1) * 32 + coarseX;
+
+    for (u8 i = 0; i < 33; ++i)
+    {
+        u8 column = (firstColumn + i) % tileColumns;
+        if (dirty[row * tileColumns + column])
+            renderTile(column, row);
+    }
+
+    const u8* src = bitmap.data() + (row * 8 + fineY) * width;
+    u16 x = firstColumn * 8 + fineX;
+    u16 firstPart = std::min<u16>(resolution.x, width - x);
+
+    memcpy(dst, src + x, firstPart);
+    memcpy(dst + firstPart, src, resolution.x - firstPart);
+}
+
+u32 BackgroundCache::takeTilesRendered() {
+    return std::exchange(tilesRendered, 0);
+}
+
+void BackgroundCache::markTile(u8 column, u8 row) {
+    dirty[row * tileColumns + column] = 1;
+    dirty[row * tileColumns + column + 32] = 1;
+    dirty[(row + 30) * tileColumns + column] = 1;
+    dirty[(row + 30) * tileColumns + column + 32] = 1;
+}
+
+void BackgroundCache::renderTile(u8 column, u8 row) {
+    dirty[row * tileColumns + column] = 0;
+    tilesRendered++;
+
+    u8 nametable = (row >= 30 ? 2 : 0) | (column >= 32 ? 1 : 0);
+    u8 tileColumn = column & 0x1f;
+    u8 tileRow = row % 30;
+
+    u16 nametableAddress = 0x2000 | (nametable << 10);
+    u8 tileIndex = ppu->readVram(nametableAddress | (tileRow << 5) | tileColumn);
+
+    u8 colorByte = ppu->readVram(nametableAddress | 0x3c0 | ((tileRow >> 2) << 3) | (tileColumn >> 2));
+    u8 quadrant = (tileRow & 0x2) + ((tileColumn & 0x2) >> 1);
+    u8 paletteBit32 = ((colorByte >> (quadrant * 2)) & 0x3) << 2;
+
+    u16 tileAddress = patternTable | (tileIndex << 4);
+    u8* dst = bitmap.data() + row * 8 * width + column * 8;
+
+    for (u8 y = 0; y < 8; ++y, dst += width)
+    {
+        u8 bitplane0 = ppu->readVram(tileAddress | y);
+        u8 bitplane1 = ppu->readVram(tileAddress | 8 | y);
+
+        for (u8 x = 0; x < 8; ++x)
+        {
+            u8 bit = 7 - x;
+            dst[x] = paletteBit32 | ((bitplane0 >> bit) & 1) | (((bitplane1 >> bit) & 1) << 1);
+        }
+    }
+}
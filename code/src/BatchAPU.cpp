@@ -0,0 +1,485 @@
+#include "BatchAPU.h"
+
+#include <algorithm>
+
+#include "NESHelpers.h"
+#include "Simd.h"
+
+using namespace apu;
+
+BatchAPU::BatchAPU(u32 instances) {
+    this->instances = instances;
+    lanes = (instances + 3) & ~3u;
+
+    auto resize = [this](Lanes& lanes, i32 value) { lanes.assign(this->lanes, value); };
+    auto resizeEnvelope = [&](Envelope& envelope) {
+        for (Lanes* lanes : {&envelope.enabled, &envelope.loop, &envelope.start, &envelope.period, &envelope.value,
+                             &envelope.volume, &envelope.constantVolume})
+            resize(*lanes, 0);
+    };
+
+    for (Pulse& pulse : pulses)
+    {
+        for (Lanes* lanes : {&pulse.enabled, &pulse.lengthEnabled, &pulse.length, &pulse.timerPeriod, &pulse.timer,
+                             &pulse.dutyMode, &pulse.duty, &pulse.sweepReload, &pulse.sweepEnabled, &pulse.sweepNegate,
+                             &pulse.sweepShift, &pulse.sweepPeriod, &pulse.sweepValue})
+            resize(*lanes, 0);
+        resizeEnvelope(pulse.envelope);
+    }
+
+    for (Lanes* lanes : {&triangle.enabled, &triangle.lengthEnabled, &triangle.length, &triangle.timerPeriod,
+                         &triangle.timer, &triangle.duty, &triangle.counterPeriod, &triangle.counter,
+                         &triangle.counterReload})
+        resize(*lanes, 0);
+
+    for (Lanes* lanes : {&noise.enabled, &noise.lengthEnabled, &noise.length, &noise.timer, &noise.shortMode})
+        resize(*lanes, 0);
+    resize(noise.timerPeriod, noiseTable[0] / 2 - 1);
+    resize(noise.shift, 1);
+    resizeEnvelope(noise.envelope);
+
+    resize(dmcLevel, 0);
+    resize(stopIRQ, 0);
+    resize(frameIRQ, 0);
+
+    nextFrameStep = stepTable[0];
+}
+
+u32 BatchAPU::size() const {
+    return instances;
+}
+
+u64 BatchAPU::getCycle() const {
+    return cycle;
+}
+
+void BatchAPU::setVectorized(bool enabled) {
+    vectorized = enabled;
+}
+
+bool BatchAPU::isVectorized() const {
+#ifdef NES_SSE2
+    return vectorized;
+#else
+    return false;
+#endif
+}
+
+void BatchAPU::write(u32 i, u16 addr, u8 val) {
+    auto writeEnvelope = [&](Envelope& envelope) {
+        envelope.loop[i] = (val >> 5) & 1;
+        envelope.enabled[i] = ((val >> 4) & 1) == 0;
+        envelope.period[i] = val & 15;
+        envelope.constantVolume[i] = val & 15;
+        envelope.start[i] = 1;
+    };
+
+    if (addr >= 0x4000 && addr <= 0x4007)
+    {
+        Pulse& pulse = pulses[(addr >> 2) & 1];
+
+        switch (addr & 3) {
+            case 0:
+                pulse.dutyMode[i] = (val >> 6) & 3;
+                pulse.lengthEnabled[i] = ((val >> 5) & 1) == 0;
+                writeEnvelope(pulse.envelope);
+                break;
+            case 1:
+                pulse.sweepEnabled[i] = (val >> 7) & 1;
+                pulse.sweepPeriod[i] = ((val >> 4) & 7) + 1;
+                pulse.sweepNegate[i] = (val >> 3) & 1;
+                pulse.sweepShift[i] = val & 7;
+                pulse.sweepReload[i] = 1;
+                break;
+            case 2:
+                pulse.timerPeriod[i] = (pulse.timerPeriod[i] & 0xff00) | val;
+                break;
+            case 3:
+                pulse.length[i] = lengthTable[val >> 3];
+                pulse.timerPeriod[i] = (pulse.timerPeriod[i] & 0xff) | ((val & 7) << 8);
+                pulse.envelope.start[i] = 1;
+                pulse.duty[i] = 0;
+                break;
+        }
+        return;
+    }
+
+    switch (addr) {
+        case 0x4008:
+            triangle.lengthEnabled[i] = ((val >> 7) & 1) == 0;
+            triangle.counterPeriod[i] = val & 0x7f;
+            break;
+        case 0x400A:
+            triangle.timerPeriod[i] = (triangle.timerPeriod[i] & 0xff00) | val;
+            break;
+        case 0x400B:
+            triangle.length[i] = lengthTable[val >> 3];
+            triangle.timerPeriod[i] = (triangle.timerPeriod[i] & 0xff) | ((val & 7) << 8);
+            triangle.timer[i] = triangle.timerPeriod[i];
+            triangle.counterReload[i] = 1;
+            break;
+        case 0x400C:
+            noise.lengthEnabled[i] = ((val >> 5) & 1) == 0;
+            writeEnvelope(noise.envelope);
+            break;
+        case 0x400E:
+            noise.shortMode[i] = (val >> 7) & 1;
+            noise.timerPeriod[i] = noiseTable[val & 0x0f] / 2 - 1;
+            break;
+        case 0x400F:
+            noise.length[i] = lengthTable[val >> 3];
+            noise.envelope.start[i] = 1;
+            break;
+        case 0x4011:
+            dmcLevel[i] = val & 0x7f;
+            break;
+        case 0x4015:
+            pulses[0].enabled[i] = val & 1;
+            pulses[1].enabled[i] = (val >> 1) & 1;
+            triangle.enabled[i] = (val >> 2) & 1;
+            noise.enabled[i] = (val >> 3) & 1;
+            for (Pulse& pulse : pulses)
+                if (!pulse.enabled[i])
+                    pulse.length[i] = 0;
+            if (!triangle.enabled[i])
+                triangle.length[i] = 0;
+            if (!noise.enabled[i])
+                noise.length[i] = 0;
+            break;
+        case 0x4017:
+            stopIRQ[i] = (val & Bit6) != 0;
+            if (stopIRQ[i])
+                frameIRQ[i] = 0;
+            break;
+    }
+}
+
+u8 BatchAPU::readStatus(u32 i) {
+    u8 status = 0;
+    if (pulses[0].length[i] > 0) status |= Bit0;
+    if (pulses[1].length[i] > 0) status |= Bit1;
+    if (triangle.length[i] > 0) status |= Bit2;
+    if (noise.length[i] > 0) status |= Bit3;
+    if (frameIRQ[i]) status |= Bit6;
+
+    frameIRQ[i] = 0;
+    return status;
+}
+
+void BatchAPU::run(u32 cycles) {
+    while (cycles > 0)
+    {
+        // timers run in stretches between frame counter steps, which touch everything else
+        const u32 chunk = u32(std::min<u64>(cycles, nextFrameStep - cycle));
+        runTimers(chunk);
+        cycle += chunk;
+        cycles -= chunk;
+
+        if (cycle == nextFrameStep)
+            frameStep();
+    }
+}
+
+void BatchAPU::runTimers(u32 cycles) {
+    if (cycles == 0)
+        return;
+
+    // the same catch up as the channels' advance(): a timer at 0 reloads to its period and clocks its sequencer,
+    // so over a stretch that's one clock on reaching 0 and one every period + 1 cycles after
+    for (u32 g = 0; g < lanes; g += 4)
+    {
+#ifdef NES_SSE2
+        if (vectorized)
+        {
+            auto load = [g](const Lanes& lanes) { return _mm_loadu_si128((const __m128i*)&lanes[g]); };
+            auto store = [g](Lanes& lanes, __m128i value) { _mm_storeu_si128((__m128i*)&lanes[g], value); };
+            auto select = [](__m128i mask, __m128i a, __m128i b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); };
+
+            const __m128i zero = _mm_setzero_si128();
+            const __m128i one = _mm_set1_epi32(1);
+            const __m128i count = _mm_set1_epi32(i32(cycles));
+
+            // returns the sequencer clocks per lane. SSE2 has no integer division, but everything is under 2^24,
+            // so the quotient in floats is off by at most one and the remainder says which way
+            auto advance = [&](__m128i& timer, __m128i period) {
+                const __m128i wraps = _mm_cmpgt_epi32(count, timer);
+                const __m128 rest = _mm_cvtepi32_ps(_mm_sub_epi32(_mm_sub_epi32(count, timer), one));
+                const __m128 length = _mm_cvtepi32_ps(_mm_add_epi32(period, one));
+
+                __m128 quotient = _mm_cvtepi32_ps(_mm_cvttps_epi32(_mm_div_ps(rest, length)));
+                __m128 remainder = _mm_sub_ps(rest, _mm_mul_ps(quotient, length));
+                const __m128 under = _mm_cmplt_ps(remainder, _mm_setzero_ps());
+                quotient = _mm_sub_ps(quotient, _mm_and_ps(under, _mm_set1_ps(1)));
+                remainder = _mm_add_ps(remainder, _mm_and_ps(under, length));
+                const __m128 over = _mm_cmpge_ps(remainder, length);
+                quotient = _mm_add_ps(quotient, _mm_and_ps(over, _mm_set1_ps(1)));
+                remainder = _mm_sub_ps(remainder, _mm_and_ps(over, length));
+
+                timer = select(wraps, _mm_sub_epi32(period, _mm_cvttps_epi32(remainder)), _mm_sub_epi32(timer, count));
+                return _mm_and_si128(wraps, _mm_add_epi32(_mm_cvttps_epi32(quotient), one));
+            };
+
+            for (Pulse& pulse : pulses)
+            {
+                __m128i timer = load(pulse.timer);
+                const __m128i clocks = advance(timer, load(pulse.timerPeriod));
+                store(pulse.timer, timer);
+                store(pulse.duty, _mm_and_si128(_mm_add_epi32(load(pulse.duty), clocks), _mm_set1_epi32(7)));
+            }
+
+            {
+                __m128i timer = load(triangle.timer);
+                const __m128i clocks = advance(timer, load(triangle.timerPeriod));
+                store(triangle.timer, timer);
+
+                // length and linear counter only change on frame steps and writes, which end a stretch
+                const __m128i stopped = _mm_or_si128(_mm_cmpeq_epi32(load(triangle.length), zero),
+                                                     _mm_cmpeq_epi32(load(triangle.counter), zero));
+                store(triangle.duty, _mm_and_si128(_mm_add_epi32(load(triangle.duty), _mm_andnot_si128(stopped, clocks)),
+                                                   _mm_set1_epi32(31)));
+            }
+
+            {
+                __m128i timer = load(noise.timer);
+                const __m128i clocks = advance(timer, load(noise.timerPeriod));
+                store(noise.timer, timer);
+
+                i32 counts[4];
+                _mm_storeu_si128((__m128i*)counts, clocks);
+                const i32 most = std::max({counts[0], counts[1], counts[2], counts[3]});
+
+                // https://www.nesdev.org/wiki/APU_Noise, lanes that are done just keep their value
+                const __m128i shortMode = _mm_cmpgt_epi32(load(noise.shortMode), zero);
+                __m128i shift = load(noise.shift);
+                for (i32 k = 0; k < most; ++k)
+                {
+                    const __m128i tap = select(shortMode, _mm_srli_epi32(shift, 6), _mm_srli_epi32(shift, 1));
+                    const __m128i feedback = _mm_and_si128(_mm_xor_si128(shift, tap), one);
+                    const __m128i next = _mm_or_si128(_mm_srli_epi32(shift, 1), _mm_slli_epi32(feedback, 14));
+                    shift = select(_mm_cmpgt_epi32(clocks, _mm_set1_epi32(k)), next, shift);
+                }
+                store(noise.shift, shift);
+            }
+        }
+        else
+#endif
+        for (u32 i = g; i < g + 4; ++i)
+        {
+            auto advance = [cycles](i32& timer, i32 period) -> i32 {
+                if (i32(cycles) <= timer)
+                {
+                    timer -= i32(cycles);
+                    return 0;
+                }
+
+                const i32 rest = i32(cycles) - timer - 1;
+                timer = period - rest % (period + 1);
+                return 1 + rest / (period + 1);
+            };
+
+            for (Pulse& pulse : pulses)
+                pulse.duty[i] = (pulse.duty[i] + advance(pulse.timer[i], pulse.timerPeriod[i])) & 7;
+
+            const i32 triangleClocks = advance(triangle.timer[i], triangle.timerPeriod[i]);
+            if (triangle.length[i] > 0 && triangle.counter[i] > 0)
+                triangle.duty[i] = (triangle.duty[i] + triangleClocks) & 31;
+
+            const i32 noiseClocks = advance(noise.timer[i], noise.timerPeriod[i]);
+            for (i32 k = 0; k < noiseClocks; ++k)
+            {
+                const i32 shift = noise.shift[i];
+                const i32 feedback = (shift ^ (shift >> (noise.shortMode[i] ? 6 : 1))) & 1;
+                noise.shift[i] = (shift >> 1) | (feedback << 14);
+            }
+        }
+    }
+}
+
+void BatchAPU::frameStep() {
+    const u64 position = cycle % (stepTable[3] + 1);
+    u8 tick = 0;
+    for (u8 i = 0; i < 4; ++i)
+        if (position == stepTable[i])
+            tick = i + 1;
+
+    // the same sequence as APU::sequencer
+    if (tick <= 3)
+        quarterFrame();
+    if (tick == 1 || tick == 3)
+        halfFrame();
+    if (tick == 3)
+        for (u32 i = 0; i < lanes; ++i)
+            frameIRQ[i] |= !stopIRQ[i];
+
+    const u64 next = tick < 4
+        ? stepTable[tick] - position
+        : stepTable[3] + 1 - position + stepTable[0];
+    nextFrameStep = cycle + next;
+}
+
+void BatchAPU::quarterFrame() {
+    auto stepLength = [this](const Lanes& enabled, Lanes& length) {
+        for (u32 i = 0; i < lanes; ++i)
+            length[i] -= enabled[i] && length[i] > 0;
+    };
+
+    for (Pulse& pulse : pulses)
+        stepLength(pulse.lengthEnabled, pulse.length);
+    stepLength(triangle.lengthEnabled, triangle.length);
+    stepLength(noise.lengthEnabled, noise.length);
+}
+
+void BatchAPU::stepEnvelopes(Envelope &envelope) {
+    for (u32 i = 0; i < lanes; ++i)
+    {
+        if (envelope.start[i])
+        {
+            envelope.volume[i] = 15;
+            envelope.value[i] = envelope.period[i];
+            envelope.start[i] = 0;
+        }
+        else if (envelope.value[i] > 0)
+        {
+            envelope.value[i]--;
+        }
+        else
+        {
+            if (envelope.volume[i] > 0)
+                envelope.volume[i]--;
+            else if (envelope.loop[i])
+                envelope.volume[i] = 15;
+            envelope.value[i] = envelope.period[i];
+        }
+    }
+}
+
+void BatchAPU::halfFrame() {
+    for (Pulse& pulse : pulses)
+        stepEnvelopes(pulse.envelope);
+    stepEnvelopes(noise.envelope);
+
+    for (u32 i = 0; i < lanes; ++i)
+    {
+        if (triangle.counterReload[i])
+            triangle.counter[i] = triangle.counterPeriod[i];
+        else if (triangle.counter[i] > 0)
+            triangle.counter[i]--;
+        if (triangle.lengthEnabled[i])
+            triangle.counterReload[i] = 0;
+    }
+
+    for (u8 channel = 0; channel < 2; ++channel)
+    {
+        Pulse& pulse = pulses[channel];
+
+        for (u32 i = 0; i < lanes; ++i)
+        {
+            auto sweep = [&] {
+                const i32 delta = pulse.timerPeriod[i] >> pulse.sweepShift[i];
+                // pulse 1 negates with one's complement, https://www.nesdev.org/wiki/APU_Sweep
+                if (pulse.sweepNegate[i])
+                    pulse.timerPeriod[i] = (pulse.timerPeriod[i] - delta - (channel == 0)) & 0xffff;
+                else
+                    pulse.timerPeriod[i] = (pulse.timerPeriod[i] + delta) & 0xffff;
+            };
+
+            if (pulse.sweepReload[i])
+            {
+                if (pulse.sweepEnabled[i] && pulse.sweepValue[i] == 0)
+                    sweep();
+                pulse.sweepValue[i] = pulse.sweepPeriod[i];
+                pulse.sweepReload[i] = 0;
+            }
+            else if (pulse.sweepValue[i] > 0)
+            {
+                pulse.sweepValue[i]--;
+            }
+            else
+            {
+                if (pulse.sweepEnabled[i])
+                    sweep();
+                pulse.sweepValue[i] = pulse.sweepPeriod[i];
+            }
+        }
+    }
+}
+
+u8 BatchAPU::pulseOut(const Pulse &pulse, u32 i) const {
+    if (!pulse.enabled[i] || pulse.length[i] == 0 || dutyTable[pulse.dutyMode[i]][pulse.duty[i]] == 0
+        || pulse.timerPeriod[i] < 8 || pulse.timerPeriod[i] > 0x7ff)
+        return 0;
+
+    return u8(pulse.envelope.enabled[i] ? pulse.envelope.volume[i] : pulse.envelope.constantVolume[i]);
+}
+
+u8 BatchAPU::triangleOut(u32 i) const {
+    if (!triangle.enabled[i] || triangle.length[i] == 0 || triangle.counter[i] == 0)
+        return 0;
+
+    return triangleTable[triangle.duty[i]];
+}
+
+u8 BatchAPU::noiseOut(u32 i) const {
+    if (!noise.enabled[i] || noise.length[i] == 0 || (noise.shift[i] & 1) == 1)
+        return 0;
+
+    return u8(noise.envelope.enabled[i] ? noise.envelope.volume[i] : noise.envelope.constantVolume[i]);
+}
+
+void BatchAPU::mix(i16 *levels) const {
+#ifdef NES_SSE2
+    if (vectorized)
+    {
+        // channel outputs are all compares and selects, only the mixer tables are looked up one lane at a time
+        for (u32 g = 0; g < lanes; g += 4)
+        {
+            auto load = [g](const Lanes& lanes) { return _mm_loadu_si128((const __m128i*)&lanes[g]); };
+            auto select = [](__m128i mask, __m128i a, __m128i b) { return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b)); };
+            auto isZero = [](__m128i value) { return _mm_cmpeq_epi32(value, _mm_setzero_si128()); };
+            auto volume = [&](const Envelope& envelope) {
+                return select(isZero(load(envelope.enabled)), load(envelope.constantVolume), load(envelope.volume));
+            };
+
+            auto pulse = [&](const Pulse& pulse) {
+                // the duty patterns are a run of ones from step 1, the last one inverted
+                const __m128i mode = load(pulse.dutyMode), duty = load(pulse.duty), period = load(pulse.timerPeriod);
+                const __m128i end = _mm_add_epi32(_mm_set1_epi32(1), _mm_sub_epi32(_mm_and_si128(_mm_cmpgt_epi32(mode, _mm_setzero_si128()), _mm_set1_epi32(1)),
+                                                                                   _mm_and_si128(_mm_cmpeq_epi32(mode, _mm_set1_epi32(2)), _mm_set1_epi32(-2))));
+                const __m128i high = _mm_xor_si128(_mm_andnot_si128(_mm_or_si128(isZero(duty), _mm_cmpgt_epi32(duty, end)), _mm_set1_epi32(-1)),
+                                                   _mm_cmpeq_epi32(mode, _mm_set1_epi32(3)));
+                const __m128i silent = _mm_or_si128(_mm_or_si128(isZero(load(pulse.enabled)), isZero(load(pulse.length))),
+                                                    _mm_or_si128(_mm_cmplt_epi32(period, _mm_set1_epi32(8)), _mm_cmpgt_epi32(period, _mm_set1_epi32(0x7ff))));
+                return _mm_andnot_si128(silent, _mm_and_si128(high, volume(pulse.envelope)));
+            };
+
+            // counts 15 down to 0, then 0 up to 15
+            const __m128i duty = load(triangle.duty);
+            const __m128i triangleLevel = _mm_xor_si128(_mm_and_si128(duty, _mm_set1_epi32(15)),
+                                                        _mm_and_si128(_mm_cmplt_epi32(duty, _mm_set1_epi32(16)), _mm_set1_epi32(15)));
+            const __m128i triangleSilent = _mm_or_si128(isZero(load(triangle.enabled)),
+                                                        _mm_or_si128(isZero(load(triangle.length)), isZero(load(triangle.counter))));
+
+            const __m128i noiseSilent = _mm_or_si128(_mm_or_si128(isZero(load(noise.enabled)), isZero(load(noise.length))),
+                                                     _mm_cmpeq_epi32(_mm_and_si128(load(noise.shift), _mm_set1_epi32(1)), _mm_set1_epi32(1)));
+
+            const __m128i pulseIndex = _mm_add_epi32(pulse(pulses[0]), pulse(pulses[1]));
+            const __m128i triangleOut = _mm_andnot_si128(triangleSilent, triangleLevel);
+            const __m128i noiseOut = _mm_andnot_si128(noiseSilent, volume(noise.envelope));
+            const __m128i tndIndex = _mm_add_epi32(_mm_add_epi32(_mm_add_epi32(triangleOut, triangleOut), triangleOut),
+                                                   _mm_add_epi32(_mm_add_epi32(noiseOut, noiseOut), load(dmcLevel)));
+
+            i32 pulseIndices[4], tndIndices[4];
+            _mm_storeu_si128((__m128i*)pulseIndices, pulseIndex);
+            _mm_storeu_si128((__m128i*)tndIndices, tndIndex);
+
+            for (u32 i = g; i < std::min(g + 4, instances); ++i)
+                levels[i] = i16(pulseMixTable[pulseIndices[i - g]] + tndMixTable[tndIndices[i - g]]);
+        }
+        return;
+    }
+#endif
+
+    for (u32 i = 0; i < instances; ++i)
+        levels[i] = i16(pulseMixTable[pulseOut(pulses[0], i) + pulseOut(pulses[1], i)]
+                        + tndMixTable[3 * triangleOut(i) + 2 * noiseOut(i) + dmcLevel[i]]);
+}
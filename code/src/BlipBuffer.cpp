@@ -0,0 +1,106 @@
+#include "BlipBuffer.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+BlipBuffer::BlipBuffer(double clockRate, double sampleRate, u32 capacity) {
+    this->capacity = capacity;
+    setRates(clockRate, sampleRate);
+    buffer.resize(capacity + taps, 0);
+
+    buildKernels();
+}
+
+void BlipBuffer::setRates(double clockRate, double sampleRate) {
+    factor = u64(std::llround(sampleRate / clockRate * double(u64(1) << timeBits)));
+}
+
+void BlipBuffer::buildKernels() {
+    // cut off a little under Nyquist, the window's transition band does the rest
+    constexpr double cutoff = 0.45;
+
+    for (u8 phase = 0; phase < phases; ++phase)
+    {
+        std::array<double, taps> kernel{};
+        double sum = 0;
+
+        for (u8 k = 0; k < taps; ++k)
+        {
+            // the step lands between taps taps/2 - 1 and taps/2
+            const double t = k - (taps / 2 - 1) - double(phase) / phases;
+            const double x = 2 * cutoff * t;
+            const double sinc = x == 0 ? 1 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+            // Blackman over the whole kernel width
+            const double w = (t + taps / 2) / taps;
+            const double window = 0.42 - 0.5 * std::cos(2 * std::numbers::pi * w) + 0.08 * std::cos(4 * std::numbers::pi * w);
+
+            kernel[k] = sinc * std::max(window, 0.0);
+            sum += kernel[k];
+        }
+
+        i32 total = 0;
+        for (u8 k = 0; k < taps; ++k)
+        {
+            kernels[phase][k] = i32(std::lround(kernel[k] / sum * (1 << kernelBits)));
+            total += kernels[phase][k];
+        }
+
+        // rounding leftovers go to the centre so every phase integrates to exactly one
+        kernels[phase][taps / 2 - 1] += (1 << kernelBits) - total;
+    }
+}
+
+void BlipBuffer::addDelta(u64 time, i32 delta) {
+    const u64 position = offset + time * factor;
+    const u64 index = position >> timeBits;
+    const u8 phase = (position >> (timeBits - phaseBits)) & (phases - 1);
+
+    // a frame longer than the buffer, dropping beats writing past it
+    if (index >= capacity)
+        return;
+
+    i64* out = &buffer[index];
+    const auto& kernel = kernels[phase];
+    for (u8 k = 0; k < taps; ++k)
+        out[k] += i64(delta) * kernel[k];
+
+    used = std::max(used, u32(index) + taps);
+}
+
+void BlipBuffer::endFrame(u64 time) {
+    offset += time * factor;
+
+    if ((offset >> timeBits) > capacity)
+        offset = u64(capacity) << timeBits;
+}
+
+u32 BlipBuffer::available() const {
+    return u32(offset >> timeBits);
+}
+
+u32 BlipBuffer::read(i16 *dst, u32 count) {
+    count = std::min(count, available());
+
+    for (u32 i = 0; i < count; ++i)
+    {
+        integrator += buffer[i];
+        dst[i] = i16(std::clamp<i64>(integrator >> kernelBits, -32768, 32767));
+    }
+
+    // what is left, including the tails of steps near the end, moves to the front
+    const u32 end = std::max(used, count);
+    std::move(buffer.begin() + count, buffer.begin() + end, buffer.begin());
+    std::fill(buffer.begin() + (end - count), buffer.begin() + end, 0);
+    used = end - count;
+    offset -= u64(count) << timeBits;
+
+    return count;
+}
+
+void BlipBuffer::clear() {
+    offset = 0;
+    used = 0;
+    integrator = 0;
+    std::fill(buffer.begin(), buffer.end(), 0);
+}
@@ -4,20 +4,17 @@
 
 #include "CPU.h"
 #include <iostream>
+#include <mutex>
 
 #include "Opcodes.h"
 #include "PPU.h"
 #include "Utils.h"
 #include "LogMessages.h"
 
-bool CPU::executeNMI = false;
-u16 CPU::OMDDMAAddress = 0;
-bool CPU::executeDMA = false;
-bool CPU::executeIRQ = false;
-
 void CPU::init() {
-
-    initOpcodes();
+    // the table is shared, CPUs may be set up on several threads at once
+    static std::once_flag opcodesReady;
+    std::call_once(opcodesReady, initOpcodes);
 
     regs = new Registers;
     mem = new Memory(ramSize);
@@ -46,16 +43,24 @@ void CPU::cleanup() {
 }
 
 void CPU::execute(Instruction instruction) {
-    if(executeNMI) {
+    CPULines& lines = mem->cpuLines;
+
+    if(lines.stall > 0) {
+        cycle += nes_cpu_cycle_t(lines.stall);
+        lines.stall = 0;
+    }
+    else if(lines.nmi) {
         pushAddress(regs->PC);
         pushByte(regs->P);
         cycle += nes_cpu_cycle_t(7);
         regs->PC = mem->read(0xFFFA) | (mem->read(0xFFFB) << 8); // jump to NMI address
 
-        executeNMI = false;
+        lines.nmi = false;
     }
-    else if(executeDMA) {
-        PPU::setOAMDMA(OMDDMAAddress);
+    else if(lines.dma) {
+        // no PPU when only the sound is emulated
+        if (mem->oamDMA)
+            mem->oamDMA(lines.dmaAddress);
 
         // http://wiki.nesdev.com/w/index.php/PPU_registers#OAMDMA
         if (cycle % 2 == nes_cpu_cycle_t(0))
@@ -63,18 +68,18 @@ void CPU::execute(Instruction instruction) {
         else
             cycle += nes_cpu_cycle_t(513);
 
-        executeDMA = false;
+        lines.dma = false;
     }
-    else if(executeIRQ) {
-        if(!regs->getStatus(InterruptDisable)) {
-            pushAddress(regs->PC);
-            pushByte(regs->P);
-            cycle += nes_cpu_cycle_t(7);
-            regs->PC = mem->read(0xFFFE) | (mem->read(0xFFFF) << 8); // jump to IRQ address
-            regs->clearStatus(InterruptDisable);
-        }
+    // a masked IRQ stays pending until CLI or until the APU is acknowledged
+    else if(lines.irq && !regs->getStatus(InterruptDisable)) {
+        pushAddress(regs->PC);
+        pushByte(regs->P);
+        cycle += nes_cpu_cycle_t(7);
+        regs->PC = mem->read(0xFFFE) | (mem->read(0xFFFF) << 8); // jump to IRQ address
+        // masked until RTI, the handler acknowledges the APU before the line is looked at again
+        regs->setStatus(InterruptDisable);
 
-        executeIRQ = false;
+        lines.irq = false;
     }
     else {
         if(instruction.cycles < 0) {
@@ -254,16 +259,3 @@ void CPU::step(nes_cycle_t new_count) {
 nes_cycle_t CPU::getCycle() const {
     return cycle;
 }
-
-void CPU::setNMI() {
-    executeNMI = true;
-}
-
-void CPU::setDMA(uint16_t omddmaAddress) {
-    executeDMA = true;
-    OMDDMAAddress = omddmaAddress;
-}
-
-void CPU::setIRQ() {
-    executeIRQ = true;
-}
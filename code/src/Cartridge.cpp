@@ -47,6 +47,7 @@ bool Cartridge::load() {
     nesFile->mapper = (header.flag6 >> 4) | (header.flag7 & 0xF0);
 
     nesFile->mirroring = header.flag6 & Bit0;
+    nesFile->four_screen = header.flag6 & Bit3;
 
     if (nesFile->has_trainer) {
         file.seekg(512, std::ios::cur);
@@ -90,13 +91,15 @@ void Cartridge::loadToMemory(Memory* mem) {
 
 void Cartridge::loadToVRam(PPU *ppu) const {
     ppu->setMirroring(getMirroring());
-    ppu->writeVram(0x0, nesFile->chr_rom.data(), nesFile->chr_rom.size());
+    ppu->loadChr(nesFile->chr_rom.data(), nesFile->chr_rom.size());
 }
 
 nes_mapper_flags Cartridge::getMirroring() const {
     nes_mapper_flags flags = nes_mapper_flags_none;
 
-    if(nesFile->mirroring)
+    if(nesFile->four_screen)
+        flags = nes_mapper_flags(flags | nes_mapper_flags_four_screen_mirroring);
+    else if(nesFile->mirroring)
         flags = nes_mapper_flags(flags | nes_mapper_flags_vertical_mirroring);
     else
         flags = nes_mapper_flags(flags | nes_mapper_flags_horizontal_mirroring);
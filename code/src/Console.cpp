@@ -0,0 +1,185 @@
+#include "Console.h"
+
+#include "APU.h"
+#include "Cartridge.h"
+#include "Controller.h"
+#include "PPU.h"
+#include "ThreadedPPU.h"
+
+Console::Console() {
+    cpu.init();
+
+    // there from the start, so audio and input can be set up before a cartridge is in
+    Memory* memory = cpu.getMemory();
+    apu = std::make_unique<APU>(memory);
+    controllers[0] = std::make_unique<Controller>(memory, input::p1);
+    controllers[1] = std::make_unique<Controller>(memory, input::p2);
+}
+
+Console::~Console() {
+    // the memory's hooks point into these, the memory itself goes last
+    for (auto& controller : controllers)
+        controller.reset();
+    apu.reset();
+    ppu.reset();
+    threadedPPU.reset();
+    cartridge.reset();
+    cpu.cleanup();
+}
+
+bool Console::load(const std::string &path) {
+    // the memory keeps whatever the first attempt put in it, another ROM needs another console
+    if (cartridge)
+        return false;
+
+    romPath = path;
+    cartridge = std::make_unique<Cartridge>(romPath.c_str());
+    if (!cartridge->load())
+        return false;
+
+    Memory* memory = cpu.getMemory();
+    cartridge->loadToMemory(memory);
+    cpu.reset();
+
+    if (threaded)
+        threadedPPU = std::make_unique<ThreadedPPU>(memory);
+    else
+        ppu = std::make_unique<PPU>(memory);
+
+    PPU* target = optionsPPU();
+    target->setSpriteEvaluation(spriteEvaluation);
+    target->setFrameSkip(frameSkip);
+    target->setBackgroundCache(backgroundCache);
+    cartridge->loadToVRam(target);
+
+    firstFrame = ppuFrameCount();
+    return true;
+}
+
+bool Console::runFrame(nes_cycle_t until) {
+    if (!isLoaded())
+        return false;
+
+    const u32 frame = ppuFrameCount();
+
+    while (master_cycle < until)
+    {
+        master_cycle += nes_cycle_t(1);
+        cpu.step(master_cycle);
+        stepPPU(master_cycle);
+        apu->step(master_cycle);
+
+        if (ppuFrameCount() != frame)
+            return true;
+    }
+
+    return false;
+}
+
+void Console::run(nes_cycle_t cycles) {
+    if (!isLoaded())
+        return;
+
+    const nes_cycle_t end = master_cycle + cycles;
+
+    while (master_cycle < end)
+    {
+        master_cycle += nes_cycle_t(1);
+        cpu.step(master_cycle);
+        stepPPU(master_cycle);
+        apu->step(master_cycle);
+    }
+}
+
+bool Console::setThreadedPPU(bool threaded) {
+    if (isLoaded())
+        return false;
+
+    this->threaded = threaded;
+    return true;
+}
+
+void Console::setSpriteEvaluation(ppu::SpriteEvaluation mode) {
+    spriteEvaluation = mode;
+    if (PPU* target = optionsPPU())
+        target->setSpriteEvaluation(mode);
+}
+
+void Console::setFrameSkip(u8 skip) {
+    frameSkip = skip;
+    if (PPU* target = optionsPPU())
+        target->setFrameSkip(skip);
+}
+
+void Console::setBackgroundCache(bool enabled) {
+    backgroundCache = enabled;
+    if (PPU* target = optionsPPU())
+        target->setBackgroundCache(enabled);
+}
+
+void Console::setInput(u8 player, u8 buttons) {
+    controllers[player & 1]->setButtonState(buttons);
+}
+
+void Console::setInputSource(u8 player, std::function<u8()> source) {
+    controllers[player & 1]->setInputSource(std::move(source));
+}
+
+const IndexedFrame & Console::frame() {
+    if (!isLoaded())
+        return lastFrame;
+
+    if (!lastFrameValid || lastFrameCount != ppuFrameCount())
+    {
+        if (threadedPPU)
+            threadedPPU->getIndexedFrame(lastFrame);
+        else
+            ppu->getIndexedFrame(lastFrame);
+        lastFrameCount = ppuFrameCount();
+        lastFrameValid = true;
+    }
+
+    return lastFrame;
+}
+
+bool Console::isLoaded() const {
+    return ppu != null || threadedPPU != null;
+}
+
+APU & Console::audio() {
+    return *apu;
+}
+
+Registers * Console::getRegisters() const {
+    return cpu.getRegisters();
+}
+
+u32 Console::getFrameCount() const {
+    if (!isLoaded())
+        return 0;
+
+    return ppuFrameCount() - firstFrame;
+}
+
+nes_cycle_t Console::getCycle() const {
+    return master_cycle;
+}
+
+void Console::stepPPU(nes_cycle_t cycle) {
+    if (threadedPPU)
+        threadedPPU->step(cycle);
+    else
+        ppu->step(cycle);
+}
+
+u32 Console::ppuFrameCount() const {
+    return threadedPPU ? threadedPPU->getFrameCount() : ppu->getFrameCount();
+}
+
+PPU * Console::optionsPPU() {
+    if (!threadedPPU)
+        return ppu.get();
+
+    threadedPPU->sync();
+    return threadedPPU->getPPU();
+}
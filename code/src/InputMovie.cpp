@@ -0,0 +1,53 @@
+#include "InputMovie.h"
+
+#include <fstream>
+
+#include "Logger.h"
+#include "LogMessages.h"
+
+bool InputMovie::load(const std::string &path) {
+    std::ifstream file(path);
+    if (!file) {
+        ERRORLOG(error::cantOpenFile);
+        return false;
+    }
+
+    frames.clear();
+
+    std::string line;
+    while (std::getline(file, line))
+    {
+        if (line.empty() || line[0] != '|')
+            continue;
+
+        std::array<u8, 2> buttons{};
+        // fields after the commands, the characters go right, left, down, up, start, select, B, A
+        size_t field = line.find('|', 1);
+        for (u8 player = 0; player < 2 && field != std::string::npos; ++player)
+        {
+            const size_t end = line.find('|', field + 1);
+            const std::string pad = line.substr(field + 1, end == std::string::npos ? std::string::npos : end - field - 1);
+
+            for (u8 i = 0; i < 8 && i < pad.size(); ++i)
+                if (pad[i] != '.' && pad[i] != ' ')
+                    buttons[player] |= 1 << i;
+
+            field = end;
+        }
+
+        frames.push_back(buttons);
+    }
+
+    return true;
+}
+
+u32 InputMovie::getFrameCount() const {
+    return u32(frames.size());
+}
+
+u8 InputMovie::getButtons(u32 frame, u8 player) const {
+    if (frame >= frames.size() || player > 1)
+        return 0;
+
+    return frames[frame][player];
+}
@@ -5,6 +5,8 @@
 #include "Memory.h"
 
 #include <cassert>
+#include <cstring>
+#include <iomanip>
 
 #include "Logger.h"
 #include "LogMessages.h"
@@ -90,8 +92,13 @@ void Memory::write(u16 startAddr, u8 *dataStart, u32 amount) {
 
 void Memory::get_bytes(uint8_t *dest, uint16_t dest_size, uint16_t src_addr, size_t src_size) {
     assert(src_addr + src_size <= maxSize);
+    if (src_size > dest_size) {
+        ERRORLOG(error::memoryOutOfBounds);
+        return;
+    }
+
     redirect_addr(src_addr);
-    memcpy_s(dest, dest_size, &data[0] + src_addr, src_size);
+    std::memcpy(dest, &data[0] + src_addr, src_size);
 }
 
 void Memory::redirect_addr(uint16_t &addr) const
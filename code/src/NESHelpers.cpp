@@ -189,8 +189,9 @@ void ppu::Registers::writePPUData(uint8_t val, PPU *ppu) {
     V += ppuAddressIncValue();
 }
 
-void ppu::Registers::writeOAMDMA(uint8_t val) {
-    CPU::setDMA((uint16_t(val) << 8));
+void ppu::Registers::writeOAMDMA(uint8_t val, Memory* memory) {
+    memory->cpuLines.dma = true;
+    memory->cpuLines.dmaAddress = uint16_t(val) << 8;
 }
 
 uint8_t ppu::Registers::readPPUSTATUS() {
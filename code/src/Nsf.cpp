@@ -0,0 +1,211 @@
+#include "Nsf.h"
+
+#include <algorithm>
+#include <cstring>
+#include <fstream>
+
+#include "APU.h"
+#include "AudioRecorder.h"
+#include "Logger.h"
+#include "LogMessages.h"
+#include "Opcodes.h"
+
+namespace {
+    constexpr const char* NSF = "NESM\x1A";
+    constexpr u16 headerSize = 0x80;
+
+    u16 readU16(const u8* bytes) {
+        return bytes[0] | (u16(bytes[1]) << 8);
+    }
+
+    std::string readText(const u8* bytes) {
+        return std::string(reinterpret_cast<const char*>(bytes), strnlen(reinterpret_cast<const char*>(bytes), 32));
+    }
+}
+
+bool Nsf::load(const std::string &path) {
+    std::ifstream file;
+    file.open(path, std::ifstream::in | std::ifstream::binary);
+    if (!file) {
+        ERRORLOG(error::cantOpenFile);
+        return false;
+    }
+
+    u8 header[headerSize];
+    file.read(reinterpret_cast<char*>(header), headerSize);
+
+    if (file.gcount() != headerSize || strncmp(reinterpret_cast<const char*>(header), NSF, 5) != 0) {
+        ERRORLOG(error::unsupportedFileFormat);
+        return false;
+    }
+
+    tracks = header[0x06];
+    startingTrack = header[0x07] > 0 ? header[0x07] - 1 : 0;
+    loadAddress = readU16(header + 0x08);
+    initAddress = readU16(header + 0x0A);
+    playAddress = readU16(header + 0x0C);
+    name = readText(header + 0x0E);
+    artist = readText(header + 0x2E);
+    playPeriod = readU16(header + 0x6E);
+
+    std::copy_n(header + 0x70, 8, initialBanks.begin());
+    bankSwitched = std::any_of(initialBanks.begin(), initialBanks.end(), [](u8 bank) { return bank != 0; });
+
+    data.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+
+    // banks are counted from the 4KB boundary below the load address
+    if (bankSwitched)
+        data.insert(data.begin(), loadAddress & 0x0FFF, 0);
+
+    // most rips use the NTSC rate, a missing one means the same
+    if (playPeriod == 0)
+        playPeriod = 16639;
+
+    return true;
+}
+
+u8 Nsf::getTrackCount() const {
+    return tracks;
+}
+
+u8 Nsf::getStartingTrack() const {
+    return startingTrack;
+}
+
+const std::string & Nsf::getName() const {
+    return name;
+}
+
+const std::string & Nsf::getArtist() const {
+    return artist;
+}
+
+NsfPlayer::NsfPlayer(const Nsf &nsf) : nsf(nsf) {
+    cpu.init();
+    apu = std::make_unique<APU>(cpu.getMemory());
+    // nothing plays the samples, the file gets exactly audioFrequency
+    apu->setRateControl(false);
+
+    if (nsf.bankSwitched)
+    {
+        cpu.getMemory()->beforeWrite.push_back([this](u16 addr, u8 val) -> bool {
+            if (addr >= 0x5FF8 && addr <= 0x5FFF)
+                switchBank(addr - 0x5FF8, val);
+
+            return true;
+        });
+    }
+}
+
+NsfPlayer::~NsfPlayer() {
+    apu.reset();
+    cpu.cleanup();
+}
+
+nes_cycle_t NsfPlayer::now() const {
+    return cpu.getCycle() + idle;
+}
+
+void NsfPlayer::switchBank(u8 slot, u8 bank) {
+    const size_t offset = size_t(bank) * 0x1000;
+    std::array<u8, 0x1000> content{};
+
+    if (offset < nsf.data.size())
+        std::copy_n(nsf.data.begin() + offset, std::min<size_t>(0x1000, nsf.data.size() - offset), content.begin());
+
+    cpu.getMemory()->write(0x8000 + slot * 0x1000, content.data(), u32(content.size()));
+}
+
+void NsfPlayer::reset(u8 track) {
+    Memory* memory = cpu.getMemory();
+
+    // https://www.nesdev.org/wiki/NSF#Initializing_a_tune
+    for (u16 addr = 0; addr < 0x0800; ++addr)
+        memory->write(addr, 0);
+    for (u16 addr = 0x6000; addr < 0x8000; ++addr)
+        memory->write(addr, 0);
+
+    for (u16 addr = 0x4000; addr <= 0x4013; ++addr)
+        memory->write(addr, 0);
+    memory->write(0x4015, 0x00);
+    memory->write(0x4015, 0x0F);
+    memory->write(0x4017, 0x40);
+
+    if (nsf.bankSwitched)
+    {
+        for (u8 slot = 0; slot < 8; ++slot)
+            switchBank(slot, nsf.initialBanks[slot]);
+    }
+    else
+    {
+        const u32 size = u32(std::min<size_t>(nsf.data.size(), 0x10000 - nsf.loadAddress));
+        memory->write(nsf.loadAddress, const_cast<u8*>(nsf.data.data()), size);
+    }
+
+    Registers* regs = cpu.getRegisters();
+    regs->A = track;
+    regs->X = 0; // NTSC
+    regs->Y = 0;
+    regs->S = 0xFD;
+}
+
+bool NsfPlayer::call(u16 address, nes_cycle_t deadline) {
+    Registers* regs = cpu.getRegisters();
+    Memory* memory = cpu.getMemory();
+
+    // as if JSR'd from right before returnAddress
+    const u16 caller = returnAddress - 1;
+    memory->write(0x0100 + regs->S--, caller >> 8);
+    memory->write(0x0100 + regs->S--, caller & 0xFF);
+    regs->PC = address;
+
+    while (regs->PC != returnAddress)
+    {
+        if (now() >= deadline)
+            return false;
+
+        cpu.execute(cpu.getInstruction());
+        apu->step(now());
+    }
+
+    return true;
+}
+
+void NsfPlayer::wait(nes_cycle_t until) {
+    // in slices, the APU flushes its samples every few milliseconds of its own time
+    while (now() < until)
+    {
+        idle += std::min(until - now(), nes_cycle_t(NES_CLOCK_HZ / 240));
+        apu->step(now());
+    }
+}
+
+bool NsfPlayer::render(u8 track, double seconds, AudioRecorder *recorder) {
+    reset(track);
+    apu->setRecorder(recorder);
+
+    bool finished = call(nsf.initAddress, now() + nes_cycle_t(NES_CLOCK_HZ));
+    if (!finished)
+        WARNLOG("NSF track " + std::to_string(track + 1) + ": INIT didn't return");
+
+    const nes_cycle_t end = now() + nes_cycle_t(i64(seconds * NES_CLOCK_HZ));
+    const nes_cycle_t period = nes_cycle_t(i64(nsf.playPeriod) * NES_CLOCK_HZ / 1000000);
+    nes_cycle_t nextPlay = now();
+
+    while (finished && nextPlay < end)
+    {
+        // the driver waits for the timer, the APU plays on meanwhile
+        wait(nextPlay);
+
+        finished = call(nsf.playAddress, std::min(nextPlay + nes_cycle_t(NES_CLOCK_HZ), end));
+        if (!finished && now() < end)
+            WARNLOG("NSF track " + std::to_string(track + 1) + ": PLAY didn't return");
+
+        nextPlay += period;
+    }
+
+    wait(end);
+
+    apu->setRecorder(null);
+    return finished || now() >= end;
+}
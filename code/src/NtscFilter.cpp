@@ -0,0 +1,164 @@
+#include "NtscFilter.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <numbers>
+
+#include "Simd.h"
+#include "WorkerPool.h"
+
+NtscFilter::NtscFilter(WorkerPool *pool) {
+    this->pool = pool;
+    buildKernels();
+
+    // the decoded signal is meant for a 2.2 gamma display, monitors expect 1.8 worth of correction
+    for (u16 i = 0; i < gammaSize; ++i)
+        gamma[i] = u8(std::lround(255.0 * std::pow(double(i) / (gammaSize - 1), 2.2 / 1.8)));
+}
+
+void NtscFilter::buildKernels() {
+    // https://www.nesdev.org/wiki/NTSC_video#Emulating_in_C++_code
+    constexpr float levels[8] = {0.350f, 0.518f, 0.962f, 1.550f, 1.094f, 1.506f, 1.962f, 1.962f};
+    constexpr float black = 0.518f;
+    constexpr float white = 1.962f;
+    constexpr float attenuation = 0.746f;
+    // lines the decoded hues up with the usual palettes
+    constexpr float hue = 3.9f;
+
+    kernels.assign(512 * phases * kernelWidth * 4, 0.0f);
+
+    for (u16 pixel = 0; pixel < 512; ++pixel)
+    {
+        const u8 color = pixel & 0x0f;
+        const u8 emphasis = pixel >> 6;
+        u8 level = (pixel >> 4) & 0x3;
+
+        if (color > 13)
+            level = 1;
+
+        float low = levels[level];
+        float high = levels[4 + level];
+        if (color == 0)
+            low = high;
+        if (color > 12)
+            high = low;
+
+        for (u8 phase = 0; phase < phases; ++phase)
+        {
+            // 8 samples per pixel, 12 per subcarrier cycle, so pixels start 4 samples apart in phase
+            float signal[8];
+            for (u8 n = 0; n < 8; ++n)
+            {
+                const u8 samplePhase = phase * 4 + n;
+                auto inColorPhase = [&](u8 c) { return (c + samplePhase) % 12 < 6; };
+
+                float value = inColorPhase(color) ? high : low;
+                if (((emphasis & 1) && inColorPhase(0))
+                    || ((emphasis & 2) && inColorPhase(4))
+                    || ((emphasis & 4) && inColorPhase(8)))
+                    value *= attenuation;
+
+                signal[n] = (value - black) / (white - black);
+            }
+
+            float* kernel = &kernels[(pixel * phases + phase) * kernelWidth * 4];
+
+            for (u8 k = 0; k < kernelWidth; ++k)
+            {
+                // output pixels cover 4 samples each
+                const int center = (kernelStart + k) * 4 + 2;
+                float y = 0, i = 0, q = 0;
+
+                for (u8 n = 0; n < 8; ++n)
+                {
+                    const int distance = n - center;
+
+                    // one subcarrier cycle of luma cancels the chroma out
+                    if (distance >= -6 && distance < 6)
+                        y += signal[n] / 12;
+
+                    // chroma is narrower band, a triangle over two cycles
+                    if (std::abs(distance) < 12)
+                    {
+                        const float weight = (12 - std::abs(distance)) / 144.0f;
+                        const float angle = std::numbers::pi_v<float> * (phase * 4 + n + hue) / 6;
+                        i += signal[n] * weight * std::cos(angle);
+                        q += signal[n] * weight * std::sin(angle);
+                    }
+                }
+
+                // FCC YIQ to RGB
+                kernel[k * 4 + 0] = y + 0.946882f * i + 0.623557f * q;
+                kernel[k * 4 + 1] = y - 0.274788f * i - 0.635691f * q;
+                kernel[k * 4 + 2] = y - 1.108545f * i + 1.709007f * q;
+            }
+        }
+    }
+}
+
+void NtscFilter::filter(const u8 *indices, const u8 *emphasis, u16 width, u16 height, u32 frame, u32 *dst, u32 dstPitch) {
+    if (!pool)
+    {
+        filterRows(indices, emphasis, width, frame, dst, dstPitch, 0, height);
+        return;
+    }
+
+    pool->runSlices(height, [&](u32 first, u32 last) {
+        filterRows(indices, emphasis, width, frame, dst, dstPitch, first, last);
+    });
+}
+
+void NtscFilter::filterRows(const u8 *indices, const u8 *emphasis, u16 width, u32 frame, u32 *dst, u32 dstPitch,
+                            u16 y0, u16 y1) const {
+    const u32 outWidth = width * factor;
+    std::vector<float> line((outWidth + kernelWidth) * 4);
+
+    for (u16 y = y0; y < y1; ++y)
+    {
+        std::fill(line.begin(), line.end(), 0.0f);
+
+        const u8* row = indices + y * width;
+        const u16 colorEmphasis = (emphasis[y] & 0x7) << 6;
+        // each line starts 4 samples further, odd frames one more step (the skipped dot)
+        u8 phase = (y + (frame & 1)) % phases;
+
+        for (u16 x = 0; x < width; ++x)
+        {
+            const u16 pixel = (row[x] & 0x3f) | colorEmphasis;
+            const float* kernel = &kernels[(pixel * phases + phase) * kernelWidth * 4];
+            // line is shifted by -kernelStart, so the kernel's first output lands on index 2x
+            float* out = &line[x * factor * 4];
+
+#ifdef NES_SSE2
+            for (u8 k = 0; k < kernelWidth; ++k)
+                _mm_storeu_ps(out + k * 4, _mm_add_ps(_mm_loadu_ps(out + k * 4), _mm_loadu_ps(kernel + k * 4)));
+#else
+            for (u8 k = 0; k < kernelWidth * 4; ++k)
+                out[k] += kernel[k];
+#endif
+
+            phase = (phase + 2) % phases;
+        }
+
+        u32* out0 = dst + y * factor * dstPitch;
+        const float* decoded = &line[-kernelStart * 4];
+
+        for (u32 x = 0; x < outWidth; ++x)
+        {
+            i32 rgb[4];
+#ifdef NES_SSE2
+            __m128i index = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_loadu_ps(decoded + x * 4), _mm_set1_ps(gammaSize - 1)),
+                                                                   _mm_setzero_ps()), _mm_set1_ps(gammaSize - 1)));
+            _mm_storeu_si128((__m128i*)rgb, index);
+#else
+            for (u8 c = 0; c < 3; ++c)
+                rgb[c] = i32(std::clamp(decoded[x * 4 + c] * (gammaSize - 1), 0.0f, float(gammaSize - 1)));
+#endif
+            out0[x] = (gamma[rgb[0]] << 24) | (gamma[rgb[1]] << 16) | (gamma[rgb[2]] << 8);
+        }
+
+        for (u8 i = 1; i < factor; ++i)
+            memcpy(out0 + i * dstPitch, out0, outWidth * sizeof(u32));
+    }
+}
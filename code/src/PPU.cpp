@@ -4,30 +4,17 @@
 
 #include "PPU.h"
 
+#include <bit>
+#include <algorithm>
 #include <cassert>
 #include <cstring>
 
 #include "Cartridge.h"
-#include "CPU.h"
+#include "Simd.h"
 
 #define PPU_SCANLINE_CYCLE nes_ppu_cycle_t(341)
 #define PPU_SCANLINE_COUNT 262
 
-std::function<void(u16)> PPU::setOAMDMA = nullptr;
-
-
-namespace ppu {
-    constexpr u16 PPUCTRLAddress = 0x2000;
-    constexpr u16 PPUMASKAddress = 0x2001;
-    constexpr u16 PPUSTATUSAddress = 0x2002;
-    constexpr u16 OAMADDRAddress = 0x2003;
-    constexpr u16 OAMDATAAddress = 0x2004;
-    constexpr u16 PPUSCROLLAddress = 0x2005;
-    constexpr u16 PPUADDRAddress = 0x2006;
-    constexpr u16 PPUDATAAddress = 0x2007;
-    constexpr u16 OAMDMAAddress = 0x4014;
-}
-
 bool isIOReg(u16 addr) {
     if ((addr & 0xfff8) == 0x2000)
         return true;
@@ -39,11 +26,11 @@ bool isIOReg(u16 addr) {
 
 using namespace ppu;
 
-PPU::PPU(Memory* shared) {
+PPU::PPU(Memory* shared, bool attachHooks) : backgroundCache(this) {
     this->sharedMemory = shared;
     init(sharedMemory);
 
-    setOAMDMA = std::function<void(u16)>([&](u16 address) {
+    sharedMemory->oamDMA = std::function<void(u16)>([this](u16 address) {
         if (*regs.OAMAddr == 0)
         {
             sharedMemory->get_bytes(regs.oam.data(), 0x100, address, 0x100);
@@ -56,64 +43,16 @@ PPU::PPU(Memory* shared) {
         }
     });
 
-    sharedMemory->beforeWrite.push_back([this](u16 addr, u8& val) -> bool {
-        switch (addr) {
-            case PPUCTRLAddress:
-                if(!is_ready()) return false;
-
-                regs.writePPUCTRL(val);
-                return false;
-            case PPUMASKAddress:
-                regs.writePPUMASK(val);
-                return false;
-            case OAMADDRAddress:
-                regs.writeOAMADDR(val);
-                return false;
-            case OAMDATAAddress:
-                regs.writeOAMDATA(val);
-                return false;
-            case PPUSCROLLAddress:
-                if(!is_ready()) return false;
-
-                regs.writePPUSCROLL(val);
-                return false;
-            case PPUADDRAddress:
-                regs.writePPUAADDR(val);
-                return false;
-            case PPUDATAAddress:
-                regs.writePPUData(val, this);
-                return false;
-            case OAMDMAAddress:
-                regs.writeOAMDMA(val);
-                return false;
-            default:
-                //do nothing
-                break;
-        }
-
-        if(isIOReg(addr) && addr != 0x4016 && addr != 4017) regs.writeLatch(val);
-
-        return true;
-    });
-
-    sharedMemory->beforeRead.push_back([this](u16 addr) -> std::optional<u8> {
-
-        switch (addr) {
-            case PPUSTATUSAddress:
-                return regs.readPPUSTATUS();
-            case OAMDATAAddress:
-                return regs.readOAMDATA();
-            case PPUDATAAddress:
-                return regs.readPPUDATA(this);
-            default:
-                //do nothing
-                break;
-        }
-
-        const bool returnLatchCondition = isIOReg(addr) && addr != input::p1 && addr != input::p2;
+    if (attachHooks)
+    {
+        sharedMemory->beforeWrite.push_back([this](u16 addr, u8& val) -> bool {
+            return writeRegister(addr, val);
+        });
 
-        return returnLatchCondition ? std::optional(regs.latch) : std::nullopt;
-    });
+        sharedMemory->beforeRead.push_back([this](u16 addr) -> std::optional<u8> {
+            return readRegister(addr);
+        });
+    }
 
     palette = {{
         {0x80, 0x80, 0x80}, {0x00, 0x3D, 0xA6}, {0x00, 0x12, 0xB0}, {0x44, 0x00, 0x96},
@@ -135,6 +74,75 @@ PPU::PPU(Memory* shared) {
     }};
 }
 
+bool PPU::writeRegister(u16 addr, u8& val) {
+    detectRasterEffect(addr, val);
+
+    switch (addr) {
+        case PPUCTRLAddress:
+            if(!is_ready()) return false;
+
+            regs.writePPUCTRL(val);
+            return false;
+        case PPUMASKAddress:
+            regs.writePPUMASK(val);
+            return false;
+        case OAMADDRAddress:
+            regs.writeOAMADDR(val);
+            return false;
+        case OAMDATAAddress:
+            regs.writeOAMDATA(val);
+            return false;
+        case PPUSCROLLAddress:
+            if(!is_ready()) return false;
+
+            regs.writePPUSCROLL(val);
+            return false;
+        case PPUADDRAddress:
+            regs.writePPUAADDR(val);
+            return false;
+        case PPUDATAAddress:
+            regs.writePPUData(val, this);
+            return false;
+        case OAMDMAAddress:
+            regs.writeOAMDMA(val, sharedMemory);
+            return false;
+        default:
+            //do nothing
+            break;
+    }
+
+    if(isIOReg(addr) && addr != 0x4016 && addr != 4017) regs.writeLatch(val);
+
+    return true;
+}
+
+std::optional<u8> PPU::readRegister(u16 addr) {
+    switch (addr) {
+        case PPUSTATUSAddress:
+            return regs.readPPUSTATUS();
+        case OAMDATAAddress:
+            return regs.readOAMDATA();
+        case PPUDATAAddress:
+            detectRasterEffect(addr, 0);
+            return regs.readPPUDATA(this);
+        default:
+            //do nothing
+            break;
+    }
+
+    const bool returnLatchCondition = isIOReg(addr) && addr != input::p1 && addr != input::p2 && addr != apu::APUSTATUSAddress;
+
+    return returnLatchCondition ? std::optional(regs.latch) : std::nullopt;
+}
+
+void PPU::writeOAMDMA(u8 offset, u8 value) {
+    regs.oam[u8(*regs.OAMAddr + offset)] = value;
+}
+
+void PPU::setRaiseNMI(bool raise) {
+    raiseNMI = raise;
+}
+
 void PPU::init(Memory* shared) {
     frameReady = false;
     scanline = 0;
@@ -153,15 +161,23 @@ void PPU::init(Memory* shared) {
     regs.PPUStatus = &shared->getReference(PPUSTATUSAddress);
     regs.OAMDMA = &shared->getReference(OAMDMAAddress);
 
-    entireFrameBuffer = frameBuffer1.data();
     frameBuffer1.resize(resolution.x * resolution.y);
     frameBuffer2.resize(resolution.x * resolution.y);
-    frameBufferBG.resize(resolution.x * resolution.y);
+    entireFrameBuffer = frameBuffer1.data();
+    emphasisBuffer1.resize(resolution.y);
+    emphasisBuffer2.resize(resolution.y);
+    entireEmphasisBuffer = emphasisBuffer1.data();
+    lineHashes1.resize(resolution.y);
+    lineHashes2.resize(resolution.y);
+    entireLineHashes = lineHashes1.data();
+    line = LineBuffer{};
 
     spriteBuffer.resize(8);
 
     regs.oam.resize(oamSize, 0);
-    vram.resize(vRamSize, 0);
+
+    loadChr(null, 0);
+    setMirroring(mirroring);
 
     _master_cycle = nes_cycle_t(0);
     _scanline_cycle = nes_ppu_cycle_t(0);
@@ -174,6 +190,31 @@ std::vector<u8> PPU::getFrameBuffer() const {
     return frameBuffer1;
 }
 
+std::vector<u8> PPU::getEmphasisBuffer() const {
+    if(entireEmphasisBuffer == emphasisBuffer1.data())
+        return emphasisBuffer2;
+
+    return emphasisBuffer1;
+}
+
+std::array<u64, stripeCount> PPU::getStripeHashes() const {
+    const std::vector<u64>& lines = entireLineHashes == lineHashes1.data() ? lineHashes2 : lineHashes1;
+    std::array<u64, stripeCount> stripes{};
+
+    for (u16 y = 0; y < resolution.y; ++y)
+        stripes[y / stripeHeight] = combineHash(stripes[y / stripeHeight], lines[y]);
+
+    return stripes;
+}
+
+u64 PPU::getFrameHash() const {
+    u64 hash = 0;
+    for (u64 stripe : getStripeHashes())
+        hash = combineHash(hash, stripe);
+
+    return hash;
+}
+
 std::vector<uint32_t> PPU::getFrame() const {
     std::vector<u32> frame;
     std::vector<u8> frameBuffer = getFrameBuffer();
@@ -189,27 +230,217 @@ std::vector<uint32_t> PPU::getFrame() const {
     return frame;
 }
 
+void PPU::getIndexedFrame(IndexedFrame &frame) const {
+    const bool first = entireFrameBuffer != frameBuffer1.data();
+    const std::vector<u8>& pixels = first ? frameBuffer1 : frameBuffer2;
+    const std::vector<u8>& emphasis = first ? emphasisBuffer1 : emphasisBuffer2;
+
+    frame.pixels.resize(pixels.size());
+    frame.emphasis = emphasis;
+    frame.number = frontFrame;
+    frame.stripes = getStripeHashes();
+    frame.hash = getFrameHash();
+
+    std::array<i8, 8> slots;
+    slots.fill(-1);
+    u8 used = 0;
+
+    for (u16 y = 0; y < resolution.y; ++y)
+    {
+        const u8 bits = emphasis[y] & 0x7;
+
+        if (slots[bits] < 0 && used == 4)
+            slots[bits] = 3;
+
+        if (slots[bits] < 0)
+        {
+            slots[bits] = used++;
+
+            // emphasised channels stay, the other two are attenuated
+            // https://www.nesdev.org/wiki/NTSC_video#Color_Tint_Bits
+            for (u8 i = 0; i < paletteSize; ++i)
+            {
+                Color c = palette[i];
+                if (bits)
+                {
+                    if (!(bits & Bit0)) c.r = u8(c.r * 0.816f);
+                    if (!(bits & Bit1)) c.g = u8(c.g * 0.816f);
+                    if (!(bits & Bit2)) c.b = u8(c.b * 0.816f);
+                }
+                frame.palette[slots[bits] * paletteSize + i] = c;
+            }
+        }
+
+        const u8 slot = slots[bits] << 6;
+        const u8* src = &pixels[y * resolution.x];
+        u8* dst = &frame.pixels[y * resolution.x];
+        for (u16 x = 0; x < resolution.x; ++x)
+            dst[x] = (src[x] & (paletteSize - 1)) | slot;
+    }
+}
+
+u8& PPU::vramByte(u16 addr) {
+    addr &= vRamSize - 1;
+
+    if (addr >= 0x3f00)
+        return paletteRam[paletteMirror[addr & 0x1f]];
+
+    return pages[addr / vRamPageSize][addr % vRamPageSize];
+}
+
+u32 PPU::getFrameCount() const {
+    return frameCount;
+}
+
+const std::array<Color, paletteSize>& PPU::getPalette() const {
+    return palette;
+}
+
 uint8_t PPU::readVram(uint16_t addr) {
-    redirectAddress(addr);
-    return vram[addr];
+    return vramByte(addr);
 }
 
 void PPU::writeVram(uint16_t addr, uint8_t value) {
-    redirectAddress(addr);
-    vram[addr] = value;
+    backgroundCache.invalidateVram(addr);
+    vramByte(addr) = value;
 }
 
 void PPU::writeVram(uint16_t addr, uint8_t *src, uint16_t src_size) {
-    redirectAddress(addr);
-    memcpy_s(vram.data() + addr, vRamSize - addr, src, src_size);
+    backgroundCache.invalidateAll();
+    for (u16 i = 0; i < src_size; ++i)
+        vramByte(addr + i) = src[i];
 }
 
-uint8_t *PPU::getVRam() {
-    return vram.data();
+void PPU::loadChr(const u8 *data, u32 size) {
+    if (size > 0)
+        chr.assign(data, data + size);
+    else
+        chr.assign(chrSize, 0);
+
+    if (chr.size() < chrSize)
+        chr.resize(chrSize, 0);
+
+    for (u8 page = 0; page < chrSize / vRamPageSize; ++page)
+        setChrPage(page, page);
+}
+
+void PPU::setChrPage(u8 page, u16 bank) {
+    bank %= chr.size() / vRamPageSize;
+
+    // lines already on screen keep the old tiles
+    if (scanline <= 239 && (regs.showBackground() || regs.showSprites()))
+        markRasterEffect();
+
+    pages[page & 0x7] = chr.data() + bank * vRamPageSize;
+    backgroundCache.invalidateAll();
 }
 
 void PPU::setMirroring(nes_mapper_flags flags) {
     mirroring = nes_mapper_flags(flags & nes_mapper_flags_mirroring_mask);
+
+    // https://www.nesdev.org/wiki/Mirroring#Nametable_Mirroring
+    std::array<u8, 4> layout;
+    switch (mirroring) {
+        case nes_mapper_flags_vertical_mirroring:
+            layout = {0, 1, 0, 1};
+            break;
+        case nes_mapper_flags_one_screen_lower_mirroring:
+            layout = {0, 0, 0, 0};
+            break;
+        case nes_mapper_flags_one_screen_upper_mirroring:
+            layout = {1, 1, 1, 1};
+            break;
+        case nes_mapper_flags_four_screen_mirroring:
+            layout = {0, 1, 2, 3};
+            break;
+        default:
+            layout = {0, 0, 1, 1};
+            break;
+    }
+
+    if (scanline <= 239 && (regs.showBackground() || regs.showSprites()))
+        markRasterEffect();
+
+    // $3000-$3eff mirrors $2000-$2eff
+    for (u8 i = 0; i < 8; ++i)
+        pages[0x2000 / vRamPageSize + i] = ciram.data() + layout[i & 0x3] * vRamPageSize;
+
+    backgroundCache.invalidateAll();
+}
+
+void PPU::setSpriteEvaluation(ppu::SpriteEvaluation mode) {
+    spriteEvaluation = mode;
+}
+
+u16 PPU::getScanline() const {
+    return scanline;
+}
+
+u16 PPU::getDot() const {
+    return _scanline_cycle.count();
+}
+
+u8 PPU::getSpriteFlags() const {
+    return (regs.getSprite0Hit() ? Bit6 : 0) | (regs.getSpriteOverflow() ? Bit5 : 0);
+}
+
+u8 PPU::getOpenBus() const {
+    return regs.latch;
+}
+
+i64 PPU::getSpriteFlagsSteadyUntil() const {
+    const i64 now = _master_cycle.count();
+    const i64 dot = _scanline_cycle.count();
+    // lines of this frame all have 341 dots, the odd frame's missing one is at the very end
+    auto lineStart = [&](int l) { return now - dot + i64(l - scanline) * 341; };
+
+    // sprite 0 hit is cleared on dot 1 of the pre-render line, after it nothing changes before the next
+    // frame's line 1 (a dot early, in case this frame is odd)
+    if (scanline == 261 && dot >= 1)
+        return lineStart(263) - 1;
+    const i64 preRender = lineStart(261) + 1;
+
+    // sprite lines evaluate (overflow is cleared on dot 0 and set by the evaluation) and compose (sprite 0
+    // hit) only with sprites shown
+    if (!regs.showSprites() || scanline > 239)
+        return preRender;
+
+    const u8 height = regs.use8x16Sprites() ? 16 : 8;
+    const bool hitPossible = !regs.getSprite0Hit() && regs.showBackground();
+
+    for (int l = std::max<int>(scanline, 1); l <= 239; ++l)
+    {
+        const bool current = l == scanline;
+        const u64 inRange = spritesInRange(regs.oam.data(), l, height);
+
+        const bool overflowChanges = regs.getSpriteOverflow() ? !current : std::popcount(inRange) > 8 && !(current && dot >= 257);
+        const bool hitChanges = hitPossible && (inRange & 1) && !(current && dot >= 320);
+
+        if (overflowChanges || hitChanges)
+            return std::max(lineStart(l), now + 1);
+    }
+
+    return preRender;
+}
+
+const std::vector<Sprite>& PPU::getSecondaryOAM() const {
+    return spriteBuffer;
+}
+
+void PPU::setFrameSkip(u8 skip) {
+    frameSkip = skip;
+}
+
+u8 PPU::getFrameSkip() const {
+    return frameSkip;
+}
+
+void PPU::setBackgroundCache(bool enabled) {
+    backgroundCacheEnabled = enabled;
+    cachedLine = false;
+    costlyFrames = 0;
+    cacheOffFrames = 0;
+    backgroundCache.invalidateAll();
 }
 
 void PPU::step(nes_cycle_t count) {
@@ -217,8 +448,14 @@ void PPU::step(nes_cycle_t count) {
         step_ppu(nes_ppu_cycle_t(1));
 
         if(scanline <= 239) {
+            if(_scanline_cycle == nes_ppu_cycle_t(321))
+                prepareCachedLine();
+
             tilesPipeline();
             spritesPipeline();
+
+            if(_scanline_cycle == nes_ppu_cycle_t(320))
+                composeLine();
         }
         else if(scanline == 240) {
 
@@ -227,8 +464,8 @@ void PPU::step(nes_cycle_t count) {
             if(scanline == 241 && _scanline_cycle == nes_ppu_cycle_t(1)) {
                 regs.setVblankFlag(true);
 
-                if(regs.vblankNmi())
-                    CPU::setNMI();
+                if(regs.vblankNmi() && raiseNMI)
+                    sharedMemory->cpuLines.nmi = true;
             }
 
             if (scanline == 260 && _scanline_cycle > nes_ppu_cycle_t(341 - 12)) {
@@ -329,6 +566,9 @@ void PPU::spritesPipeline() {
     {
         regs.maskOAMRead = false;
 
+        if (spriteEvaluation == SpriteEvaluation::Scanline)
+            return;
+
         u8 sprite_cycle = (uint8_t) (_scanline_cycle.count() - 65);
         u8 sprite_id = sprite_cycle / 2;
 
@@ -357,6 +597,9 @@ void PPU::spritesPipeline() {
     }
     else if (_scanline_cycle < nes_ppu_cycle_t(321))
     {
+        if (_scanline_cycle == nes_ppu_cycle_t(257) && spriteEvaluation == SpriteEvaluation::Scanline)
+            evaluateSprites();
+
         auto sprite_cycle = (u8)(_scanline_cycle.count() - 257);
         u8 sprite_id = sprite_cycle / 8;
         if (sprite_cycle % 8 == 4)
@@ -370,31 +613,143 @@ void PPU::spritesPipeline() {
     }
 }
 
-void PPU::fetchTile() {
-    auto scanline_render_cycle = nes_ppu_cycle_t(0);
-    u16 cur_scanline = scanline;
+void PPU::evaluateSprites() {
+    u8 spriteHeight = regs.use8x16Sprites() ? 16 : 8;
+    u64 inRange = spritesInRange(regs.oam.data(), scanline, spriteHeight);
+
+    hasSprite0 = inRange & 1;
 
-    if (_scanline_cycle > nes_ppu_cycle_t(320))
+    if (std::popcount(inRange) > 8)
+        regs.setSpriteOverflow(true);
+
+    while (inRange != 0 && lastSpriteID < 8)
+    {
+        int sprite_id = std::countr_zero(inRange);
+        memcpy(&spriteBuffer[lastSpriteID++], &regs.oam[sprite_id * sizeof(Sprite)], sizeof(Sprite));
+        inRange &= inRange - 1;
+    }
+}
+
+u64 ppu::spritesInRange(const u8 *oam, u16 scanline, u8 spriteHeight) {
+    if (scanline == 0 || scanline > 0xff)
+        return 0;
+
+    // y + 1 <= scanline < y + 1 + height, evaluated as two unsigned 8-bit compares
+    const u8 lastLine = scanline - 1;
+    u64 mask = 0;
+
+#ifdef NES_SSE2
+    const __m128i yMask = _mm_set1_epi32(0xff);
+    const __m128i line = _mm_set1_epi8((char)lastLine);
+    const __m128i maxRow = _mm_set1_epi8((char)(spriteHeight - 1));
+
+    for (int group = 0; group < 4; ++group)
+    {
+        const u8* src = oam + group * 64;
+        __m128i a = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src +  0)), yMask);
+        __m128i b = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 16)), yMask);
+        __m128i c = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 32)), yMask);
+        __m128i d = _mm_and_si128(_mm_loadu_si128((const __m128i*)(src + 48)), yMask);
+        __m128i y = _mm_packus_epi16(_mm_packs_epi32(a, b), _mm_packs_epi32(c, d));
+
+        __m128i above = _mm_cmpeq_epi8(_mm_min_epu8(y, line), y);
+        __m128i row = _mm_sub_epi8(line, y);
+        __m128i inside = _mm_cmpeq_epi8(_mm_min_epu8(row, maxRow), row);
+
+        mask |= u64(u16(_mm_movemask_epi8(_mm_and_si128(above, inside)))) << (group * 16);
+    }
+#else
+    for (int i = 0; i < 64; ++i)
+    {
+        u8 y = oam[i * 4];
+        if (y <= lastLine && u8(lastLine - y) < spriteHeight)
+            mask |= u64(1) << i;
+    }
+#endif
+
+    return mask;
+}
+
+int PPU::tileFetchCycle(u16 &cur_scanline) const {
+    const int cycle = int(_scanline_cycle.count());
+    cur_scanline = scanline;
+
+    if (cycle > 320)
     {
-        scanline_render_cycle = _scanline_cycle - nes_ppu_cycle_t(321);
         cur_scanline = (cur_scanline + 1) % resolution.y;
+        return cycle - 321;
     }
-    else
+
+    return cycle - 1 + 16;
+}
+
+void PPU::fetchTile() {
+    u16 cur_scanline = scanline;
+    const int scanline_render_cycle = tileFetchCycle(cur_scanline);
+    const int data_access_cycle = scanline_render_cycle % 8;
+    int start_bit = 7;
+    int end_bit = 0;
+
+    // pixels come from the background cache, only the column advances. A split redoes the fetches of the
+    // tile it lands in.
+    if (cachedLine)
     {
-        scanline_render_cycle = (_scanline_cycle - nes_ppu_cycle_t(1) + nes_ppu_cycle_t(16));
+        if (data_access_cycle == 6 && tileSpan(scanline_render_cycle / 8, start_bit, end_bit))
+        {
+            xOffset += start_bit - end_bit + 1;
+            incrementCoarseX();
+        }
+        return;
     }
 
-    auto data_access_cycle = scanline_render_cycle % 8;
+    // the last line prefetches the first tiles of the next frame
+    const bool skipped = isSkippedFrame(cur_scanline < scanline ? frameCount + 1 : frameCount);
 
     uint8_t tile_row_index = (cur_scanline + regs.yScroll) % 8;
 
-    if (data_access_cycle == nes_ppu_cycle_t(0))
+    if (data_access_cycle < 6)
+    {
+        fetchTileByte(data_access_cycle, tile_row_index, skipped);
+    }
+    else if (data_access_cycle == 6)
+    {
+        int tile = (scanline_render_cycle - /* current_access_cycle */ 6) / 8;
+        if (!tileSpan(tile, start_bit, end_bit))
+            return;
+
+        uint8_t bitplane1 = read_pattern_table_column(/* sprite = */false, tileIndex, /* bitplane = */ 1, tile_row_index);
+
+        for (int i = start_bit; i >= end_bit; --i)
+        {
+            uint8_t column_mask = 1 << i;
+            uint8_t tile_palette_bit01 = ((bitPlane0 & column_mask) >> i) | ((bitplane1 & column_mask) >> i << 1);
+            uint8_t color_4_bit = tilePaletteBit32 | tile_palette_bit01;
+
+            if (xOffset >= resolution.x)
+                continue;
+
+            if (!skipped)
+            {
+                _pixel_cycle[i] = get_palette_color(/* is_background = */ true, color_4_bit);
+                line.bgColor[xOffset] = _pixel_cycle[i];
+            }
+
+            line.bgOpaque[xOffset] = tile_palette_bit01 != 0 ? 0xff : 0;
+            xOffset++;
+        }
+
+        incrementCoarseX();
+    }
+}
+
+void PPU::fetchTileByte(u8 access_cycle, u8 tile_row_index, bool skipped) {
+    if (access_cycle == 0)
     {
         // http://wiki.nesdev.com/w/index.php/PPU_nametables
         uint16_t name_tbl_addr = (regs.V & 0xfff) | 0x2000;
         tileIndex = readVram(name_tbl_addr);
     }
-    else if (data_access_cycle == nes_ppu_cycle_t(2))
+    else if (access_cycle == 2 && !skipped)
     {
         // http://wiki.nesdev.com/w/index.php/PPU_attribute_tables
         // http://wiki.nesdev.com/w/index.php/PPU_scrolling#Wrapping_around
@@ -409,71 +764,59 @@ void PPU::fetchTile() {
         uint8_t color_bit32 = (color_byte & (0x3 << (_quadrant_id * 2))) >> (_quadrant_id * 2);
         tilePaletteBit32 = color_bit32 << 2;
     }
-    else if (data_access_cycle == nes_ppu_cycle_t(4))
+    else if (access_cycle == 4)
     {
         // http://wiki.nesdev.com/w/index.php/PPU_pattern_tables
         bitPlane0 = read_pattern_table_column(/* sprite = */false, tileIndex, /* bitplane = */ 0, tile_row_index);
     }
-    else if (data_access_cycle == nes_ppu_cycle_t(6))
-    {
-        uint8_t bitplane1 = read_pattern_table_column(/* sprite = */false, tileIndex, /* bitplane = */ 1, tile_row_index);
-
-        int start_bit = 7;
-        int end_bit = 0;
+}
 
-        int tile = (int)(scanline_render_cycle.count() - /* current_access_cycle */ 6) / 8;
-        if (regs.X > 0)
+bool PPU::tileSpan(int tile, int &start_bit, int &end_bit) const {
+    // fine X latched when the line's prefetch started, so the first and last tile always add up to 256 pixels
+    if (lineFineX > 0)
+    {
+        if (tile == 0)
         {
-            if (tile == 0)
-            {
-                start_bit = 7 - regs.X;
-            }
-            else if (tile == 32)
-            {
-                end_bit = 7 - regs.X + 1;
-            }
-            else if (tile > 32)
-            {
-                return;
-            }
+            start_bit = 7 - lineFineX;
         }
-        else
+        else if (tile == 32)
         {
-            if (tile > 31) return;
+            end_bit = 7 - lineFineX + 1;
         }
-
-        for (int i = start_bit; i >= end_bit; --i)
+        else if (tile > 32)
         {
-            uint8_t column_mask = 1 << i;
-            uint8_t tile_palette_bit01 = ((bitPlane0 & column_mask) >> i) | ((bitplane1 & column_mask) >> i << 1);
-            uint8_t color_4_bit = tilePaletteBit32 | tile_palette_bit01;
-
-            _pixel_cycle[i] = get_palette_color(/* is_background = */ true, color_4_bit);
-
-            uint16_t frame_addr = u16(cur_scanline) * resolution.x + xOffset++;
-
-            if (frame_addr >= frameBuffer1.size())
-                continue;
-            entireFrameBuffer[frame_addr] = _pixel_cycle[i];
-
-            frameBufferBG[frame_addr] = tile_palette_bit01;
+            return false;
         }
+    }
+    else
+    {
+        if (tile > 31) return false;
+    }
 
-        if ((regs.V & 0x1f) == 0x1f)
-        {
-            regs.V &= ~0x1f;
-            regs.V ^= 0x0400;
-        }
-        else
-        {
-            regs.V++;
-        }
+    return true;
+}
+
+void PPU::incrementCoarseX() {
+    if ((regs.V & 0x1f) == 0x1f)
+    {
+        regs.V &= ~0x1f;
+        regs.V ^= 0x0400;
+    }
+    else
+    {
+        regs.V++;
     }
 }
 
 void PPU::fetch_sprite(uint8_t sprite_id) {
     assert(sprite_id < 8);
 
+    const bool skipped = isSkippedFrame(frameCount);
+
+    // without pixels only sprite 0 matters, for the hit flag
+    if (skipped && !(hasSprite0 && sprite_id == 0))
+        return;
+
     Sprite *sprite = &spriteBuffer[sprite_id];
     uint8_t tile_index = sprite->tileIndex;
 
@@ -508,39 +851,263 @@ void PPU::fetch_sprite(uint8_t sprite_id) {
 
         uint8_t palette_index = palette_index_bit32 | palette_index_bit01;
 
-        uint8_t color = get_palette_color(/* is_background = */false, palette_index);
-        uint16_t frame_addr = scanline * resolution.x + sprite->x;
+        u16 x = sprite->x;
         if (sprite->attribute & Bit6)
-            frame_addr += i;
+            x += i;
         else
-            frame_addr += 7 - i;
+            x += 7 - i;
+
+        // the first opaque sprite in OAM order owns the pixel, even when it sits behind the background
+        if (x >= resolution.x || line.spriteOpaque[x])
+            continue;
 
-        if (frame_addr >= frameBuffer1.size())
+        if (skipped)
         {
+            if (x != resolution.x - 1)
+                line.sprite0[x] = 0xff;
             continue;
         }
 
-        bool is_sprite_0 = (hasSprite0 && sprite_id == 0);
-        bool behind_bg = sprite->attribute & Bit5;
-        if (behind_bg || is_sprite_0)
-        {
-            bool overlap = (frameBufferBG[frame_addr] != 0);
-            if (overlap)
-            {
-                if (is_sprite_0)
-                {
-                    regs.setSprite0Hit(true);
-                }
+        line.spriteColor[x] = get_palette_color(/* is_background = */false, palette_index);
+        line.spriteOpaque[x] = 0xff;
+        line.spriteFront[x] = (sprite->attribute & Bit5) ? 0 : 0xff;
 
-                if (behind_bg)
-                {
-                    continue;
-                }
-            }
-        }
+        // sprite 0 hit never triggers on the last column
+        if (hasSprite0 && sprite_id == 0 && x != resolution.x - 1)
+            line.sprite0[x] = 0xff;
+    }
+}
+
+void PPU::composeLine() {
+    const bool skipped = isSkippedFrame(frameCount);
+
+    if (!regs.showBackground())
+    {
+        if (!skipped)
+            line.bgColor.fill(readVram(0x3f00));
+        line.bgOpaque.fill(0);
+    }
+    else if (cachedLine)
+    {
+        copyCachedLine(scanline, skipped);
+        cachedLines++;
+    }
+
+    const bool hit = skipped ? sprite0Overlaps(line) : composeScanline(line, entireFrameBuffer + scanline * resolution.x);
+    // a skipped line is never shown, so neither its emphasis nor its hash is needed
+    if (!skipped)
+    {
+        entireEmphasisBuffer[scanline] = *regs.PPUMask >> 5;
+        entireLineHashes[scanline] = hashLine(entireFrameBuffer + scanline * resolution.x, entireEmphasisBuffer[scanline]);
+    }
+    if (hit && regs.showBackground())
+        regs.setSprite0Hit(true);
+
+    line.spriteOpaque.fill(0);
+    line.sprite0.fill(0);
+}
+
+void PPU::prepareCachedLine() {
+    u16 nextLine = (scanline + 1) % resolution.y;
+
+    // line 0 is fetched across the pre-render V reload, coarse Y 30/31 reads attributes as tiles
+    cachedLine = backgroundCacheEnabled
+              && !rasterEffectThisFrame && cacheOffFrames == 0
+              && nextLine != 0
+              && ((regs.V >> 5) & 0x1f) < 30;
+
+    cachedLineV = regs.V;
+    lineFineX = regs.X;
+}
+
+void PPU::copyCachedLine(u16 target, bool skipped, u16 pixels) {
+    std::array<u8, resolution.x> indices;
+    u8 fineY = (target + regs.yScroll) % 8;
+    backgroundCache.copyLine(cachedLineV, lineFineX, fineY, regs.backgroundPatternTableAddress(), indices.data());
 
-        entireFrameBuffer[frame_addr] = color;
+    std::array<u8, 16> colors{};
+    if (!skipped)
+    {
+        for (u8 i = 0; i < colors.size(); ++i)
+            colors[i] = get_palette_color(/* is_background = */ true, i);
+    }
+
+    // the same as the tile pipeline leaves behind, a skipped frame keeps the old colours
+    for (int x = 0; x < pixels; ++x)
+    {
+        u8 index = indices[x];
+        line.bgOpaque[x] = (index & 0x3) != 0 ? 0xff : 0;
+        if (!skipped)
+            line.bgColor[x] = colors[index];
+    }
+}
+
+void PPU::detectRasterEffect(u16 addr, u8 val) {
+    if (scanline > 239)
+        return;
+
+    const bool rendering = regs.showBackground() || regs.showSprites();
+
+    switch (addr) {
+        case PPUADDRAddress:
+        case PPUDATAAddress:
+            if (!rendering)
+                return;
+            break;
+        case PPUCTRLAddress:
+            if (!rendering || !((val ^ *regs.PPUControl) & Bit4))
+                return;
+            break;
+        case PPUSCROLLAddress:
+            // fine Y is read per tile, only the rest of this line sees the new one, later lines are cached fine
+            if (rendering && is_ready() && regs.W && ((val ^ regs.yScroll) & 0x7) && cachedLine)
+                splitCachedLine();
+            return;
+        case PPUMASKAddress:
+            // switching the background on mid-frame starts from whatever V holds, treat it like a split
+            if (!((val ^ *regs.PPUMask) & Bit3))
+                return;
+            break;
+        default:
+            return;
+    }
+
+    markRasterEffect();
+}
+
+void PPU::markRasterEffect() {
+    rasterEffectThisFrame = true;
+
+    if (cachedLine)
+        splitCachedLine();
+}
+
+void PPU::splitCachedLine() {
+    // pixels fetched so far come from the cache, the tile pipeline takes over from xOffset. A line that is
+    // fetched already (cycles 257-320) is copied whole, composeLine takes it as it is.
+    bool prefetch = _scanline_cycle > nes_ppu_cycle_t(320);
+    bool fetched = _scanline_cycle > nes_ppu_cycle_t(256) && !prefetch;
+    u16 target = prefetch ? (scanline + 1) % resolution.y : scanline;
+
+    // xOffset wraps to 0 once the line's last tile is in
+    const u16 pixels = fetched || (!prefetch && xOffset == 0) ? resolution.x : xOffset;
+
+    const bool skipped = isSkippedFrame(prefetch && target == 0 ? frameCount + 1 : frameCount);
+
+    if (regs.showBackground())
+        copyCachedLine(target, skipped, pixels);
+    cachedLine = false;
+
+    // the tile under way had its fetches skipped, the ones the tile pipeline made by now are made here
+    const bool fetching = (_scanline_cycle >= nes_ppu_cycle_t(1) && !fetched && !prefetch)
+                       || (prefetch && _scanline_cycle < nes_ppu_cycle_t(337));
+    if (!regs.showBackground() || !fetching)
+        return;
+
+    u16 cur_scanline = scanline;
+    const u8 access_cycle = tileFetchCycle(cur_scanline) % 8;
+    const u8 tile_row_index = (cur_scanline + regs.yScroll) % 8;
+    for (u8 access = 0; access <= access_cycle && access < 6; access += 2)
+        fetchTileByte(access, tile_row_index, skipped);
+}
+
+void PPU::endCachedFrame() {
+    // re-rendering a tile costs about what fetching one does, a cached line saves 33 fetches. One costly frame
+    // is a new scene, two in a row are CHR banks switched or tiles rewritten all the time, then the cache
+    // sits out a second before trying again
+    const u32 rendered = backgroundCache.takeTilesRendered();
+    if (rendered > cachedLines * 33u)
+        costlyFrames = std::min<u8>(costlyFrames + 1, 2);
+    else
+        costlyFrames = 0;
+
+    if (costlyFrames == 2)
+    {
+        cacheOffFrames = 60;
+        costlyFrames = 0;
+    }
+    else if (cacheOffFrames > 0)
+    {
+        cacheOffFrames--;
+    }
+
+    cachedLines = 0;
+    rasterEffectThisFrame = false;
+}
+
+bool ppu::sprite0Overlaps(const LineBuffer &line) {
+#ifdef NES_SSE2
+    __m128i hit = _mm_setzero_si128();
+
+    for (int x = 0; x < resolution.x; x += 16)
+    {
+        __m128i bgOpaque = _mm_load_si128((const __m128i*)&line.bgOpaque[x]);
+        __m128i sprite0 = _mm_load_si128((const __m128i*)&line.sprite0[x]);
+        hit = _mm_or_si128(hit, _mm_and_si128(bgOpaque, sprite0));
+    }
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) != 0xffff;
+#else
+    u8 hit = 0;
+
+    for (int x = 0; x < resolution.x; ++x)
+        hit |= line.bgOpaque[x] & line.sprite0[x];
+
+    return hit != 0;
+#endif
+}
+
+bool ppu::composeScanline(const LineBuffer &line, u8 *dst) {
+#ifdef NES_SSE2
+    const __m128i ones = _mm_set1_epi8((char)0xff);
+    __m128i hit = _mm_setzero_si128();
+
+    for (int x = 0; x < resolution.x; x += 16)
+    {
+        __m128i bg = _mm_load_si128((const __m128i*)&line.bgColor[x]);
+        __m128i bgOpaque = _mm_load_si128((const __m128i*)&line.bgOpaque[x]);
+        __m128i sprite = _mm_load_si128((const __m128i*)&line.spriteColor[x]);
+        __m128i spriteOpaque = _mm_load_si128((const __m128i*)&line.spriteOpaque[x]);
+        __m128i spriteFront = _mm_load_si128((const __m128i*)&line.spriteFront[x]);
+        __m128i sprite0 = _mm_load_si128((const __m128i*)&line.sprite0[x]);
+
+        __m128i useSprite = _mm_and_si128(spriteOpaque, _mm_or_si128(spriteFront, _mm_xor_si128(bgOpaque, ones)));
+        __m128i out = _mm_or_si128(_mm_and_si128(useSprite, sprite), _mm_andnot_si128(useSprite, bg));
+        _mm_storeu_si128((__m128i*)(dst + x), out);
+
+        hit = _mm_or_si128(hit, _mm_and_si128(bgOpaque, sprite0));
+    }
+
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(hit, _mm_setzero_si128())) != 0xffff;
+#else
+    u8 hit = 0;
+
+    for (int x = 0; x < resolution.x; ++x)
+    {
+        u8 useSprite = line.spriteOpaque[x] & (line.spriteFront[x] | u8(~line.bgOpaque[x]));
+        dst[x] = (useSprite & line.spriteColor[x]) | (u8(~useSprite) & line.bgColor[x]);
+        hit |= line.bgOpaque[x] & line.sprite0[x];
     }
+
+    return hit != 0;
+#endif
+}
+
+u64 ppu::hashLine(const u8 *pixels, u8 emphasis) {
+    u64 hash = 0x9e3779b97f4a7c15ull ^ emphasis;
+
+    for (int x = 0; x < resolution.x; x += sizeof(u64))
+    {
+        u64 word;
+        memcpy(&word, pixels + x, sizeof(u64));
+        hash = std::rotl((hash ^ word) * 0xff51afd7ed558ccdull, 29);
+    }
+
+    return hash ^ (hash >> 32);
+}
+
+u64 ppu::combineHash(u64 seed, u64 value) {
+    return std::rotl(seed, 31) * 0xc4ceb9fe1a85ec53ull ^ value;
 }
 
 u8 PPU::read_pattern_table_column(bool sprite, u8 tile_index, u8 bitplane, u8 tile_row_index) {
@@ -579,37 +1146,31 @@ void PPU::step_ppu(nes_ppu_cycle_t count) {
         if (scanline >= PPU_SCANLINE_COUNT)
         {
             scanline %= PPU_SCANLINE_COUNT;
-            swap_buffer();
+
+            // a skipped frame leaves the last rendered one on the front buffer
+            if (!isSkippedFrame(frameCount))
+            {
+                swap_buffer();
+                frontFrame = frameCount;
+            }
             frameCount++;
+
+            endCachedFrame();
         }
     }
 }
 
 void PPU::swap_buffer() {
     if (entireFrameBuffer == frameBuffer1.data())
-        entireFrameBuffer = frameBuffer2.data();
-    else
-        entireFrameBuffer = frameBuffer1.data();
-}
-
-void PPU::redirectAddress(uint16_t &addr) {
-    if ((addr & 0xff00) == 0x3f00)
     {
-        addr &= 0xff1f;
-
-        if ((addr & 0xfff3) == 0x3f10)
-            addr &= 0x3f0f;
-    }
-    else if ((addr & 0xf000) == 0x2000)
-    {
-        if (mirroring == nes_mapper_flags_vertical_mirroring)
-            addr &= 0xf7ff;     // $2000=$2800, $2400=$2c00
-        else if (mirroring == nes_mapper_flags_horizontal_mirroring)
-            addr &= 0xfbff;     // $2000=$2400, $2800=$2c00
-        else assert(!"Unsupported mirroring modes");
+        entireFrameBuffer = frameBuffer2.data();
+        entireEmphasisBuffer = emphasisBuffer2.data();
+        entireLineHashes = lineHashes2.data();
     }
-    else if (addr >= 0x3000)
+    else
     {
-        addr -= 0x1000;
+        entireFrameBuffer = frameBuffer1.data();
+        entireEmphasisBuffer = emphasisBuffer1.data();
+        entireLineHashes = lineHashes1.data();
     }
 }
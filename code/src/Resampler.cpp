@@ -0,0 +1,122 @@
+#include "Resampler.h"
+
+#include <algorithm>
+#include <cmath>
+#include <numbers>
+
+#include "Simd.h"
+
+Resampler::Resampler(double inRate, double outRate, ResampleQuality quality) {
+    nominalStep = inRate / outRate;
+    step = nominalStep;
+
+    // relative to the input rate, a little under the lower Nyquist
+    const double cutoff = 0.45 * std::min(1.0, outRate / inRate);
+    buildKernels(cutoff, u8(quality));
+}
+
+void Resampler::buildKernels(double cutoff, u8 zeroCrossings) {
+    // zero crossings are 1 / (2 * cutoff) input samples apart
+    const u32 width = u32(std::ceil(zeroCrossings / cutoff));
+    taps = u16((width + 3) & ~3u);
+    kernels.assign(size_t(phases) * taps, 0.0f);
+
+    for (u16 phase = 0; phase < phases; ++phase)
+    {
+        float* kernel = &kernels[size_t(phase) * taps];
+        double sum = 0;
+
+        for (u16 k = 0; k < taps; ++k)
+        {
+            // the output sample sits between taps taps/2 - 1 and taps/2
+            const double t = k - (taps / 2 - 1) - double(phase) / phases;
+            const double x = 2 * cutoff * t;
+            const double sinc = x == 0 ? 1 : std::sin(std::numbers::pi * x) / (std::numbers::pi * x);
+            // Blackman over the kernel
+            const double w = (t + taps / 2) / taps;
+            const double window = 0.42 - 0.5 * std::cos(2 * std::numbers::pi * w) + 0.08 * std::cos(4 * std::numbers::pi * w);
+
+            kernel[k] = float(sinc * std::max(window, 0.0));
+            sum += kernel[k];
+        }
+
+        // unity gain at DC for every phase
+        for (u16 k = 0; k < taps; ++k)
+            kernel[k] = float(kernel[k] / sum);
+    }
+
+    clear();
+}
+
+void Resampler::setRatio(double ratio) {
+    step = nominalStep / ratio;
+}
+
+size_t Resampler::maxOutput(size_t count) const {
+    return size_t((history.size() + count - position) / step) + 1;
+}
+
+u16 Resampler::getTaps() const {
+    return taps;
+}
+
+void Resampler::clear() {
+    // starts from silence, the first outputs ramp in like the kernel
+    history.assign(taps, 0.0f);
+    position = 0;
+}
+
+size_t Resampler::process(const float *src, size_t count, float *dst) {
+    history.insert(history.end(), src, src + count);
+
+    size_t written = 0;
+    const double last = double(history.size() - taps);
+
+    while (position <= last)
+    {
+        size_t index = size_t(position);
+        u32 phase = u32((position - index) * phases + 0.5);
+        if (phase == phases)
+        {
+            phase = 0;
+            ++index;
+            if (index > last)
+                break;
+        }
+
+        const float* in = &history[index];
+        const float* kernel = &kernels[size_t(phase) * taps];
+
+#ifdef NES_SSE2
+        __m128 acc0 = _mm_setzero_ps();
+        __m128 acc1 = _mm_setzero_ps();
+        u16 k = 0;
+        for (; k + 8 <= taps; k += 8)
+        {
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(in + k), _mm_loadu_ps(kernel + k)));
+            acc1 = _mm_add_ps(acc1, _mm_mul_ps(_mm_loadu_ps(in + k + 4), _mm_loadu_ps(kernel + k + 4)));
+        }
+        if (k < taps)
+            acc0 = _mm_add_ps(acc0, _mm_mul_ps(_mm_loadu_ps(in + k), _mm_loadu_ps(kernel + k)));
+
+        __m128 acc = _mm_add_ps(acc0, acc1);
+        acc = _mm_add_ps(acc, _mm_movehl_ps(acc, acc));
+        acc = _mm_add_ss(acc, _mm_shuffle_ps(acc, acc, 1));
+        dst[written++] = _mm_cvtss_f32(acc);
+#else
+        float acc = 0;
+        for (u16 k = 0; k < taps; ++k)
+            acc += in[k] * kernel[k];
+        dst[written++] = acc;
+#endif
+
+        position += step;
+    }
+
+    // keep what the next outputs still reach back to
+    const size_t consumed = std::min(size_t(position), history.size() - taps);
+    history.erase(history.begin(), history.begin() + consumed);
+    position -= double(consumed);
+
+    return written;
+}
@@ -0,0 +1,372 @@
+#include "Scaler.h"
+
+#include <algorithm>
+#include <cstring>
+
+#include "Simd.h"
+#include "WorkerPool.h"
+
+namespace {
+    // row with the edge pixels repeated on both sides, index x + 1 is source pixel x
+    void padRow(const u32* row, u16 width, u32* out) {
+        out[0] = row[0];
+        memcpy(out + 1, row, width * sizeof(u32));
+        out[width + 1] = row[width - 1];
+    }
+
+    i32 luma(u32 pixel) {
+        return (((pixel >> 24) & 0xff) * 77 + ((pixel >> 16) & 0xff) * 150 + ((pixel >> 8) & 0xff) * 29) >> 8;
+    }
+
+    void padLuma(const u32* row, u16 width, i32* out) {
+        for (u16 x = 0; x < width; ++x)
+            out[x + 1] = luma(row[x]);
+        out[0] = out[1];
+        out[width + 1] = out[width];
+    }
+
+    u32 average(u32 a, u32 b) {
+        // per byte rounding up, same as _mm_avg_epu8
+        return (a | b) - (((a ^ b) >> 1) & 0x7f7f7f7f);
+    }
+
+#ifdef NES_SSE2
+    __m128i select(__m128i mask, __m128i a, __m128i b) {
+        return _mm_or_si128(_mm_and_si128(mask, a), _mm_andnot_si128(mask, b));
+    }
+
+    __m128i absDiff(__m128i a, __m128i b) {
+        __m128i d = _mm_sub_epi32(a, b);
+        __m128i sign = _mm_srai_epi32(d, 31);
+        return _mm_sub_epi32(_mm_xor_si128(d, sign), sign);
+    }
+
+    __m128i load(const void* p) {
+        return _mm_loadu_si128((const __m128i*)p);
+    }
+
+    void store(void* p, __m128i v) {
+        _mm_storeu_si128((__m128i*)p, v);
+    }
+#endif
+
+    void nearest(const u32* src, u16 width, u32* dst, u32 dstPitch, u8 factor, u16 y0, u16 y1) {
+        const u32 outWidth = width * factor;
+
+        for (u16 y = y0; y < y1; ++y)
+        {
+            const u32* in = src + y * width;
+            u32* out = dst + y * factor * dstPitch;
+            u16 x = 0;
+
+#ifdef NES_SSE2
+            if (factor == 2)
+            {
+                for (; x + 4 <= width; x += 4)
+                {
+                    __m128i v = load(in + x);
+                    store(out + x * 2, _mm_unpacklo_epi32(v, v));
+                    store(out + x * 2 + 4, _mm_unpackhi_epi32(v, v));
+                }
+            }
+            else if (factor == 4)
+            {
+                for (; x + 4 <= width; x += 4)
+                {
+                    __m128i v = load(in + x);
+                    store(out + x * 4, _mm_shuffle_epi32(v, 0x00));
+                    store(out + x * 4 + 4, _mm_shuffle_epi32(v, 0x55));
+                    store(out + x * 4 + 8, _mm_shuffle_epi32(v, 0xaa));
+                    store(out + x * 4 + 12, _mm_shuffle_epi32(v, 0xff));
+                }
+            }
+#endif
+            for (; x < width; ++x)
+                std::fill_n(out + x * factor, factor, in[x]);
+
+            for (u8 i = 1; i < factor; ++i)
+                memcpy(out + i * dstPitch, out, outWidth * sizeof(u32));
+        }
+    }
+
+    void scale2x(const u32* src, u16 width, u16 height, u32* dst, u32 dstPitch, u16 y0, u16 y1) {
+        std::vector<u32> rows(3 * (width + 2));
+        u32* prev = rows.data();
+        u32* cur = prev + width + 2;
+        u32* next = cur + width + 2;
+
+        for (u16 y = y0; y < y1; ++y)
+        {
+            padRow(src + (y > 0 ? y - 1 : 0) * width, width, prev);
+            padRow(src + y * width, width, cur);
+            padRow(src + std::min<u16>(y + 1, height - 1) * width, width, next);
+
+            u32* out0 = dst + y * 2 * dstPitch;
+            u32* out1 = out0 + dstPitch;
+            u16 x = 0;
+
+#ifdef NES_SSE2
+            const __m128i ones = _mm_set1_epi32(-1);
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i b = load(prev + x + 1);
+                __m128i d = load(cur + x);
+                __m128i e = load(cur + x + 1);
+                __m128i f = load(cur + x + 2);
+                __m128i h = load(next + x + 1);
+
+                __m128i cond = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), ones);
+
+                __m128i e0 = select(_mm_and_si128(cond, _mm_cmpeq_epi32(d, b)), d, e);
+                __m128i e1 = select(_mm_and_si128(cond, _mm_cmpeq_epi32(b, f)), f, e);
+                __m128i e2 = select(_mm_and_si128(cond, _mm_cmpeq_epi32(d, h)), d, e);
+                __m128i e3 = select(_mm_and_si128(cond, _mm_cmpeq_epi32(h, f)), f, e);
+
+                store(out0 + x * 2, _mm_unpacklo_epi32(e0, e1));
+                store(out0 + x * 2 + 4, _mm_unpackhi_epi32(e0, e1));
+                store(out1 + x * 2, _mm_unpacklo_epi32(e2, e3));
+                store(out1 + x * 2 + 4, _mm_unpackhi_epi32(e2, e3));
+            }
+#endif
+            for (; x < width; ++x)
+            {
+                u32 b = prev[x + 1], d = cur[x], e = cur[x + 1], f = cur[x + 2], h = next[x + 1];
+                bool cond = b != h && d != f;
+
+                out0[x * 2] = cond && d == b ? d : e;
+                out0[x * 2 + 1] = cond && b == f ? f : e;
+                out1[x * 2] = cond && d == h ? d : e;
+                out1[x * 2 + 1] = cond && h == f ? f : e;
+            }
+        }
+    }
+
+    void scale3x(const u32* src, u16 width, u16 height, u32* dst, u32 dstPitch, u16 y0, u16 y1) {
+        std::vector<u32> rows(3 * (width + 2));
+        u32* prev = rows.data();
+        u32* cur = prev + width + 2;
+        u32* next = cur + width + 2;
+
+        for (u16 y = y0; y < y1; ++y)
+        {
+            padRow(src + (y > 0 ? y - 1 : 0) * width, width, prev);
+            padRow(src + y * width, width, cur);
+            padRow(src + std::min<u16>(y + 1, height - 1) * width, width, next);
+
+            u32* out[3] = {dst + y * 3 * dstPitch, dst + (y * 3 + 1) * dstPitch, dst + (y * 3 + 2) * dstPitch};
+            u16 x = 0;
+
+#ifdef NES_SSE2
+            const __m128i ones = _mm_set1_epi32(-1);
+            alignas(16) u32 result[9][4];
+
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i a = load(prev + x), b = load(prev + x + 1), c = load(prev + x + 2);
+                __m128i d = load(cur + x), e = load(cur + x + 1), f = load(cur + x + 2);
+                __m128i g = load(next + x), h = load(next + x + 1), i = load(next + x + 2);
+
+                __m128i cond = _mm_andnot_si128(_mm_or_si128(_mm_cmpeq_epi32(b, h), _mm_cmpeq_epi32(d, f)), ones);
+                __m128i db = _mm_and_si128(cond, _mm_cmpeq_epi32(d, b));
+                __m128i bf = _mm_and_si128(cond, _mm_cmpeq_epi32(b, f));
+                __m128i dh = _mm_and_si128(cond, _mm_cmpeq_epi32(d, h));
+                __m128i hf = _mm_and_si128(cond, _mm_cmpeq_epi32(h, f));
+
+                // x && e != n
+                auto unless = [&](__m128i mask, __m128i n) { return _mm_andnot_si128(_mm_cmpeq_epi32(e, n), mask); };
+
+                _mm_store_si128((__m128i*)result[0], select(db, d, e));
+                _mm_store_si128((__m128i*)result[1], select(_mm_or_si128(unless(db, c), unless(bf, a)), b, e));
+                _mm_store_si128((__m128i*)result[2], select(bf, f, e));
+                _mm_store_si128((__m128i*)result[3], select(_mm_or_si128(unless(db, g), unless(dh, a)), d, e));
+                _mm_store_si128((__m128i*)result[4], e);
+                _mm_store_si128((__m128i*)result[5], select(_mm_or_si128(unless(bf, i), unless(hf, c)), f, e));
+                _mm_store_si128((__m128i*)result[6], select(dh, d, e));
+                _mm_store_si128((__m128i*)result[7], select(_mm_or_si128(unless(dh, i), unless(hf, g)), h, e));
+                _mm_store_si128((__m128i*)result[8], select(hf, f, e));
+
+                for (u8 lane = 0; lane < 4; ++lane)
+                    for (u8 row = 0; row < 3; ++row)
+                        for (u8 column = 0; column < 3; ++column)
+                            out[row][(x + lane) * 3 + column] = result[row * 3 + column][lane];
+            }
+#endif
+            for (; x < width; ++x)
+            {
+                u32 a = prev[x], b = prev[x + 1], c = prev[x + 2];
+                u32 d = cur[x], e = cur[x + 1], f = cur[x + 2];
+                u32 g = next[x], h = next[x + 1], i = next[x + 2];
+
+                u32 result[9] = {e, e, e, e, e, e, e, e, e};
+
+                if (b != h && d != f)
+                {
+                    result[0] = d == b ? d : e;
+                    result[1] = (d == b && e != c) || (b == f && e != a) ? b : e;
+                    result[2] = b == f ? f : e;
+                    result[3] = (d == b && e != g) || (d == h && e != a) ? d : e;
+                    result[5] = (b == f && e != i) || (h == f && e != c) ? f : e;
+                    result[6] = d == h ? d : e;
+                    result[7] = (d == h && e != i) || (h == f && e != g) ? h : e;
+                    result[8] = h == f ? f : e;
+                }
+
+                for (u8 row = 0; row < 3; ++row)
+                    for (u8 column = 0; column < 3; ++column)
+                        out[row][x * 3 + column] = result[row * 3 + column];
+            }
+        }
+    }
+
+    void xbr2x(const u32* src, u16 width, u16 height, u32* dst, u32 dstPitch, u16 y0, u16 y1) {
+        std::vector<u32> rows(3 * (width + 2));
+        u32* prev = rows.data();
+        u32* cur = prev + width + 2;
+        u32* next = cur + width + 2;
+
+        std::vector<i32> lumaRows(3 * (width + 2));
+        i32* lprev = lumaRows.data();
+        i32* lcur = lprev + width + 2;
+        i32* lnext = lcur + width + 2;
+
+        for (u16 y = y0; y < y1; ++y)
+        {
+            const u32* rowPrev = src + (y > 0 ? y - 1 : 0) * width;
+            const u32* rowNext = src + std::min<u16>(y + 1, height - 1) * width;
+
+            padRow(rowPrev, width, prev);
+            padRow(src + y * width, width, cur);
+            padRow(rowNext, width, next);
+            padLuma(rowPrev, width, lprev);
+            padLuma(src + y * width, width, lcur);
+            padLuma(rowNext, width, lnext);
+
+            u32* out0 = dst + y * 2 * dstPitch;
+            u32* out1 = out0 + dstPitch;
+            u16 x = 0;
+
+#ifdef NES_SSE2
+            for (; x + 4 <= width; x += 4)
+            {
+                __m128i la = load(lprev + x), lb = load(lprev + x + 1), lc = load(lprev + x + 2);
+                __m128i ld = load(lcur + x), le = load(lcur + x + 1), lf = load(lcur + x + 2);
+                __m128i lg = load(lnext + x), lh = load(lnext + x + 1), li = load(lnext + x + 2);
+
+                __m128i b = load(prev + x + 1), d = load(cur + x), e = load(cur + x + 1);
+                __m128i f = load(cur + x + 2), h = load(next + x + 1);
+
+                // corner towards p and q with diagonal neighbour n, p2/q2 are the corners beside p/q
+                // and op/oq the pixels opposite to p/q
+                auto corner = [&](__m128i p, __m128i q, __m128i lp, __m128i lq, __m128i ln,
+                                  __m128i lp2, __m128i lq2, __m128i lop, __m128i loq) {
+                    __m128i edge = _mm_add_epi32(_mm_add_epi32(absDiff(le, lp2), absDiff(le, lq2)),
+                                                 _mm_slli_epi32(absDiff(lp, lq), 2));
+                    __m128i across = _mm_add_epi32(_mm_add_epi32(absDiff(lq, lop), absDiff(lp, loq)),
+                                                   _mm_slli_epi32(absDiff(le, ln), 2));
+                    __m128i pick = select(_mm_cmpgt_epi32(absDiff(le, lp), absDiff(le, lq)), q, p);
+                    return select(_mm_cmplt_epi32(edge, across), _mm_avg_epu8(e, pick), e);
+                };
+
+                __m128i e0 = corner(b, d, lb, ld, la, lc, lg, lh, lf);
+                __m128i e1 = corner(f, b, lf, lb, lc, li, la, ld, lh);
+                __m128i e2 = corner(d, h, ld, lh, lg, la, li, lf, lb);
+                __m128i e3 = corner(h, f, lh, lf, li, lg, lc, lb, ld);
+
+                store(out0 + x * 2, _mm_unpacklo_epi32(e0, e1));
+                store(out0 + x * 2 + 4, _mm_unpackhi_epi32(e0, e1));
+                store(out1 + x * 2, _mm_unpacklo_epi32(e2, e3));
+                store(out1 + x * 2 + 4, _mm_unpackhi_epi32(e2, e3));
+            }
+#endif
+            for (; x < width; ++x)
+            {
+                i32 la = lprev[x], lb = lprev[x + 1], lc = lprev[x + 2];
+                i32 ld = lcur[x], le = lcur[x + 1], lf = lcur[x + 2];
+                i32 lg = lnext[x], lh = lnext[x + 1], li = lnext[x + 2];
+
+                u32 b = prev[x + 1], d = cur[x], e = cur[x + 1], f = cur[x + 2], h = next[x + 1];
+
+                auto corner = [&](u32 p, u32 q, i32 lp, i32 lq, i32 ln, i32 lp2, i32 lq2, i32 lop, i32 loq) {
+                    i32 edge = std::abs(le - lp2) + std::abs(le - lq2) + 4 * std::abs(lp - lq);
+                    i32 across = std::abs(lq - lop) + std::abs(lp - loq) + 4 * std::abs(le - ln);
+                    u32 pick = std::abs(le - lp) > std::abs(le - lq) ? q : p;
+                    return edge < across ? average(e, pick) : e;
+                };
+
+                out0[x * 2] = corner(b, d, lb, ld, la, lc, lg, lh, lf);
+                out0[x * 2 + 1] = corner(f, b, lf, lb, lc, li, la, ld, lh);
+                out1[x * 2] = corner(d, h, ld, lh, lg, la, li, lf, lb);
+                out1[x * 2 + 1] = corner(h, f, lh, lf, li, lg, lc, lb, ld);
+            }
+        }
+    }
+}
+
+Scaler::Scaler(WorkerPool *pool) {
+    this->pool = pool;
+}
+
+void Scaler::setFilter(ScaleFilter filter, u8 factor) {
+    this->filter = filter;
+
+    switch (filter) {
+        case ScaleFilter::Nearest:
+            this->factor = std::clamp<u8>(factor, 1, 8);
+            break;
+        case ScaleFilter::Scale2x:
+        case ScaleFilter::XBR:
+            this->factor = 2;
+            break;
+        case ScaleFilter::Scale3x:
+            this->factor = 3;
+            break;
+        case ScaleFilter::Scale4x:
+            this->factor = 4;
+            break;
+    }
+}
+
+ScaleFilter Scaler::getFilter() const {
+    return filter;
+}
+
+u8 Scaler::getFactor() const {
+    return factor;
+}
+
+void Scaler::scale(const u32 *src, u16 width, u16 height, u32 *dst, u32 dstPitch) {
+    switch (filter) {
+        case ScaleFilter::Nearest:
+            forSlices(height, [&](u16 y0, u16 y1) { nearest(src, width, dst, dstPitch, factor, y0, y1); });
+            break;
+        case ScaleFilter::Scale2x:
+            forSlices(height, [&](u16 y0, u16 y1) { scale2x(src, width, height, dst, dstPitch, y0, y1); });
+            break;
+        case ScaleFilter::Scale3x:
+            forSlices(height, [&](u16 y0, u16 y1) { scale3x(src, width, height, dst, dstPitch, y0, y1); });
+            break;
+        case ScaleFilter::Scale4x: {
+            // the second pass reads rows from neighbouring slices, so the first one has to finish everywhere
+            intermediate.resize(width * 2 * height * 2);
+            u32* mid = intermediate.data();
+
+            forSlices(height, [&](u16 y0, u16 y1) { scale2x(src, width, height, mid, width * 2, y0, y1); });
+            forSlices(height * 2, [&](u16 y0, u16 y1) { scale2x(mid, width * 2, height * 2, dst, dstPitch, y0, y1); });
+            break;
+        }
+        case ScaleFilter::XBR:
+            forSlices(height, [&](u16 y0, u16 y1) { xbr2x(src, width, height, dst, dstPitch, y0, y1); });
+            break;
+    }
+}
+
+void Scaler::forSlices(u16 height, const std::function<void(u16, u16)>& rows) const {
+    if (!pool)
+    {
+        rows(0, height);
+        return;
+    }
+
+    pool->runSlices(height, [&](u32 first, u32 last) { rows(first, last); });
+}
@@ -0,0 +1,281 @@
+#include "ThreadedPPU.h"
+
+#include <algorithm>
+
+
+using namespace ppu;
+
+ThreadedPPU::ThreadedPPU(Memory *shared) : ppu(shared, false) {
+    this->sharedMemory = shared;
+    ppu.setRaiseNMI(false);
+
+    sharedMemory->oamDMA = std::function<void(u16)>([this](u16 address) {
+        u8 bytes[0x100];
+        sharedMemory->get_bytes(bytes, sizeof(bytes), address, sizeof(bytes));
+
+        for (u16 i = 0; i < 0x100; ++i)
+            push(EventType::OAMDMA, i, bytes[i]);
+    });
+
+    sharedMemory->beforeWrite.push_back([this](u16 addr, u8& val) -> bool {
+        if (!isIOReg(addr))
+            return true;
+
+        // DMA is the CPU's business, the bytes arrive through oamDMA
+        if (addr == OAMDMAAddress)
+        {
+            sharedMemory->cpuLines.dma = true;
+            sharedMemory->cpuLines.dmaAddress = u16(val) << 8;
+            return false;
+        }
+
+        // PPU::is_ready, the shadow is exactly where the PPU will be when the write is applied
+        const bool ready = shadowCycle > nes_cycle_t(29658);
+        if (addr == PPUCTRLAddress && ready)
+            shadowControl = val;
+
+        // what PPU::writeRegister leaves in the latch
+        const bool ignored = (addr == PPUCTRLAddress || addr == PPUSCROLLAddress) && !ready;
+        if (!ignored && addr != input::p1)
+            shadowLatch = val;
+
+        push(EventType::Write, addr, val);
+        return addr > PPUDATAAddress;
+    });
+
+    sharedMemory->beforeRead.push_back([this](u16 addr) -> std::optional<u8> {
+        if (!isIOReg(addr) || addr == input::p1 || addr == input::p2 || addr == apu::APUSTATUSAddress)
+            return std::nullopt;
+
+        switch (addr) {
+            case PPUSTATUSAddress:
+                return readStatus();
+            case OAMDATAAddress:
+            case PPUDATAAddress: {
+                // OAM and VRAM as rendering left them, and the $2007 read buffer
+                sync();
+                const std::optional<u8> value = ppu.readRegister(addr);
+                shadowLatch = ppu.getOpenBus();
+                return value;
+            }
+            default:
+                return shadowLatch;
+        }
+    });
+
+    thread = std::thread(&ThreadedPPU::run, this);
+}
+
+ThreadedPPU::~ThreadedPPU() {
+    running.store(false, std::memory_order_release);
+    if (thread.joinable())
+        thread.join();
+}
+
+void ThreadedPPU::step(nes_cycle_t count) {
+    while (shadowCycle < count)
+        stepShadow();
+
+    now = count;
+    if (now.count() - published >= publishInterval)
+        publish(now.count());
+}
+
+void ThreadedPPU::sync() {
+    publish(now.count());
+
+    while (processed.load(std::memory_order_acquire) != pushed
+        || reached.load(std::memory_order_acquire) != now.count())
+    {
+        std::this_thread::yield();
+    }
+}
+
+PPU* ThreadedPPU::getPPU() {
+    return &ppu;
+}
+
+std::vector<u8> ThreadedPPU::getFrameBuffer() {
+    sync();
+    return ppu.getFrameBuffer();
+}
+
+std::vector<u32> ThreadedPPU::getFrame() {
+    sync();
+    return ppu.getFrame();
+}
+
+void ThreadedPPU::getIndexedFrame(IndexedFrame &frame) {
+    sync();
+    ppu.getIndexedFrame(frame);
+}
+
+u64 ThreadedPPU::getFrameHash() {
+    sync();
+    return ppu.getFrameHash();
+}
+
+u32 ThreadedPPU::getFrameCount() const {
+    return shadowFrame;
+}
+
+void ThreadedPPU::setChrPage(u8 page, u16 bank) {
+    push(EventType::ChrPage, bank, page);
+}
+
+void ThreadedPPU::setMirroring(nes_mapper_flags flags) {
+    push(EventType::Mirroring, 0, flags);
+}
+
+void ThreadedPPU::push(EventType type, u16 addr, u8 value) {
+    Event event;
+    event.time = now.count();
+    event.type = type;
+    event.addr = addr;
+    event.value = value;
+
+    // a full queue means the PPU thread is behind, let it run up to the oldest event
+    while (!events.push(event))
+    {
+        publish(now.count());
+        std::this_thread::yield();
+    }
+
+    pushed++;
+
+    // what the PPU's outlook on the sprite flags depends on: OAM, sprite size and what is shown
+    const bool spriteState = type == EventType::OAMDMA
+        || (type == EventType::Write && (addr == PPUCTRLAddress || addr == PPUMASKAddress || addr == OAMDATAAddress));
+    if (spriteState)
+        lastEvent = event.time;
+}
+
+void ThreadedPPU::publish(i64 time) {
+    published = time;
+    target.store(time, std::memory_order_release);
+}
+
+void ThreadedPPU::run() {
+    i64 stepped = 0;
+    u64 count = 0;
+
+    while (running.load(std::memory_order_acquire))
+    {
+        // events pushed after this load are stamped at time or later
+        const i64 time = target.load(std::memory_order_acquire);
+        bool idle = true;
+
+        Event event;
+        while (events.pop(event))
+        {
+            ppu.step(nes_cycle_t(event.time));
+            apply(event);
+            processed.store(++count, std::memory_order_release);
+            idle = false;
+        }
+
+        if (stepped != time)
+        {
+            ppu.step(nes_cycle_t(time));
+            stepped = time;
+            reportSpriteStatus(time);
+            reached.store(time, std::memory_order_release);
+            idle = false;
+        }
+
+        if (idle)
+            std::this_thread::yield();
+    }
+}
+
+void ThreadedPPU::apply(const Event &event) {
+    switch (event.type) {
+        case EventType::Write: {
+            u8 value = event.value;
+            ppu.writeRegister(event.addr, value);
+            break;
+        }
+        case EventType::OAMDMA:
+            ppu.writeOAMDMA(event.addr, event.value);
+            break;
+        case EventType::ChrPage:
+            ppu.setChrPage(event.value, event.addr);
+            break;
+        case EventType::Mirroring:
+            ppu.setMirroring(nes_mapper_flags(event.value));
+            break;
+        case EventType::StatusRead:
+            ppu.readRegister(PPUSTATUSAddress);
+            break;
+    }
+}
+
+void ThreadedPPU::reportSpriteStatus(i64 time) {
+    const i64 steady = std::clamp<i64>(ppu.getSpriteFlagsSteadyUntil() - time, 0, 0x3ffff);
+    spriteStatus.store(u64(time) << 20 | u64(steady) << 2 | ppu.getSpriteFlags() >> 5, std::memory_order_release);
+}
+
+u8 ThreadedPPU::readStatus() {
+    const u8 status = (shadowLatch & 0x1f) | spriteFlags() | (shadowVblank ? Bit7 : 0);
+
+    // PPU::readRegister does the same to the PPU when the read reaches it
+    shadowVblank = false;
+    shadowLatch = status;
+    push(EventType::StatusRead, PPUSTATUSAddress, 0);
+
+    return status;
+}
+
+u8 ThreadedPPU::spriteFlags() {
+    const i64 time = now.count();
+
+    // the PPU got here, or what it reported earlier still holds because nothing since could change it
+    auto known = [&](u64 status) {
+        const i64 at = i64(status >> 20);
+        const i64 steady = i64(status >> 2) & 0x3ffff;
+        return at == time || (at > lastEvent && time < at + steady);
+    };
+
+    u64 status = spriteStatus.load(std::memory_order_acquire);
+    if (!known(status))
+    {
+        publish(time);
+        while (!known(status = spriteStatus.load(std::memory_order_acquire)))
+            std::this_thread::yield();
+    }
+
+    return u8(status & 0x3) << 5;
+}
+
+void ThreadedPPU::stepShadow() {
+    advanceShadow();
+
+    if (shadowScanline == 241 && shadowDot == 1)
+    {
+        shadowVblank = true;
+        if (shadowControl & Bit7)
+            sharedMemory->cpuLines.nmi = true;
+    }
+
+    // PPU::step clears it late on the last vblank line, and again on the pre-render line
+    if ((shadowScanline == 260 && shadowDot > 341 - 12) || (shadowScanline == 261 && shadowDot == 0))
+        shadowVblank = false;
+
+    // odd frames skip the last dot of the pre-render line
+    if (shadowScanline == 261 && shadowDot == 340 && shadowFrame % 2 == 1)
+        advanceShadow();
+}
+
+void ThreadedPPU::advanceShadow() {
+    shadowCycle += nes_cycle_t(1);
+
+    if (++shadowDot >= 341)
+    {
+        shadowDot = 0;
+        if (++shadowScanline >= 262)
+        {
+            shadowScanline = 0;
+            shadowFrame++;
+        }
+    }
+}
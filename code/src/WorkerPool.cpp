@@ -0,0 +1,98 @@
+#include "WorkerPool.h"
+
+#include <algorithm>
+
+WorkerPool::WorkerPool(u32 threads) {
+    if (threads == 0)
+    {
+        u32 cores = std::thread::hardware_concurrency();
+        threads = cores > 1 ? cores - 1 : 0;
+    }
+
+    for (u32 i = 0; i < threads; ++i)
+        workers.emplace_back(&WorkerPool::work, this);
+}
+
+WorkerPool::~WorkerPool() {
+    {
+        std::lock_guard lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+
+    for (auto& worker : workers)
+        worker.join();
+}
+
+u32 WorkerPool::size() const {
+    return workers.size() + 1;
+}
+
+void WorkerPool::run(u32 count, const std::function<void(u32)> &task) {
+    if (workers.empty() || count == 1)
+    {
+        for (u32 i = 0; i < count; ++i)
+            task(i);
+        return;
+    }
+
+    {
+        std::lock_guard lock(mutex);
+        this->task = &task;
+        this->count = count;
+        next.store(0, std::memory_order_relaxed);
+        active = workers.size();
+        generation++;
+    }
+    wake.notify_all();
+
+    drain();
+
+    std::unique_lock lock(mutex);
+    finished.wait(lock, [this] { return active == 0; });
+    this->task = null;
+}
+
+void WorkerPool::runSlices(u32 rows, const std::function<void(u32, u32)> &task) {
+    u32 slices = std::min<u32>(size() * 2, rows);
+    if (slices <= 1)
+    {
+        task(0, rows);
+        return;
+    }
+
+    u32 sliceRows = (rows + slices - 1) / slices;
+
+    run(slices, [&](u32 slice) {
+        u32 first = slice * sliceRows;
+        u32 last = std::min(first + sliceRows, rows);
+        if (first < last)
+            task(first, last);
+    });
+}
+
+void WorkerPool::work() {
+    u64 seen = 0;
+
+    while (true)
+    {
+        {
+            std::unique_lock lock(mutex);
+            wake.wait(lock, [&] { return stopping || generation != seen; });
+            if (stopping)
+                return;
+            seen = generation;
+        }
+
+        drain();
+
+        std::lock_guard lock(mutex);
+        if (--active == 0)
+            finished.notify_one();
+    }
+}
+
+void WorkerPool::drain() {
+    for (u32 i = next.fetch_add(1, std::memory_order_relaxed); i < count; i = next.fetch_add(1, std::memory_order_relaxed))
+        (*task)(i);
+}
@@ -0,0 +1,63 @@
+#include "sdl/AudioOutput.h"
+
+#include <string>
+
+#include "APU.h"
+#include "Logger.h"
+#include "Settings.h"
+
+AudioOutput::AudioOutput(APU *apu, u16 deviceSamples) : playback(apu, audioFrequency) {
+    this->apu = apu;
+
+    SDL_AudioSpec desired{};
+    desired.freq = audioFrequency;
+    desired.format = AUDIO_S16SYS;
+    desired.channels = 1;
+    desired.samples = deviceSamples;
+    desired.callback = callback;
+    desired.userdata = this;
+
+    // the device may round the chunk, it has to keep the rate and format the APU produces
+    device = SDL_OpenAudioDevice(null, 0, &desired, &obtained, SDL_AUDIO_ALLOW_SAMPLES_CHANGE);
+    if (device == 0)
+    {
+        ERRORLOG(std::string("Unable to open audio device! SDL_Error: ") + SDL_GetError());
+        return;
+    }
+
+    apu->setTargetFill(2 * obtained.samples);
+
+    INFOLOG("audio device " + std::to_string(device) + ", " + std::to_string(obtained.samples)
+        + " samples per chunk, buffer target " + std::to_string(apu->getTargetFill()) + " samples");
+
+    SDL_PauseAudioDevice(device, 0);
+}
+
+AudioOutput::~AudioOutput() {
+    if (device != 0)
+        SDL_CloseAudioDevice(device);
+}
+
+bool AudioOutput::isOpen() const {
+    return device != 0;
+}
+
+u16 AudioOutput::getDeviceSamples() const {
+    return obtained.samples;
+}
+
+float AudioOutput::getLatencyMs() const {
+    return playback.getLatencyMs();
+}
+
+float AudioOutput::getMaxLatencyMs() const {
+    return playback.getMaxLatencyMs();
+}
+
+u64 AudioOutput::getPrefills() const {
+    return playback.getPrefills();
+}
+
+void AudioOutput::callback(void *userdata, u8 *stream, int len) {
+    static_cast<AudioOutput*>(userdata)->playback.fill(reinterpret_cast<i16*>(stream), len / sizeof(i16));
+}
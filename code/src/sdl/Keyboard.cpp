@@ -0,0 +1,14 @@
+#include "sdl/Keyboard.h"
+
+#include <SDL_keyboard.h>
+
+u8 input::readKeyboard(const SDL_Scancode *keys) {
+    const u8* keyboard = SDL_GetKeyboardState(null);
+
+    u8 buttons = 0;
+    for (u8 i = 0; i < 8; ++i)
+        if (keyboard[keys[i]])
+            buttons |= 1 << i;
+
+    return buttons;
+}
@@ -0,0 +1,218 @@
+#include "sdl/Presenter.h"
+
+#include <algorithm>
+#include <cstring>
+
+Presenter::Presenter(SDL_Window *window)
+    : scaler(&pool), ntsc(&pool),
+      frames(IndexedFrame{std::vector<u8>(resolution.x * resolution.y, 0), std::vector<u8>(resolution.y, 0)}) {
+    pixels.resize(resolution.x * resolution.y, 0);
+
+    indexed = SDL_CreateRGBSurfaceWithFormat(0, resolution.x, resolution.y, 8, SDL_PIXELFORMAT_INDEX8);
+    rgba = SDL_CreateRGBSurfaceWithFormatFrom(pixels.data(), resolution.x, resolution.y, 32,
+                                              resolution.x * sizeof(u32), SDL_PIXELFORMAT_RGBA8888);
+    if (!indexed || !rgba)
+        ERRORLOG(std::string("Unable to create frame surfaces! SDL_Error: ") + SDL_GetError());
+
+    renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
+    vsync = renderer != null;
+
+    if (!renderer)
+    {
+        WARNLOG(std::string("No accelerated renderer, falling back to software: ") + SDL_GetError());
+        renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_SOFTWARE);
+    }
+
+    SDL_SetRenderDrawColor(renderer, 30, 30, 30, SDL_ALPHA_OPAQUE);
+    SDL_RenderClear(renderer);
+    SDL_RenderPresent(renderer);
+
+    setFilter(ScaleFilter::Nearest);
+}
+
+Presenter::~Presenter() {
+    if (rgba)
+        SDL_FreeSurface(rgba);
+    if (indexed)
+        SDL_FreeSurface(indexed);
+    if (texture)
+        SDL_DestroyTexture(texture);
+    if (renderer)
+        SDL_DestroyRenderer(renderer);
+}
+
+void Presenter::setFilter(ScaleFilter filter, u8 factor) {
+    scaler.setFilter(filter, factor);
+    createTexture();
+}
+
+void Presenter::setNtsc(bool enabled) {
+    ntscEnabled = enabled;
+    createTexture();
+}
+
+bool Presenter::isNtsc() const {
+    return ntscEnabled;
+}
+
+void Presenter::submit(const IndexedFrame& frame) {
+    IndexedFrame& back = frames.back();
+    std::copy_n(frame.pixels.begin(), std::min(frame.pixels.size(), back.pixels.size()), back.pixels.begin());
+    std::copy_n(frame.emphasis.begin(), std::min(frame.emphasis.size(), back.emphasis.size()), back.emphasis.begin());
+    back.palette = frame.palette;
+    back.number = frame.number;
+    back.stripes = frame.stripes;
+    back.hash = frame.hash;
+
+    if (!frames.publish())
+        dropped.fetch_add(1, std::memory_order_relaxed);
+    submitted.fetch_add(1, std::memory_order_relaxed);
+}
+
+bool Presenter::present() {
+    if (frames.update())
+    {
+        const IndexedFrame& frame = frames.front();
+
+        if (shown.matches(frame, ntscEnabled))
+        {
+            unchanged.fetch_add(1, std::memory_order_relaxed);
+            return false;
+        }
+
+        upload();
+    }
+    else
+    {
+        // without vsync a repeat would only spin, with it the present paces this thread
+        if (!vsync || !shown.isSet())
+            return false;
+
+        repeated.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    SDL_RenderClear(renderer);
+    SDL_RenderCopy(renderer, texture, null, null);
+    SDL_RenderPresent(renderer);
+
+    presented.fetch_add(1, std::memory_order_relaxed);
+    return true;
+}
+
+u64 Presenter::getFramesSubmitted() const {
+    return submitted.load(std::memory_order_relaxed);
+}
+
+u64 Presenter::getFramesPresented() const {
+    return presented.load(std::memory_order_relaxed);
+}
+
+u64 Presenter::getFramesDropped() const {
+    return dropped.load(std::memory_order_relaxed);
+}
+
+u64 Presenter::getFramesRepeated() const {
+    return repeated.load(std::memory_order_relaxed);
+}
+
+u64 Presenter::getFramesUnchanged() const {
+    return unchanged.load(std::memory_order_relaxed);
+}
+
+void Presenter::createTexture() {
+    const u8 factor = ntscEnabled ? NtscFilter::factor : scaler.getFactor();
+
+    if (texture)
+        SDL_DestroyTexture(texture);
+
+    texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_RGBA8888, SDL_TEXTUREACCESS_STREAMING,
+                                resolution.x * factor, resolution.y * factor);
+    if (!texture)
+        ERRORLOG(std::string("Unable to create texture! SDL_Error: ") + SDL_GetError());
+
+    // the alpha channel is not part of the picture
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_NONE);
+
+    // the new texture holds nothing, all of the shown frame goes up again
+    if (shown.isSet())
+    {
+        shown = ShownFrame();
+        upload();
+    }
+}
+
+void Presenter::loadIndexed(const IndexedFrame &frame) {
+    SDL_Color colors[256];
+    for (u16 i = 0; i < 256; ++i)
+        colors[i] = {frame.palette[i].r, frame.palette[i].g, frame.palette[i].b, SDL_ALPHA_OPAQUE};
+    SDL_SetPaletteColors(indexed->format->palette, colors, 0, 256);
+
+    for (u16 y = 0; y < resolution.y; ++y)
+        memcpy(static_cast<u8*>(indexed->pixels) + y * indexed->pitch, &frame.pixels[y * resolution.x], resolution.x);
+}
+
+void Presenter::upload() {
+    const IndexedFrame& frame = frames.front();
+    const u32 changed = shown.changedStripes(frame);
+    shown.show(frame);
+
+    if (ntscEnabled)
+    {
+        void* target = null;
+        int pitch = 0;
+        if (SDL_LockTexture(texture, null, &target, &pitch) != 0)
+            return;
+
+        ntsc.filter(frame.pixels.data(), frame.emphasis.data(), resolution.x, resolution.y, frame.number,
+                    static_cast<u32*>(target), pitch / sizeof(u32));
+        SDL_UnlockTexture(texture);
+        return;
+    }
+
+    loadIndexed(frame);
+
+    if (scaler.getFilter() == ScaleFilter::Nearest && scaler.getFactor() == 1 && changed != (1u << stripeCount) - 1)
+    {
+        // equal stripe hashes are equal colours, only runs of changed stripes go up to the texture
+        for (u8 first = 0; first < stripeCount; ++first)
+        {
+            if (!(changed & (1u << first)))
+                continue;
+
+            u8 last = first;
+            while (last + 1 < stripeCount && (changed & (1u << (last + 1))))
+                ++last;
+
+            const SDL_Rect rect{0, first * stripeHeight, resolution.x, (last - first + 1) * stripeHeight};
+            SDL_Rect blitRect = rect;
+            SDL_BlitSurface(indexed, &rect, rgba, &blitRect);
+            SDL_UpdateTexture(texture, &rect, &pixels[rect.y * resolution.x], resolution.x * sizeof(u32));
+
+            first = last;
+        }
+        return;
+    }
+
+    if (scaler.getFilter() == ScaleFilter::Nearest && scaler.getFactor() == 1)
+    {
+        // expanded straight into the texture memory
+        SDL_Surface* target = null;
+        if (SDL_LockTextureToSurface(texture, null, &target) != 0)
+            return;
+
+        SDL_BlitSurface(indexed, null, target, null);
+        SDL_UnlockTexture(texture);
+        return;
+    }
+
+    SDL_BlitSurface(indexed, null, rgba, null);
+
+    // scaled straight into the texture memory
+    void* target = null;
+    int pitch = 0;
+    if (SDL_LockTexture(texture, null, &target, &pitch) != 0)
+        return;
+
+    scaler.scale(pixels.data(), resolution.x, resolution.y, static_cast<u32*>(target), pitch / sizeof(u32));
+    SDL_UnlockTexture(texture);
+}
@@ -0,0 +1,18 @@
+#ifndef TEMPPATH_H
+#define TEMPPATH_H
+
+#include <filesystem>
+#include <random>
+#include <string>
+
+#include <gtest/gtest.h>
+
+// a file in the test temp directory named after the running test with a random tag, so suites run in
+// parallel (ctest -j, several test binaries) never share one
+inline std::string tempPath(const std::string& name) {
+    const std::string prefix = std::string(testing::UnitTest::GetInstance()->current_test_info()->name())
+        + "_" + std::to_string(std::random_device()()) + "_";
+    return (std::filesystem::path(testing::TempDir()) / (prefix + name)).string();
+}
+
+#endif //TEMPPATH_H
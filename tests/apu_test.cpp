@@ -0,0 +1,395 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <random>
+#include <utility>
+
+#include "APU.h"
+#include "AudioRecorder.h"
+#include "BatchAPU.h"
+#include "CPU.h"
+#include "Memory.h"
+#include "Settings.h"
+#include "TempPath.h"
+
+TEST(APUTest, statusReportsNoiseAndDmc) {
+    Memory memory(ramSize);
+    memory.init();
+    APU apu(&memory);
+
+    memory.write(0x4015, 0x08);
+    memory.write(0x400C, 0x3f);
+    memory.write(0x400E, 0x04);
+    memory.write(0x400F, 0x08);
+    EXPECT_EQ(memory.read(0x4015), 0x08);
+
+    // 17 bytes at the fastest rate, IRQ at the end
+    memory.write(0x4010, 0x8f);
+    memory.write(0x4012, 0x00);
+    memory.write(0x4013, 0x01);
+    memory.write(0x4015, 0x18);
+    EXPECT_EQ(memory.read(0x4015), 0x18);
+
+    for (i64 c = 1; c <= 6 * 20000; ++c)
+        apu.step(nes_cycle_t(c));
+
+    // 17 bytes at 27 APU cycles per bit are long gone, the IRQ stays until $4015 is written
+    EXPECT_EQ(memory.read(0x4015), 0x88);
+    EXPECT_EQ(memory.read(0x4015), 0x88);
+    memory.write(0x4015, 0x08);
+    EXPECT_EQ(memory.read(0x4015), 0x08);
+}
+
+TEST(APUTest, largeStepsMatchPerCycleStepping) {
+    Memory cycleMemory(ramSize), jumpMemory(ramSize);
+    cycleMemory.init();
+    jumpMemory.init();
+    APU perCycle(&cycleMemory);
+    APU jumping(&jumpMemory);
+
+    std::mt19937 rng(39);
+    const u16 registers[] = {0x4000, 0x4001, 0x4002, 0x4003, 0x4004, 0x4005, 0x4006, 0x4007, 0x4008, 0x400A,
+                             0x400B, 0x400C, 0x400E, 0x400F, 0x4010, 0x4011, 0x4012, 0x4013, 0x4015, 0x4017};
+
+    // one steps through every master cycle, the other straight to the next write or read, which can be
+    // past several frame counter steps and timer reloads
+    i64 c = 0;
+    // the IRQ line is only a flag, a jump sees whether it was raised somewhere along the way
+    u32 cycleStalls = 0, jumpStalls = 0, irqs = 0;
+    for (u32 n = 0; n < 4000; ++n)
+    {
+        const i64 target = c + 1 + (rng() % 4 == 0 ? rng() % 200000 : rng() % 2000);
+        bool cycleIRQ = false;
+        for (++c; c <= target; ++c)
+        {
+            perCycle.step(nes_cycle_t(c));
+            cycleStalls += std::exchange(cycleMemory.cpuLines.stall, u16(0));
+            cycleIRQ |= std::exchange(cycleMemory.cpuLines.irq, false);
+        }
+        c = target;
+        jumping.step(nes_cycle_t(c));
+        jumpStalls += std::exchange(jumpMemory.cpuLines.stall, u16(0));
+        const bool jumpIRQ = std::exchange(jumpMemory.cpuLines.irq, false);
+
+        ASSERT_EQ(perCycle.getLevel(), jumping.getLevel()) << "cycle " << c;
+        ASSERT_EQ(cycleStalls, jumpStalls) << "cycle " << c;
+        ASSERT_EQ(cycleIRQ, jumpIRQ) << "cycle " << c;
+        irqs += jumpIRQ;
+
+        if (rng() % 3 == 0)
+        {
+            ASSERT_EQ(cycleMemory.read(0x4015), jumpMemory.read(0x4015)) << "cycle " << c;
+            continue;
+        }
+
+        const u16 addr = registers[rng() % std::size(registers)];
+        u8 val = u8(rng());
+        if (addr == 0x4013)
+            val &= 0x03;
+        if (addr == 0x4017)
+            val &= Bit6 | Bit7;
+        // mostly keep the channels on, timers that ran while they were silent decide how they come back
+        if (addr == 0x4015 && rng() % 4 != 0)
+            val |= 0x0f;
+
+        cycleMemory.write(addr, val);
+        cycleStalls += std::exchange(cycleMemory.cpuLines.stall, u16(0));
+        jumpMemory.write(addr, val);
+        jumpStalls += std::exchange(jumpMemory.cpuLines.stall, u16(0));
+        ASSERT_EQ(std::exchange(cycleMemory.cpuLines.irq, false), std::exchange(jumpMemory.cpuLines.irq, false))
+            << "cycle " << c;
+        ASSERT_EQ(perCycle.getLevel(), jumping.getLevel()) << "cycle " << c;
+    }
+
+    EXPECT_GT(cycleStalls, 0u);
+    EXPECT_GT(irqs, 0u);
+}
+
+TEST(APUTest, timingOnlyMatchesFullEmulation) {
+    Memory fullMemory(ramSize), timingMemory(ramSize);
+    fullMemory.init();
+    timingMemory.init();
+    APU full(&fullMemory);
+    APU timing(&timingMemory);
+    timing.setTimingOnly(true);
+
+    std::mt19937 rng(45);
+    // channel registers, $4015 and $4017, DMC samples stay short so they finish and raise their IRQ
+    const u16 registers[] = {0x4000, 0x4001, 0x4002, 0x4003, 0x4004, 0x4005, 0x4006, 0x4007, 0x4008, 0x400A,
+                             0x400B, 0x400C, 0x400E, 0x400F, 0x4010, 0x4011, 0x4012, 0x4013, 0x4015, 0x4017};
+
+    u32 stalls = 0, irqs = 0;
+    for (i64 c = 1; c <= 6 * 200000; ++c)
+    {
+        // DMC fetches stall the CPU and IRQs are raised on the same cycles in both
+        full.step(nes_cycle_t(c));
+        timing.step(nes_cycle_t(c));
+        const u16 fullStall = std::exchange(fullMemory.cpuLines.stall, u16(0));
+        const bool fullIRQ = std::exchange(fullMemory.cpuLines.irq, false);
+        ASSERT_EQ(fullStall, std::exchange(timingMemory.cpuLines.stall, u16(0))) << "cycle " << c;
+        ASSERT_EQ(fullIRQ, std::exchange(timingMemory.cpuLines.irq, false)) << "cycle " << c;
+        stalls += fullStall > 0;
+        irqs += fullIRQ;
+
+        if (c % 997 == 0)
+        {
+            const u16 addr = registers[rng() % std::size(registers)];
+            u8 val = u8(rng());
+            if (addr == 0x4013)
+                val &= 0x03;
+            if (addr == 0x4017)
+                val &= Bit6;
+
+            // enabling the DMC fetches its first byte right away
+            fullMemory.write(addr, val);
+            timingMemory.write(addr, val);
+            const u16 writeStall = std::exchange(fullMemory.cpuLines.stall, u16(0));
+            ASSERT_EQ(writeStall, std::exchange(timingMemory.cpuLines.stall, u16(0))) << "cycle " << c;
+            ASSERT_EQ(std::exchange(fullMemory.cpuLines.irq, false), std::exchange(timingMemory.cpuLines.irq, false))
+                << "cycle " << c;
+            stalls += writeStall > 0;
+        }
+
+        if (c % 89 == 0)
+        {
+            ASSERT_EQ(fullMemory.read(0x4015), timingMemory.read(0x4015)) << "cycle " << c;
+        }
+    }
+
+    // the writes did get the DMC fetching and raising IRQs
+    EXPECT_GT(stalls, 0u);
+    EXPECT_GT(irqs, 0u);
+}
+
+TEST(APUTest, batchMatchesScalarInstances) {
+    // not a multiple of the vector width, the padding lanes must not matter
+    constexpr u32 instances = 6;
+    std::vector<std::unique_ptr<Memory>> memories;
+    std::vector<std::unique_ptr<APU>> apus;
+    for (u32 i = 0; i < instances; ++i)
+    {
+        memories.push_back(std::make_unique<Memory>(ramSize));
+        memories.back()->init();
+        apus.push_back(std::make_unique<APU>(memories.back().get()));
+    }
+    // the SSE2 path and the scalar fallback, both against the APUs
+    BatchAPU batch(instances), scalarBatch(instances);
+    scalarBatch.setVectorized(false);
+
+    std::mt19937 rng(48);
+    // no DMC sample playback in the batch, only its level
+    const u16 registers[] = {0x4000, 0x4001, 0x4002, 0x4003, 0x4004, 0x4005, 0x4006, 0x4007, 0x4008, 0x400A,
+                             0x400B, 0x400C, 0x400E, 0x400F, 0x4011, 0x4015, 0x4017};
+    std::array<i16, instances> levels{}, scalarLevels{};
+
+    // stretches of random length, up to well past a frame counter step
+    i64 c = 0;
+    for (u32 n = 0; n < 3000; ++n)
+    {
+        c += 1 + rng() % 20000;
+        batch.run(u32(c - batch.getCycle()));
+        scalarBatch.run(u32(c - scalarBatch.getCycle()));
+        for (auto& apu : apus)
+            apu->step(nes_cycle_t(6 * c));
+
+        batch.mix(levels.data());
+        scalarBatch.mix(scalarLevels.data());
+        for (u32 i = 0; i < instances; ++i)
+        {
+            ASSERT_EQ(levels[i], apus[i]->getLevel()) << "instance " << i << " cycle " << c;
+            ASSERT_EQ(scalarLevels[i], apus[i]->getLevel()) << "scalar instance " << i << " cycle " << c;
+            const u8 status = memories[i]->read(0x4015);
+            ASSERT_EQ(batch.readStatus(i), status) << "instance " << i << " cycle " << c;
+            ASSERT_EQ(scalarBatch.readStatus(i), status) << "scalar instance " << i << " cycle " << c;
+        }
+
+        for (u32 w = rng() % 8; w > 0; --w)
+        {
+            const u32 i = rng() % instances;
+            const u16 addr = registers[rng() % std::size(registers)];
+            u8 val = u8(rng());
+            if (addr == 0x4015)
+                val &= 0x0f;
+            if (addr == 0x4017)
+                val &= Bit6;
+
+            memories[i]->write(addr, val);
+            batch.write(i, addr, val);
+            scalarBatch.write(i, addr, val);
+        }
+    }
+}
+
+TEST(APUTest, longStepKeepsEverySample) {
+    // blip buffer and resampler
+    for (const bool resample : {false, true})
+    {
+        const std::string path = tempPath("apu_test.raw");
+
+        Memory memory(ramSize);
+        memory.init();
+        APU apu(&memory);
+        if (resample)
+            apu.setResampler(ResampleQuality::Medium);
+
+        // a pulse playing, so the flush has something to say
+        memory.write(0x4015, 0x01);
+        memory.write(0x4000, 0xbf);
+        memory.write(0x4002, 0xfd);
+        memory.write(0x4003, 0x08);
+
+        AudioRecorder recorder(path, AudioRecorder::formatFor(path), audioFrequency);
+        ASSERT_TRUE(recorder.isOpen());
+        apu.setRecorder(&recorder);
+
+        // a tenth of a second in one step, five times what the blip buffer holds
+        apu.step(nes_cycle_t(NES_CLOCK_HZ / 10));
+        apu.setRecorder(null);
+        recorder.close();
+        std::filesystem::remove(path);
+
+        // all of it but the part of a flush still pending and what the kernel holds back
+        EXPECT_GT(recorder.getSamplesWritten(), audioFrequency / 10 - audioFrequency / 240 - 64) << "resample " << resample;
+        EXPECT_EQ(recorder.getDropped(), 0u) << "resample " << resample;
+    }
+}
+
+TEST(APUTest, maskedIrqIsTakenAfterCli) {
+    CPU cpu;
+    cpu.init();
+    Memory& memory = *cpu.getMemory();
+    APU apu(&memory);
+
+    // SEI, frame IRQ on, a delay well past the first frame IRQ, then CLI and spin
+    const u8 program[] = {
+        0x78,             // SEI
+        0xa9, 0x00,       // LDA #$00
+        0x8d, 0x17, 0x40, // STA $4017
+        0xa0, 0x60,       // LDY #$60
+        0xa2, 0x00,       // LDX #$00
+        0xca,             // DEX
+        0xd0, 0xfd,       // BNE -3
+        0x88,             // DEY
+        0xd0, 0xf8,       // BNE -8
+        0x58,             // CLI
+        0x4c, 0x11, 0x80, // JMP $8011
+    };
+    // acknowledge, keep the status, no more frame IRQs and count the entries
+    const u8 handler[] = {
+        0xad, 0x15, 0x40, // LDA $4015
+        0x85, 0x00,       // STA $00
+        0xa9, 0x40,       // LDA #$40
+        0x8d, 0x17, 0x40, // STA $4017
+        0xe6, 0x01,       // INC $01
+        0x40,             // RTI
+    };
+    for (u16 i = 0; i < std::size(program); ++i)
+        memory.write(0x8000 + i, program[i]);
+    for (u16 i = 0; i < std::size(handler); ++i)
+        memory.write(0x9000 + i, handler[i]);
+    memory.write(0xfffe, 0x00);
+    memory.write(0xffff, 0x90);
+    cpu.getRegisters()->PC = 0x8000;
+
+    auto run = [&](i64 from, i64 to) {
+        for (i64 c = from; c <= to; ++c)
+        {
+            cpu.step(nes_cycle_t(c));
+            apu.step(nes_cycle_t(c));
+        }
+    };
+
+    // the frame IRQ is raised while the delay, about 370000 master cycles, still runs with I set
+    run(1, 300000);
+    EXPECT_EQ(memory.read(0x0000), 0);
+    EXPECT_EQ(memory.read(0x0001), 0);
+
+    // taken once after CLI
+    run(300001, 420000);
+    EXPECT_EQ(memory.read(0x0001), 1);
+    EXPECT_EQ(memory.read(0x0000) & Bit6, Bit6);
+}
+
+TEST(APUTest, rateControlSettlesOnADriftingDevice) {
+    // a device a little fast and one a little slow, well inside what rate control may take up
+    for (const double drift : {0.004, -0.004})
+    {
+        Memory memory(ramSize);
+        memory.init();
+        APU apu(&memory);
+        apu.setRateControl(true);
+
+        constexpr u32 seconds = 60;
+        constexpr u32 flushesPerSecond = 240;
+        const nes_cycle_t flush(NES_CLOCK_HZ / flushesPerSecond);
+
+        // the device pulls fixed chunks once it has been primed with the target fill
+        i16 chunk[audioDeviceSamples];
+        double owed = 0;
+        bool playing = false;
+        u64 underrunsAtStart = 0;
+        float minRatio = 2, maxRatio = 0;
+
+        for (u32 n = 1; n <= seconds * flushesPerSecond; ++n)
+        {
+            apu.step(flush * n);
+
+            if (!playing && apu.getQueuedSamples() >= apu.getTargetFill())
+            {
+                playing = true;
+                underrunsAtStart = apu.getUnderruns();
+            }
+            if (playing)
+                owed += double(audioFrequency) / flushesPerSecond * (1 + drift);
+            for (; owed >= audioDeviceSamples; owed -= audioDeviceSamples)
+                apu.readSamples(chunk, audioDeviceSamples);
+
+            minRatio = std::min(minRatio, apu.getRateRatio());
+            maxRatio = std::max(maxRatio, apu.getRateRatio());
+        }
+
+        EXPECT_TRUE(playing);
+        EXPECT_EQ(apu.getUnderruns(), underrunsAtStart) << "drift " << drift;
+        EXPECT_GE(minRatio, 1 - audioMaxRateDelta) << "drift " << drift;
+        EXPECT_LE(maxRatio, 1 + audioMaxRateDelta) << "drift " << drift;
+        // the ratio took up the drift and the fill is back near the target
+        EXPECT_NEAR(apu.getRateRatio(), 1 + drift, 0.001) << "drift " << drift;
+        EXPECT_NEAR(apu.getBufferFill(), float(apu.getTargetFill()), apu.getTargetFill() * 0.15f) << "drift " << drift;
+    }
+}
+
+TEST(APUTest, mixerFollowsTheLookupTables) {
+    using namespace apu;
+
+    // https://www.nesdev.org/wiki/APU_Mixer#Lookup_Table, straight from the formulas
+    const auto pulse = [](u32 n) { return n == 0 ? 0.0 : 95.52 / (8128.0 / n + 100); };
+    const auto tnd = [](u32 n) { return n == 0 ? 0.0 : 163.67 / (24329.0 / n + 100); };
+
+    EXPECT_EQ(pulseMixTable[0], 0);
+    EXPECT_EQ(tndMixTable[0], 0);
+    for (u32 n : {1u, 15u, 30u})
+        EXPECT_NEAR(pulseMixTable[n], pulse(n) * 32767, 0.5) << "pulse " << n;
+    for (u32 n : {1u, 45u, 127u, 202u})
+        EXPECT_NEAR(tndMixTable[n], tnd(n) * 32767, 0.5) << "tnd " << n;
+
+    // not linear, a louder channel adds less on top of the others
+    EXPECT_LT(pulseMixTable[30] - pulseMixTable[29], pulseMixTable[1] - pulseMixTable[0]);
+    EXPECT_LT(tndMixTable[202] - tndMixTable[201], tndMixTable[1] - tndMixTable[0]);
+
+    // everything at full is just under full scale, as i16 and as the [-1, 1] floats readSamples gives
+    const i32 full = pulseMixTable[30] + tndMixTable[202];
+    EXPECT_EQ(full, 8438 + 24328);
+    EXPECT_LE(full, 32767);
+    EXPECT_GT(full * (1.0f / 32768), 0.9999f);
+    EXPECT_LT(full * (1.0f / 32768), 1.0f);
+
+    // the DMC alone through $4011, the level is its entry
+    Memory memory(ramSize);
+    memory.init();
+    APU apu(&memory);
+    EXPECT_EQ(apu.getLevel(), 0);
+    memory.write(0x4011, 0x7f);
+    EXPECT_EQ(apu.getLevel(), tndMixTable[127]);
+    memory.write(0x4011, 0x20);
+    EXPECT_EQ(apu.getLevel(), tndMixTable[32]);
+}
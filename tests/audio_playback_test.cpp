@@ -0,0 +1,84 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+
+#include "APU.h"
+#include "AudioPlayback.h"
+#include "Memory.h"
+#include "Settings.h"
+
+namespace {
+    // emulates until at least count samples wait in the APU buffer
+    void queue(APU& apu, nes_cycle_t& cycle, size_t count) {
+        while (apu.getQueuedSamples() < count)
+        {
+            cycle += nes_cycle_t(NES_CLOCK_HZ / 240);
+            apu.step(cycle);
+        }
+    }
+}
+
+TEST(AudioPlaybackTest, primesAtStartAndAfterADrain) {
+    Memory memory(ramSize);
+    memory.init();
+    APU apu(&memory);
+    apu.setTargetFill(1024);
+
+    // a pulse playing, so what plays can be told from the held sample
+    memory.write(0x4015, 0x01);
+    memory.write(0x4000, 0xbf);
+    memory.write(0x4002, 0xfd);
+    memory.write(0x4003, 0x08);
+
+    AudioPlayback playback(&apu, audioFrequency);
+    i16 chunk[512];
+    nes_cycle_t cycle(0);
+
+    // nothing until the buffer holds the target, the start counts as a prefill
+    queue(apu, cycle, 512);
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_TRUE(playback.isPriming());
+    EXPECT_TRUE(std::all_of(std::begin(chunk), std::end(chunk), [](i16 s) { return s == 0; }));
+    EXPECT_EQ(playback.getPrefills(), 1u);
+    EXPECT_EQ(playback.getLatencyMs(), 0);
+
+    // the newest sample plays after the queue and the chunk, the first measurement is taken as it is
+    queue(apu, cycle, 1024);
+    const size_t queued = apu.getQueuedSamples();
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_FALSE(playback.isPriming());
+    EXPECT_EQ(apu.getQueuedSamples(), queued - std::size(chunk));
+    const float latency = float(queued + std::size(chunk)) * 1000 / audioFrequency;
+    EXPECT_FLOAT_EQ(playback.getLatencyMs(), latency);
+    EXPECT_FLOAT_EQ(playback.getMaxLatencyMs(), latency);
+
+    // later ones are smoothed, the max keeps the worst
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_LT(playback.getLatencyMs(), latency);
+    EXPECT_GT(playback.getLatencyMs(), float(apu.getQueuedSamples() + 2 * std::size(chunk)) * 1000 / audioFrequency);
+    EXPECT_FLOAT_EQ(playback.getMaxLatencyMs(), latency);
+
+    // drained, partial chunks still play while anything is queued
+    while (apu.getQueuedSamples() > 0)
+        playback.fill(chunk, std::size(chunk));
+    EXPECT_FALSE(playback.isPriming());
+    EXPECT_EQ(playback.getPrefills(), 1u);
+
+    // found empty, the last sample is held until the target is back
+    const i16 held = chunk[std::size(chunk) - 1];
+    const u64 underruns = apu.getUnderruns();
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_TRUE(playback.isPriming());
+    EXPECT_EQ(playback.getPrefills(), 2u);
+    EXPECT_TRUE(std::all_of(std::begin(chunk), std::end(chunk), [held](i16 s) { return s == held; }));
+
+    queue(apu, cycle, 512);
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_TRUE(playback.isPriming());
+    EXPECT_EQ(apu.getUnderruns(), underruns);
+
+    queue(apu, cycle, 1024);
+    playback.fill(chunk, std::size(chunk));
+    EXPECT_FALSE(playback.isPriming());
+    EXPECT_EQ(playback.getPrefills(), 2u);
+}
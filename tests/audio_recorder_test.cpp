@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <vector>
+
+#include "AudioRecorder.h"
+#include "TempPath.h"
+
+TEST(AudioRecorderTest, wavHoldsEverySubmittedSample) {
+    const std::string path = tempPath("audio_recorder_test.wav");
+
+    std::vector<i16> samples(100000);
+    for (size_t i = 0; i < samples.size(); ++i)
+        samples[i] = i16(i * 37);
+
+    {
+        AudioRecorder recorder(path, AudioRecorder::formatFor(path), 48000);
+        ASSERT_TRUE(recorder.isOpen());
+
+        for (size_t i = 0; i < samples.size(); i += 800)
+            recorder.submit(samples.data() + i, std::min<size_t>(800, samples.size() - i));
+
+        recorder.close();
+        EXPECT_EQ(recorder.getSamplesWritten(), samples.size());
+        EXPECT_EQ(recorder.getDropped(), 0u);
+    }
+
+    std::ifstream file(path, std::ifstream::binary);
+    std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+    file.close();
+    std::remove(path.c_str());
+
+    ASSERT_EQ(bytes.size(), 44 + samples.size() * sizeof(i16));
+    EXPECT_EQ(std::memcmp(bytes.data(), "RIFF", 4), 0);
+    EXPECT_EQ(std::memcmp(bytes.data() + 36, "data", 4), 0);
+
+    u32 dataBytes;
+    std::memcpy(&dataBytes, bytes.data() + 40, 4);
+    EXPECT_EQ(dataBytes, samples.size() * sizeof(i16));
+    EXPECT_EQ(std::memcmp(bytes.data() + 44, samples.data(), samples.size() * sizeof(i16)), 0);
+}
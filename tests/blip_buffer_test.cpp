@@ -0,0 +1,45 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <vector>
+
+#include "BlipBuffer.h"
+
+TEST(BlipBufferTest, stepsSettleAtTheirHeight) {
+    // a clock that isn't a multiple of the sample rate, like the console's
+    const double clockRate = 5369318;
+    BlipBuffer blip(clockRate, 48000, 4096);
+
+    blip.addDelta(1000, 1000);
+    blip.addDelta(30000, -400);
+    blip.endFrame(u64(clockRate / 100));
+
+    std::vector<i16> out(4096);
+    const u32 count = blip.read(out.data(), out.size());
+    EXPECT_NEAR(count, 480, 1);
+
+    // flat before, between and after the band-limited edges
+    EXPECT_EQ(out[0], 0);
+    EXPECT_EQ(out[100], 1000);
+    EXPECT_EQ(out[count - 1], 600);
+
+    // the edge rings a little but stays close to the step
+    for (u32 i = 0; i < 100; ++i)
+        EXPECT_LE(std::abs(out[i]), 1100);
+}
+
+TEST(BlipBufferTest, framesJoinWithoutGaps) {
+    BlipBuffer blip(1000000, 48000, 1024);
+    std::vector<i16> out(1024);
+    u64 total = 0;
+
+    // many short frames, the fractional sample positions carry over
+    for (int frame = 0; frame < 1000; ++frame)
+    {
+        blip.addDelta(0, frame % 2 ? -100 : 100);
+        blip.endFrame(997);
+        total += blip.read(out.data(), out.size());
+    }
+
+    EXPECT_NEAR(double(total), 997 * 1000 * 0.048, 1);
+}
@@ -0,0 +1,159 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+#include <thread>
+#include <vector>
+
+#include "APU.h"
+#include "Console.h"
+#include "TempPath.h"
+
+namespace {
+    std::string writeRom() {
+        const std::string path = tempPath("console_test.nes");
+
+        // NROM, 32KB PRG, 8KB CHR. Strobes the first controller, shifts its 8 bits into $00 and keeps the
+        // last complete byte in Y, forever. Bit 7 of the byte turns the NMI on, its handler never returns.
+        std::vector<u8> prg(0x8000, 0);
+        const std::vector<u8> program = {
+            0xa9, 0x01,             // loop: LDA #1
+            0x8d, 0x16, 0x40,       //       STA $4016
+            0xa9, 0x00,             //       LDA #0
+            0x8d, 0x16, 0x40,       //       STA $4016
+            0xa2, 0x08,             //       LDX #8
+            0xad, 0x16, 0x40,       // read: LDA $4016
+            0x4a,                   //       LSR A
+            0x26, 0x00,             //       ROL $00
+            0xca,                   //       DEX
+            0xd0, 0xf7,             //       BNE read
+            0xa4, 0x00,             //       LDY $00
+            0x98,                   //       TYA
+            0x29, 0x80,             //       AND #$80
+            0x8d, 0x00, 0x20,       //       STA $2000
+            0x4c, 0x00, 0x80,       //       JMP loop
+        };
+        std::copy(program.begin(), program.end(), prg.begin());
+        // nmi: JMP nmi
+        prg[0x100] = 0x4c;
+        prg[0x101] = 0x00;
+        prg[0x102] = 0x81;
+        prg[0x7ffa] = 0x00;
+        prg[0x7ffb] = 0x81;
+        prg[0x7ffc] = 0x00;
+        prg[0x7ffd] = 0x80;
+
+        const u8 header[16] = {'N', 'E', 'S', 0x1a, 2, 1};
+        std::ofstream file(path, std::ofstream::binary);
+        file.write((const char*)header, sizeof(header));
+        file.write((const char*)prg.data(), prg.size());
+        file.write(std::vector<char>(0x2000, 0).data(), 0x2000);
+        return path;
+    }
+}
+
+TEST(ConsoleTest, consolesOnSeparateThreadsRunIndependently) {
+    const std::string path = writeRom();
+
+    const u8 buttons[2] = {0x81, 0x5a};
+    u8 y[2] = {};
+    u32 frames[2] = {};
+    u64 hashes[2] = {};
+
+    std::vector<std::thread> threads;
+    for (u8 i = 0; i < 2; ++i)
+    {
+        threads.emplace_back([&, i] {
+            Console console;
+            ASSERT_TRUE(console.load(path));
+            console.setInput(0, buttons[i]);
+            for (u8 frame = 0; frame < 3; ++frame)
+                EXPECT_TRUE(console.runFrame());
+            y[i] = console.getRegisters()->Y;
+            frames[i] = console.getFrameCount();
+            hashes[i] = console.frame().hash;
+        });
+    }
+    for (auto& thread : threads)
+        thread.join();
+
+    for (u8 i = 0; i < 2; ++i)
+    {
+        EXPECT_EQ(y[i], buttons[i]);
+        EXPECT_EQ(frames[i], 3u);
+    }
+    // nothing was drawn, both show the same backdrop
+    EXPECT_EQ(hashes[0], hashes[1]);
+
+    std::filesystem::remove(path);
+}
+
+TEST(ConsoleTest, consolesOnOneThreadRunIndependently) {
+    const std::string path = writeRom();
+
+    // one takes its NMI and stays in the handler, the other never turns it on
+    const u8 buttons[2] = {0x81, 0x5a};
+    Console consoles[2];
+    for (u8 i = 0; i < 2; ++i)
+    {
+        ASSERT_TRUE(consoles[i].load(path));
+        consoles[i].setInput(0, buttons[i]);
+    }
+
+    // a cycle each, whatever one raises is pending while the other runs
+    for (u32 cycle = 0; cycle < 3 * 89342; ++cycle)
+        for (Console& console : consoles)
+            console.run(nes_cycle_t(1));
+
+    for (u8 i = 0; i < 2; ++i)
+        EXPECT_EQ(consoles[i].getRegisters()->Y, buttons[i]);
+    EXPECT_EQ(consoles[0].getRegisters()->PC, 0x8100);
+    EXPECT_LT(consoles[1].getRegisters()->PC, 0x8100);
+
+    std::filesystem::remove(path);
+}
+
+TEST(ConsoleTest, loadIsOneAttempt) {
+    const std::string path = writeRom();
+
+    // a failed load leaves a console that does nothing, but is safe to ask
+    Console failed;
+    EXPECT_FALSE(failed.load(tempPath("missing.nes")));
+    EXPECT_FALSE(failed.isLoaded());
+    EXPECT_FALSE(failed.runFrame());
+    EXPECT_EQ(failed.getFrameCount(), 0u);
+    EXPECT_TRUE(failed.frame().pixels.empty());
+    failed.audio().setTimingOnly(true);
+    failed.setInput(0, 0x80);
+    EXPECT_FALSE(failed.load(path));
+
+    Console console;
+    EXPECT_TRUE(console.load(path));
+    EXPECT_FALSE(console.load(path));
+    EXPECT_TRUE(console.runFrame());
+    EXPECT_EQ(console.getFrameCount(), 1u);
+
+    std::filesystem::remove(path);
+}
+
+TEST(ConsoleTest, threadedPPUMatchesSingleThreaded) {
+    const std::string path = writeRom();
+
+    Console single, threaded;
+    EXPECT_TRUE(threaded.setThreadedPPU(true));
+    for (Console* console : {&single, &threaded})
+    {
+        ASSERT_TRUE(console->load(path));
+        console->setInput(0, 0xa5);
+        for (u8 frame = 0; frame < 3; ++frame)
+            EXPECT_TRUE(console->runFrame());
+    }
+    EXPECT_FALSE(threaded.setThreadedPPU(false));
+
+    EXPECT_EQ(threaded.getFrameCount(), single.getFrameCount());
+    EXPECT_EQ(threaded.getCycle(), single.getCycle());
+    EXPECT_EQ(threaded.getRegisters()->Y, single.getRegisters()->Y);
+    EXPECT_EQ(threaded.frame().hash, single.frame().hash);
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,46 @@
+#include <gtest/gtest.h>
+
+#include <filesystem>
+#include <fstream>
+
+#include "Controller.h"
+#include "InputMovie.h"
+#include "Memory.h"
+#include "NESHelpers.h"
+#include "Settings.h"
+#include "TempPath.h"
+
+TEST(InputMovieTest, fm2FramesDriveTheController) {
+    const std::string path = tempPath("input_movie_test.fm2");
+    {
+        std::ofstream file(path);
+        file << "version 3\nemuVersion 22020\nport0 1\n";
+        file << "|0|........|........||\n";
+        file << "|0|R......A|.L..T...||\n";
+        file << "|1|   U  B |........||\n";
+    }
+
+    InputMovie movie;
+    ASSERT_TRUE(movie.load(path));
+    ASSERT_EQ(movie.getFrameCount(), 3u);
+    EXPECT_EQ(movie.getButtons(0, 0), 0x00);
+    EXPECT_EQ(movie.getButtons(1, 0), 0x81);
+    EXPECT_EQ(movie.getButtons(1, 1), 0x12);
+    EXPECT_EQ(movie.getButtons(2, 0), 0x48);
+    EXPECT_EQ(movie.getButtons(3, 0), 0x00);
+
+    Memory memory(ramSize);
+    memory.init();
+    Controller p1(&memory, input::p1);
+    p1.setButtonState(movie.getButtons(1, 0));
+
+    // strobe, then A, B, Select, Start, Up, Down, Left, Right
+    memory.write(input::p1, 1);
+    memory.write(input::p1, 0);
+    u8 reads = 0;
+    for (u8 i = 0; i < 8; ++i)
+        reads = (reads << 1) | (memory.read(input::p1) & 1);
+    EXPECT_EQ(reads, 0x81);
+
+    std::filesystem::remove(path);
+}
@@ -0,0 +1,95 @@
+#include <gtest/gtest.h>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <thread>
+#include <vector>
+
+#include "AudioRecorder.h"
+#include "Nsf.h"
+#include "Settings.h"
+#include "TempPath.h"
+
+namespace {
+    // INIT starts a square wave with the track number as the pitch, PLAY bends it every call
+    std::string writeTune() {
+        const u8 init[] = {
+            0x0A, 0x0A, 0x69, 0x40,       // ASL, ASL, ADC #$40
+            0x85, 0x00, 0x8D, 0x02, 0x40, // STA $00, STA $4002
+            0xA9, 0xBF, 0x8D, 0x00, 0x40, // LDA #$BF, STA $4000
+            0xA9, 0x00, 0x8D, 0x03, 0x40, // LDA #$00, STA $4003
+            0x60,                         // RTS
+        };
+        const u8 play[] = {
+            0xE6, 0x00, 0xA5, 0x00,       // INC $00, LDA $00
+            0x8D, 0x02, 0x40,             // STA $4002
+            0x60,                         // RTS
+        };
+
+        std::vector<u8> file(0x80, 0);
+        std::memcpy(file.data(), "NESM\x1A", 5);
+        file[0x05] = 1;
+        file[0x06] = 4;
+        file[0x07] = 1;
+        const u16 playAddress = 0x8000 + sizeof(init);
+        const u16 addresses[] = {0x8000, 0x8000, playAddress, 16639};
+        for (u8 i = 0; i < 3; ++i)
+        {
+            file[0x08 + i * 2] = addresses[i] & 0xFF;
+            file[0x09 + i * 2] = addresses[i] >> 8;
+        }
+        file[0x6E] = addresses[3] & 0xFF;
+        file[0x6F] = addresses[3] >> 8;
+        file.insert(file.end(), std::begin(init), std::end(init));
+        file.insert(file.end(), std::begin(play), std::end(play));
+
+        const std::string path = tempPath("tune.nsf");
+        std::ofstream(path, std::ofstream::binary).write(reinterpret_cast<const char*>(file.data()), file.size());
+        return path;
+    }
+
+    std::vector<char> render(const Nsf& nsf, u8 track, const std::string& path) {
+        {
+            AudioRecorder recorder(path, AudioRecorder::Format::Raw, audioFrequency, AudioRecorder::Overflow::Wait);
+            NsfPlayer player(nsf);
+            EXPECT_TRUE(player.render(track, 2, &recorder));
+        }
+
+        std::ifstream file(path, std::ifstream::binary);
+        std::vector<char> bytes((std::istreambuf_iterator<char>(file)), std::istreambuf_iterator<char>());
+        file.close();
+        std::filesystem::remove(path);
+        return bytes;
+    }
+}
+
+TEST(NsfTest, tracksRenderTheSameOnParallelThreads) {
+    Nsf nsf;
+    const std::string tune = writeTune();
+    const bool loaded = nsf.load(tune);
+    std::filesystem::remove(tune);
+    ASSERT_TRUE(loaded);
+    ASSERT_EQ(nsf.getTrackCount(), 4);
+
+    std::vector<std::vector<char>> serial(nsf.getTrackCount());
+    for (u8 track = 0; track < nsf.getTrackCount(); ++track)
+        serial[track] = render(nsf, track, tempPath("serial.raw"));
+
+    // two seconds, a sample flush or two short
+    EXPECT_GT(serial[0].size(), 2 * audioFrequency * sizeof(i16) * 99 / 100);
+    EXPECT_NE(serial[0], serial[1]);
+
+    std::vector<std::vector<char>> parallel(nsf.getTrackCount());
+    std::vector<std::thread> threads;
+    for (u8 track = 0; track < nsf.getTrackCount(); ++track)
+        threads.emplace_back([&, track] {
+            parallel[track] = render(nsf, track, tempPath(std::to_string(track) + ".raw"));
+        });
+    for (auto& thread : threads)
+        thread.join();
+
+    for (u8 track = 0; track < nsf.getTrackCount(); ++track)
+        EXPECT_EQ(parallel[track], serial[track]) << "track " << int(track);
+}
@@ -0,0 +1,50 @@
+#include <gtest/gtest.h>
+
+#include <array>
+
+#include "NtscFilter.h"
+#include "WorkerPool.h"
+
+namespace {
+    u8 red(u32 pixel) { return pixel >> 24; }
+    u8 green(u32 pixel) { return pixel >> 16; }
+    u8 blue(u32 pixel) { return pixel >> 8; }
+}
+
+TEST(NtscTest, flatColoursDecodeToTheirHue) {
+    const u16 width = 64, height = 8;
+    // grey, red ($16), green ($2a), blue ($12) side by side, the last line with red emphasis
+    std::vector<u8> indices(width * height);
+    for (u16 y = 0; y < height; ++y)
+        for (u16 x = 0; x < width; ++x)
+            indices[y * width + x] = std::array<u8, 4>{0x10, 0x16, 0x2a, 0x12}[x / 16];
+    std::vector<u8> emphasis(height, 0);
+    emphasis[height - 1] = 0x1;
+
+    WorkerPool pool;
+    NtscFilter ntsc(&pool);
+    const u32 pitch = width * NtscFilter::factor;
+    std::vector<u32> dst(pitch * height * NtscFilter::factor);
+    ntsc.filter(indices.data(), emphasis.data(), width, height, 0, dst.data(), pitch);
+
+    // middle of each 16 pixel block on the first line
+    auto at = [&](u16 block, u16 line) { return dst[line * NtscFilter::factor * pitch + block * 32 + 16]; };
+
+    u32 grey = at(0, 0);
+    EXPECT_NEAR(red(grey), green(grey), 8);
+    EXPECT_NEAR(green(grey), blue(grey), 8);
+
+    EXPECT_GT(red(at(1, 0)), green(at(1, 0)));
+    EXPECT_GT(red(at(1, 0)), blue(at(1, 0)));
+    EXPECT_GT(green(at(2, 0)), red(at(2, 0)));
+    EXPECT_GT(green(at(2, 0)), blue(at(2, 0)));
+    EXPECT_GT(blue(at(3, 0)), red(at(3, 0)));
+    EXPECT_GT(blue(at(3, 0)), green(at(3, 0)));
+
+    // red emphasis darkens green and blue
+    EXPECT_LT(green(at(0, height - 1)), green(grey));
+    EXPECT_LT(blue(at(0, height - 1)), blue(grey));
+
+    // lines are doubled
+    EXPECT_EQ(dst[pitch], dst[0]);
+}
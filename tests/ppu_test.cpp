@@ -0,0 +1,645 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <cstring>
+#include <random>
+#include <utility>
+
+#include "PPU.h"
+#include "ThreadedPPU.h"
+
+namespace {
+    const i64 frameLength = 262 * 341;
+
+    // random tiles, nametables, attributes, palette and sprites, for loading the same picture into several PPUs
+    struct Scene {
+        std::vector<u8> chr;
+        std::vector<u8> nametables;
+        std::array<u8, 0x20> palette{};
+        std::array<u8, oamSize> oam{};
+    };
+
+    // sprites crowd the top of the screen, so plenty of lines have more than 8 of them
+    std::array<u8, oamSize> makeOam(std::mt19937& rng) {
+        std::array<u8, oamSize> oam{};
+        for (u16 i = 0; i < oamSize; ++i)
+            oam[i] = rng() & 0xff;
+        for (u16 i = 0; i < oamSize; i += 4)
+            oam[i] = i % 16 == 12 ? oam[i] : rng() % 96;
+
+        return oam;
+    }
+
+    Scene makeScene(std::mt19937& rng, u32 chrBytes = chrSize) {
+        Scene scene;
+        scene.chr.resize(chrBytes);
+        for (auto& byte : scene.chr)
+            byte = rng() & 0xff;
+        scene.nametables.resize(4 * vRamPageSize);
+        for (auto& byte : scene.nametables)
+            byte = rng() & 0xff;
+        for (auto& byte : scene.palette)
+            byte = rng() & 0x3f;
+        scene.oam = makeOam(rng);
+
+        return scene;
+    }
+
+    // OAM goes in the way a game puts it there, through DMA from page 2
+    void loadOam(Memory& memory, const std::array<u8, oamSize>& oam) {
+        for (u16 i = 0; i < oamSize; ++i)
+            memory.write(0x200 + i, oam[i]);
+        memory.oamDMA(0x200);
+    }
+
+    void loadScene(PPU& ppu, Memory& memory, const Scene& scene) {
+        ppu.loadChr(scene.chr.data(), scene.chr.size());
+        for (u16 i = 0; i < scene.nametables.size(); ++i)
+            ppu.writeVram(0x2000 + i, scene.nametables[i]);
+        for (u8 i = 0; i < scene.palette.size(); ++i)
+            ppu.writeVram(0x3f00 + i, scene.palette[i]);
+        loadOam(memory, scene.oam);
+    }
+
+    // what a CPU and a mapper do to the PPU, at a master cycle
+    struct Event {
+        enum class Type { Write, Read, OAMDMA, ChrPage, Mirroring };
+
+        i64 time = 0;
+        Type type = Type::Write;
+        u16 addr = 0;       // register, or the bank for ChrPage
+        u8 value = 0;       // the page for OAMDMA and ChrPage, mirroring flags for Mirroring
+    };
+
+    class Events {
+    public:
+        explicit Events(std::mt19937& rng) : rng(rng) {}
+
+        // vblank updates every frame and $2005/$2000 splits on any of them. The raster effects (bank and
+        // mirroring switches, PPUADDR splits, palette writes and the background toggled mid-frame) go on one
+        // frame out of every busyEvery, the cache draws the lines before the first of them.
+        std::vector<Event> make(u32 frames, u32 busyEvery, u16 chrBanks) {
+            list.clear();
+
+            for (u32 frame = 0; frame < frames; ++frame)
+            {
+                // frames drift a dot every other one, nowhere near the edges of vblank
+                const i64 start = frame * frameLength;
+
+                time = start + 242 * 341;
+                vblank(chrBanks);
+
+                for (u32 i = rng() % 3; i > 0; --i)
+                {
+                    time = start + (1 + rng() % 237) * 341 + rng() % 341;
+                    split();
+                }
+
+                if (frame % busyEvery == busyEvery - 1)
+                    for (u32 i = 1 + rng() % 3; i > 0; --i)
+                    {
+                        time = start + (1 + rng() % 237) * 341 + rng() % 341;
+                        rasterEffect(chrBanks);
+                    }
+            }
+
+            std::stable_sort(list.begin(), list.end(), [](const Event& a, const Event& b) { return a.time < b.time; });
+            return list;
+        }
+
+    private:
+        std::mt19937& rng;
+        std::vector<Event> list;
+        i64 time = 0;
+
+        void add(Event::Type type, u16 addr, u8 value) {
+            list.push_back({time++, type, addr, value});
+        }
+
+        void write(u16 addr, u8 value) { add(Event::Type::Write, addr, value); }
+        void read(u16 addr) { add(Event::Type::Read, addr, 0); }
+
+        nes_mapper_flags mirroring() {
+            const nes_mapper_flags all[] = {
+                nes_mapper_flags_vertical_mirroring, nes_mapper_flags_horizontal_mirroring,
+                nes_mapper_flags_one_screen_lower_mirroring, nes_mapper_flags_one_screen_upper_mirroring,
+                nes_mapper_flags_four_screen_mirroring,
+            };
+            return all[rng() % 5];
+        }
+
+        void vblank(u16 chrBanks) {
+            if (rng() % 2)
+            {
+                for (u16 i = 0; i < oamSize; ++i)
+                    write(0x200 + i, i % 4 == 0 ? rng() % 96 : rng() & 0xff);
+                write(ppu::OAMADDRAddress, 0);
+                add(Event::Type::OAMDMA, 0, 0x02);
+            }
+
+            read(ppu::PPUSTATUSAddress);
+            write(ppu::PPUADDRAddress, 0x3f);
+            write(ppu::PPUADDRAddress, rng() & 0x1f);
+            for (u32 i = 1 + rng() % 4; i > 0; --i)
+                write(ppu::PPUDATAAddress, rng() & 0x3f);
+
+            // some tiles and attributes, and back through the read buffer
+            const u16 addr = 0x2000 + rng() % 0x1000;
+            write(ppu::PPUADDRAddress, addr >> 8);
+            write(ppu::PPUADDRAddress, addr & 0xff);
+            for (u32 i = 1 + rng() % 8; i > 0; --i)
+                write(ppu::PPUDATAAddress, rng() & 0xff);
+            write(ppu::PPUADDRAddress, addr >> 8);
+            write(ppu::PPUADDRAddress, addr & 0xff);
+            read(ppu::PPUDATAAddress);
+            read(ppu::PPUDATAAddress);
+
+            if (rng() % 3 == 0)
+                add(Event::Type::ChrPage, rng() % chrBanks, rng() % 8);
+            if (rng() % 3 == 0)
+                add(Event::Type::Mirroring, 0, mirroring());
+
+            read(ppu::PPUSTATUSAddress);
+            write(ppu::PPUSCROLLAddress, rng() & 0xff);
+            write(ppu::PPUSCROLLAddress, rng() % 240);
+            write(ppu::PPUCTRLAddress, Bit7 | (rng() & (Bit0 | Bit1 | Bit2 | Bit4 | Bit5)));
+            write(ppu::PPUMASKAddress, 0x18 | (rng() & (Bit1 | Bit2 | Bit5 | Bit6 | Bit7)));
+        }
+
+        // status bar style, the next lines scroll elsewhere
+        void split() {
+            read(ppu::PPUSTATUSAddress);
+            write(ppu::PPUSCROLLAddress, rng() & 0xff);
+            write(ppu::PPUSCROLLAddress, rng() % 240);
+            write(ppu::PPUCTRLAddress, Bit7 | (rng() & (Bit0 | Bit1)));
+        }
+
+        void rasterEffect(u16 chrBanks) {
+            switch (rng() % 5) {
+                case 0:
+                    add(Event::Type::ChrPage, rng() % chrBanks, rng() % 8);
+                    break;
+                case 1:
+                    add(Event::Type::Mirroring, 0, mirroring());
+                    break;
+                case 2:
+                    read(ppu::PPUSTATUSAddress);
+                    write(ppu::PPUADDRAddress, 0x20 | (rng() & 0x0f));
+                    write(ppu::PPUADDRAddress, rng() & 0xff);
+                    break;
+                case 3:
+                    write(ppu::PPUADDRAddress, 0x3f);
+                    write(ppu::PPUADDRAddress, rng() & 0x1f);
+                    write(ppu::PPUDATAAddress, rng() & 0x3f);
+                    break;
+                default:
+                    write(ppu::PPUMASKAddress, 0x10);
+                    time += 20 + rng() % 300;
+                    write(ppu::PPUMASKAddress, 0x1e);
+                    break;
+            }
+        }
+    };
+
+    // what a run looks like from the outside: frames at every vblank, NMIs and the values register reads got
+    struct Trace {
+        std::vector<IndexedFrame> frames;
+        std::vector<i64> nmis;
+        std::vector<u8> reads;
+    };
+
+    // register accesses and DMA go through the memory's hooks, banks and mirroring straight to the target
+    template <class Target>
+    Trace play(Target& target, Memory& memory, const std::vector<Event>& events, u32 frames) {
+        Trace trace;
+        auto next = events.begin();
+
+        for (i64 cycle = 1; cycle <= frames * frameLength; ++cycle)
+        {
+            target.step(nes_cycle_t(cycle));
+            if (std::exchange(memory.cpuLines.nmi, false))
+                trace.nmis.push_back(cycle);
+
+            for (; next != events.end() && next->time <= cycle; ++next)
+            {
+                switch (next->type) {
+                    case Event::Type::Write:
+                        memory.write(next->addr, next->value);
+                        break;
+                    case Event::Type::Read:
+                        trace.reads.push_back(memory.read(next->addr));
+                        break;
+                    case Event::Type::OAMDMA:
+                        memory.oamDMA(u16(next->value) << 8);
+                        break;
+                    case Event::Type::ChrPage:
+                        target.setChrPage(next->value, next->addr);
+                        break;
+                    case Event::Type::Mirroring:
+                        target.setMirroring(nes_mapper_flags(next->value));
+                        break;
+                }
+            }
+
+            // well into vblank, the frame before is on the front buffer
+            if (cycle % frameLength == 250 * 341)
+            {
+                trace.frames.emplace_back();
+                target.getIndexedFrame(trace.frames.back());
+            }
+        }
+
+        return trace;
+    }
+
+    bool sameSprites(const std::vector<ppu::Sprite>& a, const std::vector<ppu::Sprite>& b) {
+        return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(ppu::Sprite)) == 0;
+    }
+}
+
+TEST(PPUTest, spritesInRangeMatchesRangeCheck) {
+    std::mt19937 rng(2002);
+    std::vector<u8> oam(oamSize);
+
+    for (int round = 0; round < 64; ++round) {
+        for (auto& byte : oam)
+            byte = rng() & 0xff;
+
+        for (u8 spriteHeight : {8, 16}) {
+            for (u16 scanline = 0; scanline < 240; ++scanline) {
+                u64 expected = 0;
+                for (int i = 0; i < 64; ++i) {
+                    u8 lastSpriteY = oam[i * 4];
+                    if (scanline != 0 && lastSpriteY + 1 <= scanline && scanline < lastSpriteY + 1 + spriteHeight)
+                        expected |= u64(1) << i;
+                }
+
+                ASSERT_EQ(ppu::spritesInRange(oam.data(), scanline, spriteHeight), expected)
+                    << "scanline " << scanline << " height " << int(spriteHeight);
+            }
+        }
+    }
+}
+
+TEST(PPUTest, scanlineEvaluationMatchesDotEvaluation) {
+    Memory dotMemory(ramSize), scanlineMemory(ramSize);
+    dotMemory.init();
+    scanlineMemory.init();
+    PPU dot(&dotMemory), scanline(&scanlineMemory);
+    scanline.setSpriteEvaluation(ppu::SpriteEvaluation::Scanline);
+
+    std::mt19937 rng(2026);
+    const Scene scene = makeScene(rng);
+    loadScene(dot, dotMemory, scene);
+    loadScene(scanline, scanlineMemory, scene);
+
+    IndexedFrame dotFrame, scanlineFrame;
+    u32 overflowLines = 0;
+
+    for (i64 cycle = 1; cycle <= 8 * frameLength; ++cycle)
+    {
+        dot.step(nes_cycle_t(cycle));
+        scanline.step(nes_cycle_t(cycle));
+        ASSERT_EQ(dot.getScanline(), scanline.getScanline());
+        ASSERT_EQ(dot.getDot(), scanline.getDot());
+
+        const u16 line = dot.getScanline();
+
+        // both finished evaluating, the dot evaluator sets the overflow flag earlier in the line
+        if (line < 240 && dot.getDot() == 300)
+        {
+            ASSERT_TRUE(sameSprites(dot.getSecondaryOAM(), scanline.getSecondaryOAM())) << "cycle " << cycle;
+
+            const u8 status = dotMemory.getReference(ppu::PPUSTATUSAddress);
+            ASSERT_EQ(status, scanlineMemory.getReference(ppu::PPUSTATUSAddress)) << "cycle " << cycle;
+            overflowLines += (status & Bit5) != 0;
+        }
+
+        // the last frame is on the front buffer, new sprites and 8x16 every other frame for the next one
+        if (line == 241 && dot.getDot() == 1)
+        {
+            dot.getIndexedFrame(dotFrame);
+            scanline.getIndexedFrame(scanlineFrame);
+            ASSERT_EQ(dotFrame.pixels, scanlineFrame.pixels) << "cycle " << cycle;
+
+            const auto oam = makeOam(rng);
+            const u8 control = dot.getFrameCount() % 2 ? Bit5 : 0;
+            for (Memory* memory : {&dotMemory, &scanlineMemory})
+            {
+                loadOam(*memory, oam);
+                memory->write(ppu::PPUCTRLAddress, control);
+                memory->write(ppu::PPUMASKAddress, 0x1e);
+            }
+        }
+    }
+
+    // crowded enough to have overflowed on plenty of lines
+    EXPECT_GT(overflowLines, 100u);
+}
+
+TEST(PPUTest, skippedFramesKeepTimingAndSprite0Hit) {
+    Memory fullMemory(ramSize), skipMemory(ramSize);
+    fullMemory.init();
+    skipMemory.init();
+    PPU full(&fullMemory), skip(&skipMemory);
+    skip.setFrameSkip(2);
+    ASSERT_EQ(skip.getFrameSkip(), 2);
+
+    std::mt19937 rng(2028);
+    const Scene scene = makeScene(rng);
+    loadScene(full, fullMemory, scene);
+    loadScene(skip, skipMemory, scene);
+
+    IndexedFrame fullFrame, skipFrame, shown;
+    u32 nmis = 0, hitFrames = 0;
+
+    for (i64 cycle = 1; cycle <= 12 * frameLength; ++cycle)
+    {
+        full.step(nes_cycle_t(cycle));
+        skip.step(nes_cycle_t(cycle));
+        const bool nmi = std::exchange(fullMemory.cpuLines.nmi, false);
+        ASSERT_EQ(std::exchange(skipMemory.cpuLines.nmi, false), nmi) << "cycle " << cycle;
+        nmis += nmi;
+
+        ASSERT_EQ(full.getFrameCount(), skip.getFrameCount());
+        // vblank, sprite 0 hit and overflow, dot for dot
+        const u8 status = fullMemory.getReference(ppu::PPUSTATUSAddress);
+        ASSERT_EQ(status, skipMemory.getReference(ppu::PPUSTATUSAddress)) << "cycle " << cycle;
+
+        if (full.getScanline() == 241 && full.getDot() == 1)
+        {
+            hitFrames += (status & Bit6) != 0;
+
+            // frames 0, 3, 6... are drawn, the front buffer stays put over the other two
+            const u32 finished = full.getFrameCount() - 1;
+            full.getIndexedFrame(fullFrame);
+            skip.getIndexedFrame(skipFrame);
+            if (finished % 3 == 0)
+            {
+                EXPECT_EQ(skipFrame.number, fullFrame.number);
+                EXPECT_EQ(skipFrame.pixels, fullFrame.pixels);
+            }
+            else
+            {
+                EXPECT_EQ(skipFrame.number, shown.number);
+                EXPECT_EQ(skipFrame.pixels, shown.pixels);
+            }
+            shown = skipFrame;
+
+            // a new picture for the next frame: sprites, scroll, size, and NMI on
+            const auto oam = makeOam(rng);
+            const u8 scrollX = rng() & 0xff, scrollY = rng() % 240;
+            const u8 control = Bit7 | (rng() & (Bit0 | Bit1 | Bit3 | Bit4 | Bit5));
+            for (Memory* memory : {&fullMemory, &skipMemory})
+            {
+                loadOam(*memory, oam);
+                memory->write(ppu::PPUSCROLLAddress, scrollX);
+                memory->write(ppu::PPUSCROLLAddress, scrollY);
+                memory->write(ppu::PPUCTRLAddress, control);
+                memory->write(ppu::PPUMASKAddress, 0x1e);
+            }
+        }
+    }
+
+    EXPECT_EQ(full.getFrameCount(), 12u);
+    EXPECT_EQ(nmis, 11u);
+    EXPECT_GT(hitFrames, 4u);
+}
+
+TEST(PPUTest, backgroundCacheMatchesTileRendering) {
+    std::mt19937 rng(2029);
+    const Scene scene = makeScene(rng, 0x8000);
+
+    // skipped frames only keep what sprite 0 hit needs from the background
+    for (u8 skip : {0, 1})
+    {
+        Memory tileMemory(ramSize), cacheMemory(ramSize);
+        tileMemory.init();
+        cacheMemory.init();
+        PPU tiles(&tileMemory), cached(&cacheMemory);
+        cached.setBackgroundCache(true);
+        tiles.setFrameSkip(skip);
+        cached.setFrameSkip(skip);
+
+        loadScene(tiles, tileMemory, scene);
+        loadScene(cached, cacheMemory, scene);
+
+        // raster effects on every fourth frame, the lines after them come from tiles
+        const u32 frames = 48;
+        const std::vector<Event> events = Events(rng).make(frames, 4, 0x8000 / vRamPageSize);
+        const Trace expected = play(tiles, tileMemory, events, frames);
+        const Trace actual = play(cached, cacheMemory, events, frames);
+
+        ASSERT_EQ(actual.frames.size(), expected.frames.size());
+        for (size_t i = 0; i < expected.frames.size(); ++i)
+        {
+            EXPECT_EQ(actual.frames[i].pixels, expected.frames[i].pixels) << "skip " << int(skip) << " frame " << i;
+            EXPECT_EQ(actual.frames[i].emphasis, expected.frames[i].emphasis) << "skip " << int(skip) << " frame " << i;
+            EXPECT_EQ(actual.frames[i].hash, expected.frames[i].hash) << "skip " << int(skip) << " frame " << i;
+        }
+        EXPECT_EQ(actual.nmis, expected.nmis);
+        EXPECT_EQ(actual.reads, expected.reads);
+    }
+}
+
+TEST(PPUTest, threadedPPUMatchesPPU) {
+    std::mt19937 rng(2031);
+    const Scene scene = makeScene(rng, 0x8000);
+
+    Memory memory(ramSize), threadedMemory(ramSize);
+    memory.init();
+    threadedMemory.init();
+    PPU ppu(&memory);
+    ThreadedPPU threaded(&threadedMemory);
+
+    loadScene(ppu, memory, scene);
+    // the PPU thread has nothing to do before the first step
+    loadScene(*threaded.getPPU(), threadedMemory, scene);
+
+    // register reads wait for the PPU thread, banks, mirroring and DMA are queued like writes
+    const u32 frames = 24;
+    const std::vector<Event> events = Events(rng).make(frames, 2, 0x8000 / vRamPageSize);
+    const Trace expected = play(ppu, memory, events, frames);
+    const Trace actual = play(threaded, threadedMemory, events, frames);
+
+    ASSERT_EQ(actual.frames.size(), expected.frames.size());
+    for (size_t i = 0; i < expected.frames.size(); ++i)
+    {
+        EXPECT_EQ(actual.frames[i].number, expected.frames[i].number) << "frame " << i;
+        EXPECT_EQ(actual.frames[i].hash, expected.frames[i].hash) << "frame " << i;
+        EXPECT_EQ(actual.frames[i].pixels, expected.frames[i].pixels) << "frame " << i;
+    }
+    EXPECT_EQ(actual.nmis, expected.nmis);
+    EXPECT_EQ(actual.reads, expected.reads);
+    EXPECT_EQ(threaded.getFrameCount(), ppu.getFrameCount());
+
+    // vblank and sprite 0 hit show up in the reads, NMI every frame from the first vblank on
+    EXPECT_EQ(expected.nmis.size(), frames - 1);
+    EXPECT_GT(std::count_if(expected.reads.begin(), expected.reads.end(), [](u8 value) { return value & Bit6; }), 0);
+}
+
+TEST(PPUTest, composeScanlinePriorityAndSprite0Hit) {
+    std::mt19937 rng(2001);
+    ppu::LineBuffer line;
+    std::array<u8, resolution.x> out{};
+
+    for (int round = 0; round < 256; ++round) {
+        bool expectedHit = false;
+
+        for (int x = 0; x < resolution.x; ++x) {
+            line.bgColor[x] = rng() & 0x3f;
+            line.bgOpaque[x] = (rng() & 1) ? 0xff : 0;
+            line.spriteColor[x] = rng() & 0x3f;
+            line.spriteOpaque[x] = (rng() & 1) ? 0xff : 0;
+            line.spriteFront[x] = (rng() & 1) ? 0xff : 0;
+            line.sprite0[x] = (round % 2 == 0 && line.spriteOpaque[x] && (rng() % 64) == 0) ? 0xff : 0;
+
+            expectedHit |= line.bgOpaque[x] && line.sprite0[x];
+        }
+
+        ASSERT_EQ(ppu::composeScanline(line, out.data()), expectedHit);
+
+        for (int x = 0; x < resolution.x; ++x) {
+            bool spriteWins = line.spriteOpaque[x] && (line.spriteFront[x] || !line.bgOpaque[x]);
+            ASSERT_EQ(out[x], spriteWins ? line.spriteColor[x] : line.bgColor[x]) << "x " << x;
+        }
+    }
+}
+
+TEST(PPUTest, nametableMirroringAndPaletteMirrors) {
+    Memory memory(ramSize);
+    memory.init();
+    PPU ppu(&memory);
+
+    ppu.setMirroring(nes_mapper_flags_vertical_mirroring);
+    ppu.writeVram(0x2000, 0x11);
+    ppu.writeVram(0x2400, 0x22);
+    EXPECT_EQ(ppu.readVram(0x2800), 0x11);
+    EXPECT_EQ(ppu.readVram(0x2c00), 0x22);
+    EXPECT_EQ(ppu.readVram(0x3400), 0x22);
+
+    ppu.setMirroring(nes_mapper_flags_horizontal_mirroring);
+    EXPECT_EQ(ppu.readVram(0x2400), 0x11);
+    EXPECT_EQ(ppu.readVram(0x2800), 0x22);
+
+    ppu.setMirroring(nes_mapper_flags_one_screen_upper_mirroring);
+    for (u16 addr : {0x2000, 0x2400, 0x2800, 0x2c00})
+        EXPECT_EQ(ppu.readVram(addr), 0x22);
+
+    ppu.setMirroring(nes_mapper_flags_four_screen_mirroring);
+    ppu.writeVram(0x2800, 0x33);
+    ppu.writeVram(0x2c00, 0x44);
+    EXPECT_EQ(ppu.readVram(0x2000), 0x11);
+    EXPECT_EQ(ppu.readVram(0x2400), 0x22);
+    EXPECT_EQ(ppu.readVram(0x2800), 0x33);
+    EXPECT_EQ(ppu.readVram(0x2c00), 0x44);
+
+    ppu.writeVram(0x3f10, 0x0f);
+    EXPECT_EQ(ppu.readVram(0x3f00), 0x0f);
+    EXPECT_EQ(ppu.readVram(0x3f30), 0x0f);
+    ppu.writeVram(0x3f11, 0x01);
+    EXPECT_NE(ppu.readVram(0x3f01), 0x01);
+
+    std::vector<u8> chr(0x4000);
+    for (size_t i = 0; i < chr.size(); ++i)
+        chr[i] = i / vRamPageSize;
+    ppu.loadChr(chr.data(), chr.size());
+    EXPECT_EQ(ppu.readVram(0x0400), 1);
+    ppu.setChrPage(1, 13);
+    EXPECT_EQ(ppu.readVram(0x0400), 13);
+}
+
+TEST(PPUTest, indexedFrameKeepsEmphasisPerLine) {
+    Memory memory(ramSize);
+    memory.init();
+    PPU ppu(&memory);
+
+    ppu.writeVram(0x3f00, 0x21);
+
+    // plain backdrop for the top half, red emphasis below
+    ppu.step(nes_cycle_t(120 * 341));
+    memory.write(ppu::PPUMASKAddress, 0x20);
+    ppu.step(nes_cycle_t(262 * 341 + 1));
+
+    IndexedFrame frame;
+    ppu.getIndexedFrame(frame);
+
+    ASSERT_EQ(frame.pixels.size(), resolution.x * resolution.y);
+    EXPECT_EQ(frame.number, 0);
+    EXPECT_EQ(frame.emphasis[10], 0);
+    EXPECT_EQ(frame.emphasis[200], 1);
+    EXPECT_EQ(frame.pixels[10 * resolution.x], 0x21);
+    EXPECT_EQ(frame.pixels[200 * resolution.x], 0x61);
+
+    const Color plain = ppu.getPalette()[0x21];
+    EXPECT_EQ(frame.palette[0x21].g, plain.g);
+    EXPECT_EQ(frame.palette[0x61].r, plain.r);
+    EXPECT_LT(frame.palette[0x61].g, plain.g);
+    EXPECT_LT(frame.palette[0x61].b, plain.b);
+}
+
+TEST(PPUTest, frameHashesFollowChangedStripes) {
+    Memory memory(ramSize);
+    memory.init();
+    PPU ppu(&memory);
+    const i64 frameLength = 262 * 341;
+
+    ppu.writeVram(0x3f00, 0x21);
+
+    IndexedFrame first, second, third;
+    ppu.step(nes_cycle_t(frameLength + 1));
+    ppu.getIndexedFrame(first);
+    // frame 1 is odd and a dot shorter
+    ppu.step(nes_cycle_t(2 * frameLength));
+    ppu.getIndexedFrame(second);
+
+    EXPECT_EQ(second.number, 1);
+    EXPECT_EQ(second.hash, first.hash);
+    EXPECT_EQ(second.changedStripes(first.stripes), 0);
+    EXPECT_EQ(ppu.getFrameHash(), second.hash);
+
+    // new backdrop from the middle of stripe 14 down
+    ppu.step(nes_cycle_t(2 * frameLength + 116 * 341));
+    ppu.writeVram(0x3f00, 0x16);
+    ppu.step(nes_cycle_t(3 * frameLength));
+    ppu.getIndexedFrame(third);
+
+    EXPECT_NE(third.hash, second.hash);
+    EXPECT_EQ(third.changedStripes(second.stripes), ((1u << stripeCount) - 1) & ~((1u << 14) - 1));
+}
+
+TEST(PPUTest, shownFrameMatchesOnlyIdenticalFrames) {
+    Memory memory(ramSize);
+    memory.init();
+    PPU ppu(&memory);
+
+    ppu.writeVram(0x3f00, 0x21);
+
+    IndexedFrame first, second, third;
+    ppu.step(nes_cycle_t(frameLength + 1));
+    ppu.getIndexedFrame(first);
+    ppu.step(nes_cycle_t(2 * frameLength));
+    ppu.getIndexedFrame(second);
+    ppu.writeVram(0x3f00, 0x16);
+    ppu.step(nes_cycle_t(3 * frameLength));
+    ppu.getIndexedFrame(third);
+
+    const u32 allStripes = (1u << stripeCount) - 1;
+    ShownFrame shown;
+    EXPECT_FALSE(shown.matches(first, false));
+    EXPECT_EQ(shown.changedStripes(first), allStripes);
+
+    shown.show(first);
+    EXPECT_TRUE(shown.matches(second, false));
+    // same picture, other parity
+    EXPECT_FALSE(shown.matches(second, true));
+    EXPECT_FALSE(shown.matches(third, false));
+    // what an upload has to redraw
+    EXPECT_EQ(shown.changedStripes(second), 0u);
+    EXPECT_EQ(shown.changedStripes(third), allStripes);
+
+    // a changed frame is shown and the next one is compared against it
+    shown.show(third);
+    EXPECT_TRUE(shown.matches(third, true));
+    EXPECT_FALSE(shown.matches(first, false));
+}
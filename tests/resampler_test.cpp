@@ -0,0 +1,66 @@
+#include <gtest/gtest.h>
+
+#include <cmath>
+#include <numbers>
+#include <vector>
+
+#include "Resampler.h"
+
+namespace {
+    // rms of what comes out for a sine at frequency, past the kernel's ramp in
+    double outputRms(ResampleQuality quality, double frequency) {
+        const double inRate = 1789773.0 / 8;
+        Resampler resampler(inRate, 48000, quality);
+
+        std::vector<float> in(22372);
+        for (size_t i = 0; i < in.size(); ++i)
+            in[i] = float(std::sin(2 * std::numbers::pi * frequency * i / inRate));
+
+        std::vector<float> out(resampler.maxOutput(in.size()));
+        out.resize(resampler.process(in.data(), in.size(), out.data()));
+
+        double sum = 0;
+        for (size_t i = 1000; i < out.size(); ++i)
+            sum += out[i] * out[i];
+
+        return std::sqrt(sum / (out.size() - 1000));
+    }
+}
+
+TEST(ResamplerTest, passesAudioAndRejectsAliases) {
+    for (ResampleQuality quality : {ResampleQuality::Fast, ResampleQuality::Medium, ResampleQuality::High})
+    {
+        // a full scale sine has an rms of 1 / sqrt(2)
+        EXPECT_NEAR(outputRms(quality, 1000), 1 / std::numbers::sqrt2, 0.01);
+        // would fold back to 8 kHz
+        EXPECT_LT(outputRms(quality, 40000), 0.001);
+    }
+
+    // the longest kernel is down to the noise floor right past the output's Nyquist
+    EXPECT_LT(outputRms(ResampleQuality::High, 26000), 0.001);
+}
+
+TEST(ResamplerTest, chunksMatchOneCall) {
+    Resampler whole(223722, 48000, ResampleQuality::Medium);
+    Resampler chunked(223722, 48000, ResampleQuality::Medium);
+
+    std::vector<float> in(10000);
+    for (size_t i = 0; i < in.size(); ++i)
+        in[i] = float((i * 7919) % 1000) / 1000;
+
+    std::vector<float> expected(whole.maxOutput(in.size()));
+    expected.resize(whole.process(in.data(), in.size(), expected.data()));
+
+    std::vector<float> actual;
+    for (size_t i = 0; i < in.size(); i += 937)
+    {
+        const size_t count = std::min<size_t>(937, in.size() - i);
+        std::vector<float> out(chunked.maxOutput(count));
+        out.resize(chunked.process(in.data() + i, count, out.data()));
+        actual.insert(actual.end(), out.begin(), out.end());
+    }
+
+    ASSERT_EQ(actual.size(), expected.size());
+    for (size_t i = 0; i < actual.size(); ++i)
+        EXPECT_EQ(actual[i], expected[i]);
+}
@@ -0,0 +1,56 @@
+#include <gtest/gtest.h>
+
+#include <numeric>
+#include <thread>
+#include <vector>
+
+#include "RingBuffer.h"
+#include "Types.h"
+
+TEST(RingBufferTest, bulkCopiesWrapAround) {
+    RingBuffer<u8, 16> ring;
+    std::vector<u8> in(32);
+    std::iota(in.begin(), in.end(), 0);
+    std::vector<u8> out(32);
+
+    // moves head and tail near the end first
+    EXPECT_EQ(ring.push(in.data(), 12), 12);
+    EXPECT_EQ(ring.pop(out.data(), 12), 12);
+
+    EXPECT_EQ(ring.push(in.data(), 32), ring.capacity());
+    EXPECT_EQ(ring.size(), ring.capacity());
+    EXPECT_FALSE(ring.push(in[0]));
+
+    EXPECT_EQ(ring.pop(out.data(), 32), ring.capacity());
+    EXPECT_TRUE(std::equal(out.begin(), out.begin() + ring.capacity(), in.begin()));
+    EXPECT_TRUE(ring.empty());
+    EXPECT_EQ(ring.pop(out.data(), 4), 0);
+}
+
+TEST(RingBufferTest, producerAndConsumerThreadsKeepOrder) {
+    RingBuffer<u32, 64> ring;
+    const u32 total = 100000;
+
+    std::thread producer([&] {
+        for (u32 i = 0; i < total;)
+        {
+            if (ring.push(i))
+                ++i;
+            else
+                std::this_thread::yield();
+        }
+    });
+
+    std::vector<u32> chunk(24);
+    u32 expected = 0;
+    while (expected < total)
+    {
+        size_t read = ring.pop(chunk.data(), chunk.size());
+        if (read == 0)
+            std::this_thread::yield();
+        for (size_t i = 0; i < read; ++i)
+            ASSERT_EQ(chunk[i], expected++);
+    }
+
+    producer.join();
+}
@@ -0,0 +1,184 @@
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <random>
+
+#include "Scaler.h"
+#include "WorkerPool.h"
+
+namespace {
+    // plain per pixel versions straight from the algorithm descriptions, edges repeat the border pixels
+    struct Image {
+        u16 width, height;
+        std::vector<u32> pixels;
+
+        u32 at(int x, int y) const {
+            x = std::clamp(x, 0, width - 1);
+            y = std::clamp(y, 0, height - 1);
+            return pixels[y * width + x];
+        }
+    };
+
+    Image scale2x(const Image& in) {
+        Image out{u16(in.width * 2), u16(in.height * 2), std::vector<u32>(in.width * 2 * in.height * 2)};
+        for (int y = 0; y < in.height; ++y)
+            for (int x = 0; x < in.width; ++x)
+            {
+                const u32 b = in.at(x, y - 1), d = in.at(x - 1, y), e = in.at(x, y), f = in.at(x + 1, y), h = in.at(x, y + 1);
+                const bool edge = b != h && d != f;
+                u32* o = &out.pixels[y * 2 * out.width + x * 2];
+                o[0] = edge && d == b ? d : e;
+                o[1] = edge && b == f ? f : e;
+                o[out.width] = edge && d == h ? d : e;
+                o[out.width + 1] = edge && h == f ? f : e;
+            }
+        return out;
+    }
+
+    Image scale3x(const Image& in) {
+        Image out{u16(in.width * 3), u16(in.height * 3), std::vector<u32>(in.width * 3 * in.height * 3)};
+        for (int y = 0; y < in.height; ++y)
+            for (int x = 0; x < in.width; ++x)
+            {
+                const u32 a = in.at(x - 1, y - 1), b = in.at(x, y - 1), c = in.at(x + 1, y - 1);
+                const u32 d = in.at(x - 1, y), e = in.at(x, y), f = in.at(x + 1, y);
+                const u32 g = in.at(x - 1, y + 1), h = in.at(x, y + 1), i = in.at(x + 1, y + 1);
+                const bool edge = b != h && d != f;
+                const u32 result[9] = {
+                    edge && d == b ? d : e,
+                    edge && ((d == b && e != c) || (b == f && e != a)) ? b : e,
+                    edge && b == f ? f : e,
+                    edge && ((d == b && e != g) || (d == h && e != a)) ? d : e,
+                    e,
+                    edge && ((b == f && e != i) || (h == f && e != c)) ? f : e,
+                    edge && d == h ? d : e,
+                    edge && ((d == h && e != i) || (h == f && e != g)) ? h : e,
+                    edge && h == f ? f : e,
+                };
+                for (int row = 0; row < 3; ++row)
+                    for (int column = 0; column < 3; ++column)
+                        out.pixels[(y * 3 + row) * out.width + x * 3 + column] = result[row * 3 + column];
+            }
+        return out;
+    }
+
+    Image xbr(const Image& in) {
+        auto luma = [](u32 p) { return i32((((p >> 24) & 0xff) * 77 + ((p >> 16) & 0xff) * 150 + ((p >> 8) & 0xff) * 29) >> 8); };
+        auto average = [](u32 p, u32 q) {
+            u32 result = 0;
+            for (int shift = 0; shift < 32; shift += 8)
+                result |= ((((p >> shift) & 0xff) + ((q >> shift) & 0xff) + 1) / 2) << shift;
+            return result;
+        };
+
+        Image out{u16(in.width * 2), u16(in.height * 2), std::vector<u32>(in.width * 2 * in.height * 2)};
+        for (int y = 0; y < in.height; ++y)
+            for (int x = 0; x < in.width; ++x)
+            {
+                const u32 e = in.at(x, y);
+                const i32 le = luma(e);
+                auto l = [&](int dx, int dy) { return luma(in.at(x + dx, y + dy)); };
+
+                // each output pixel is the corner towards n, between the edge neighbours p and q. p2/q2 are the
+                // pixels beside p/q away from n, op/oq the ones opposite p/q. Ties pick p, which is the
+                // vertical neighbour in the top left and bottom right corners.
+                for (int sy : {-1, 1})
+                    for (int sx : {-1, 1})
+                    {
+                        const int px = sx == sy ? 0 : sx, py = sx == sy ? sy : 0;
+                        const int qx = sx - px, qy = sy - py;
+                        const i32 lp = l(px, py), lq = l(qx, qy);
+
+                        const i32 edge = std::abs(le - l(2 * px - sx, 2 * py - sy)) + std::abs(le - l(2 * qx - sx, 2 * qy - sy))
+                                         + 4 * std::abs(lp - lq);
+                        const i32 across = std::abs(lq - l(-px, -py)) + std::abs(lp - l(-qx, -qy)) + 4 * std::abs(le - l(sx, sy));
+                        const u32 pick = std::abs(le - lp) > std::abs(le - lq) ? in.at(x + qx, y + qy) : in.at(x + px, y + py);
+
+                        out.pixels[(y * 2 + (sy > 0)) * out.width + x * 2 + (sx > 0)] = edge < across ? average(e, pick) : e;
+                    }
+            }
+        return out;
+    }
+}
+
+TEST(ScalerTest, scale2xRoundsDiagonals) {
+    const u32 o = 0x00000000, x = 0xffffff00;
+    // 5x3 diagonal, wide enough for a vector and a scalar tail
+    std::vector<u32> src = {
+        x, o, o, o, o,
+        o, x, o, o, o,
+        o, o, x, o, o,
+    };
+
+    Scaler scaler;
+    scaler.setFilter(ScaleFilter::Scale2x);
+    std::vector<u32> dst(10 * 6);
+    scaler.scale(src.data(), 5, 3, dst.data(), 10);
+
+    // the diagonal stays as it is, the background pixel right of it fills the corner between both steps
+    for (int i : {2, 3})
+        for (int j : {2, 3})
+            EXPECT_EQ(dst[i * 10 + j], x);
+
+    EXPECT_EQ(dst[2 * 10 + 4], o);
+    EXPECT_EQ(dst[2 * 10 + 5], o);
+    EXPECT_EQ(dst[3 * 10 + 4], x);
+    EXPECT_EQ(dst[3 * 10 + 5], o);
+}
+
+TEST(ScalerTest, slicedMatchesSingleThread) {
+    std::mt19937 rng(7);
+    const u16 width = 67, height = 45;
+    std::vector<u32> src(width * height);
+    for (auto& pixel : src)
+        pixel = (rng() % 3) << 24;
+
+    WorkerPool pool(3);
+
+    for (ScaleFilter filter : {ScaleFilter::Nearest, ScaleFilter::Scale2x, ScaleFilter::Scale3x,
+                               ScaleFilter::Scale4x, ScaleFilter::XBR}) {
+        Scaler single;
+        Scaler sliced(&pool);
+        single.setFilter(filter, 5);
+        sliced.setFilter(filter, 5);
+
+        const u8 factor = single.getFactor();
+        std::vector<u32> a(width * factor * height * factor), b(a.size());
+        single.scale(src.data(), width, height, a.data(), width * factor);
+        sliced.scale(src.data(), width, height, b.data(), width * factor);
+
+        EXPECT_EQ(a, b) << "filter " << int(filter);
+    }
+}
+
+TEST(ScalerTest, simdMatchesPerPixelReference) {
+    std::mt19937 rng(33);
+    // odd sizes for the scalar tails, a few colours so the equality rules fire, close lumas for XBR's ties
+    const u32 palette[] = {0x00000000, 0xffffff00, 0x80808000, 0x81807f00, 0xc8282800, 0x30a03000, 0x1d1d5500};
+    const u16 width = 37, height = 23;
+
+    for (u32 frame = 0; frame < 20; ++frame)
+    {
+        Image src{width, height, std::vector<u32>(width * height)};
+        const u32 colours = 2 + frame % 6;
+        for (auto& pixel : src.pixels)
+            pixel = palette[rng() % colours];
+
+        const std::pair<ScaleFilter, Image> expected[] = {
+            {ScaleFilter::Scale2x, scale2x(src)},
+            {ScaleFilter::Scale3x, scale3x(src)},
+            {ScaleFilter::Scale4x, scale2x(scale2x(src))},
+            {ScaleFilter::XBR, xbr(src)},
+        };
+
+        for (const auto& [filter, reference] : expected)
+        {
+            Scaler scaler;
+            scaler.setFilter(filter);
+            std::vector<u32> dst(reference.pixels.size());
+            scaler.scale(src.pixels.data(), width, height, dst.data(), reference.width);
+
+            EXPECT_EQ(dst, reference.pixels) << "filter " << int(filter) << " frame " << frame;
+        }
+    }
+}
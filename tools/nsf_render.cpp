@@ -0,0 +1,66 @@
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include "AudioRecorder.h"
+#include "Logger.h"
+#include "Nsf.h"
+#include "Settings.h"
+#include "WorkerPool.h"
+
+// Renders NSF tracks to WAV files as fast as the machine goes, one track per core at a time.
+// Usage: NsfRender <file.nsf> <seconds> <output prefix> [track...]
+// Tracks are 1 based, all of them when none are given, each goes to <prefix>_<track>.wav.
+
+int main(int argc, char* argv[]) {
+    if (argc < 4)
+    {
+        std::fprintf(stderr, "usage: %s <file.nsf> <seconds> <output prefix> [track...]\n", argv[0]);
+        return 1;
+    }
+
+    Nsf nsf;
+    if (!nsf.load(argv[1]))
+        return 1;
+
+    const double seconds = std::atof(argv[2]);
+    const std::string prefix = argv[3];
+
+    std::vector<u8> tracks;
+    for (int i = 4; i < argc; ++i)
+    {
+        const int track = std::atoi(argv[i]);
+        if (track >= 1 && track <= nsf.getTrackCount())
+            tracks.push_back(u8(track - 1));
+    }
+    if (argc == 4)
+        for (u8 track = 0; track < nsf.getTrackCount(); ++track)
+            tracks.push_back(track);
+
+    INFOLOG(nsf.getName() + " by " + nsf.getArtist() + ", rendering " + std::to_string(tracks.size()) + " tracks");
+
+    WorkerPool pool;
+    std::atomic<u32> failed{0};
+
+    pool.run(u32(tracks.size()), [&](u32 i) {
+        const u8 track = tracks[i];
+        char number[8];
+        std::snprintf(number, sizeof(number), "_%02u", track + 1);
+
+        AudioRecorder recorder(prefix + number + ".wav", AudioRecorder::Format::Wav, audioFrequency,
+                               AudioRecorder::Overflow::Wait);
+        if (!recorder.isOpen())
+        {
+            failed++;
+            return;
+        }
+
+        NsfPlayer player(nsf);
+        if (!player.render(track, seconds, &recorder))
+            failed++;
+    });
+
+    return failed > 0 ? 1 : 0;
+}